@@ -0,0 +1,62 @@
+// Reads what JoyShockMapper publishes with OUTPUT_DEVICE = SHARED_MEMORY, the way a game would once per frame.
+// Build it with the JSM_EXAMPLES CMake option, or on its own with:
+//   g++ -std=c++17 -I../include SharedMemoryReader.cpp -o SharedMemoryReader -lrt
+
+#include "SharedMemoryOutput.h"
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+int main()
+{
+	SharedOutputReader reader;
+	while (!reader.Open())
+	{
+		std::printf("Waiting for JoyShockMapper to open %s...\n", SHARED_OUTPUT_NAME);
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+	}
+
+	// Camera motion is the difference of the running totals, so no motion is lost even if frames were skipped
+	SharedOutputFrame frame;
+	uint64_t last = reader->head.load(std::memory_order_acquire);
+	double lastX = 0., lastY = 0.;
+	if (reader->TryRead(last, frame))
+	{
+		lastX = frame.totalX;
+		lastY = frame.totalY;
+	}
+
+	for (;;)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(16)); // One game frame
+
+		int frames = 0;
+		while (reader->ReadNext(last, frame))
+		{
+			++frames;
+		}
+		if (frames == 0)
+		{
+			continue;
+		}
+		std::printf("%3d ticks, camera %+8.3f %+8.3f", frames, frame.totalX - lastX, frame.totalY - lastY);
+		lastX = frame.totalX;
+		lastY = frame.totalY;
+
+		std::printf(", held:");
+		for (int key = 0; key < SHARED_OUTPUT_KEY_WORDS * 32; ++key)
+		{
+			if (frame.IsKeyDown(key))
+			{
+				std::printf(" 0x%02X", key);
+			}
+		}
+		for (int i = 0; i < SHARED_OUTPUT_CONTROLLERS && frame.controllers[i] != -1; ++i)
+		{
+			const float *q = frame.orientation[i];
+			std::printf(", controller %d: %.3f %.3f %.3f %.3f", frame.controllers[i], q[0], q[1], q[2], q[3]);
+		}
+		std::printf("\n");
+	}
+}
@@ -6,6 +6,7 @@
 #include <map>
 #include <memory>
 #include <string_view>
+#include <unordered_map>
 
 // This is a base class for any Command line operation. It binds a command name to a parser function
 // Derivatives from this class have a default parser function and performs specific operations.
@@ -32,6 +33,9 @@ protected:
 	// Some task to perform when this object is destroyed
 	TaskOnDestruction _taskOnDestruction;
 
+	// Whether running the command does nothing besides changing JSM variables
+	bool _onlyChangesVariables = false;
+
 public:
 	// Name of the command. Cannot be changed after construction.
 	// I don't mind leaving this public since it can't be changed.
@@ -50,7 +54,7 @@ public:
 	// It returns a pointer to itself for setter chaining.
 	virtual JSMCommand* SetHelp(in_string commandDescription);
 
-	virtual unique_ptr<JSMCommand> GetModifiedCmd(char op, in_string chord);
+	virtual unique_ptr<JSMCommand> GetModifiedCmd(char op, string_view chord);
 
 	// Get the help string for the command.
 	inline string Help() const
@@ -65,13 +69,51 @@ public:
 		return this;
 	}
 
+	// Flag a command that only changes JSM variables. Configurations made only of those can be compiled in a profile.
+	inline JSMCommand* SetOnlyChangesVariables(bool onlyChangesVariables = true)
+	{
+		_onlyChangesVariables = onlyChangesVariables;
+		return this;
+	}
+
+	inline bool OnlyChangesVariables() const
+	{
+		return _onlyChangesVariables;
+	}
+
 	// Request this command to parse the command arguments. Returns true if the command was processed.
-	virtual bool ParseData(in_string arguments);
+	// The arguments view the line being processed: they're only copied to be handed to the parser.
+	virtual bool ParseData(string_view arguments);
+};
+
+// The parts of a line of text entered in the console or found in a configuration file:
+// [<combo> <op>] <name> <arguments> [# <label>]
+// They point into the line they were read from.
+struct CmdLine
+{
+	string_view combo;
+	char op = '\0';
+	string_view name;
+	string_view arguments;
+	string_view label;
+};
+
+// Told about the files and commands run while a configuration loads. See ProfileCache.
+class LoadObserver
+{
+public:
+	virtual ~LoadObserver() = default;
+
+	// path is where the file was actually found
+	virtual void OnFileLoaded(in_string path) = 0;
+
+	// Return false to skip the command
+	virtual bool OnCommand(const JSMCommand& cmd) = 0;
 };
 
 // The command registry holds all JSMCommands object and should not care what the derived type is.
 // It's capable of recognizing a command and requesting it to process arguments. That's it.
-// It uses regular expression to breakup a command string in its various components.
+// It breaks up a command string in its various components with a small tokenizer.
 // Currently it refuses to accept different commands with the same name but there's an
 // argument to be made to use the return value of JSMCommand::ParseData() to attempt multiple
 // commands until one returns true. This can enable multiple parsers for the same command.
@@ -80,12 +122,24 @@ class CmdRegistry
 private:
 	typedef multimap<string, unique_ptr<JSMCommand>> CmdMap;
 
-	// multimap allows multiple entries with the same keys
+	// Commands sharing a name, such as SL and SR, are kept in the order they were added
+	typedef unordered_map<string_view, vector<JSMCommand*>> CmdIndex;
+
+	// multimap allows multiple entries with the same keys, and keeps them sorted for the command list
 	CmdMap _registry;
 
+	// Hash index over _registry used to look commands up. Keys point to the names of the commands themselves.
+	CmdIndex _index;
+
+	LoadObserver* _loadObserver = nullptr;
+
 	static string_view strtrim(std::string_view str);
 
-	static bool findCommandWithName(in_string name, CmdMap::value_type& pair);
+	// Returns nullptr if no command has that name
+	const vector<JSMCommand*>* findCommands(string_view name) const;
+
+	// Returns false if the line can't be a command, in which case all parts are left empty
+	static bool tokenize(string_view line, CmdLine& parts);
 
 public:
 	CmdRegistry();
@@ -113,6 +167,12 @@ public:
 
 	// Return help string for provided command
 	string GetHelp(in_string command);
+
+	// Set to nullptr to stop observing
+	inline void SetLoadObserver(LoadObserver* observer)
+	{
+		_loadObserver = observer;
+	}
 };
 
 // Macro commands are simple function calls when recognized. But it could do different things
@@ -9,6 +9,45 @@
 #include <utility>
 #include <vector>
 #include <atomic>
+#include <cstdint>
+
+// Receives the keyboard and mouse output of the calling thread instead of the OS, while it is set.
+// This is how a replay captures what a recording produces.
+class OutputSink
+{
+public:
+	virtual ~OutputSink() = default;
+
+	virtual void pressKey(KeyCode key, bool pressed) = 0;
+
+	// Relative movement in pixels, including fractions
+	virtual void moveMouse(float x, float y) = 0;
+
+	// Absolute position, normalized to the screen
+	virtual void setMouseNorm(float x, float y) = 0;
+
+	// Orientation quaternion of the given controller
+	virtual void setOrientation(int handle, float w, float x, float y, float z)
+	{
+	}
+
+	// Called at the end of every output frame, and after any output sent outside of one
+	virtual void flush()
+	{
+	}
+};
+
+// Pass nullptr to send output to the OS again
+void setOutputSink(OutputSink *sink);
+
+// Whether the calling thread has a sink of its own, such as a replay capturing its output
+bool hasOutputSink();
+
+// Where the output of threads without a sink of their own goes. Returns false if that device can't be used.
+bool setOutputDevice(OutputDevice device);
+
+// Only output devices made for games to read, such as shared memory, make use of the controller orientation
+void setOrientation(int handle, float w, float x, float y, float z);
 
 // get the user's mouse sensitivity multiplier from the user. In Windows it's an int, but who cares? it's well within range for float to represent it exactly
 // also, if this is ported to other platforms, we might want non-integer sensitivities
@@ -24,9 +63,16 @@ void moveMouse(float x, float y);
 
 void setMouseNorm(float x, float y);
 
+// Output sent between these calls is held back and handed to the OS all at once by flushOutputFrame,
+// so that everything produced while processing a controller report arrives as a single event.
+void beginOutputFrame();
+
+void flushOutputFrame();
+
 // delta time will apply to shaped movement, but the extra (velocity parameters after deltaTime) is
 // applied as given
-inline void shapedSensitivityMoveMouse(float x, float y, std::pair<float, float> lowSensXY, std::pair<float, float> hiSensXY,
+// Mouse motion for the given gyro velocity, in pixels
+inline std::pair<float, float> shapedSensitivityMouseMotion(float x, float y, std::pair<float, float> lowSensXY, std::pair<float, float> hiSensXY,
   float minThreshold, float maxThreshold, float deltaTime, float extraVelocityX, float extraVelocityY, float calibration)
 {
 	// apply calibration factor
@@ -59,8 +105,8 @@ inline void shapedSensitivityMoveMouse(float x, float y, std::pair<float, float>
 	  (hiSensXY.second * calibration) * newSensitivity;
 
 	// apply all values
-	moveMouse((x * newSensitivityX) * deltaTime + extraVelocityX,
-	  (y * newSensitivityY) * deltaTime + extraVelocityY);
+	return { (x * newSensitivityX) * deltaTime + extraVelocityX,
+	  (y * newSensitivityY) * deltaTime + extraVelocityY };
 }
 
 BOOL WriteToConsole(in_string command);
@@ -72,8 +118,38 @@ void initConsole();
 
 std::tuple<std::string, std::string> GetActiveWindowName();
 
+// Block until another window comes in focus, or timeoutMs goes by. Returns whether focus changed.
+// The first call returns right away. Where focus changes can't be watched, it sleeps and always returns true.
+// Only call it from one thread.
+bool WaitForFocusChange(int timeoutMs);
+
 std::vector<std::string> ListDirectory(std::string directory);
 
+// Tells when files are added to, removed from or renamed in a folder, so that it doesn't need listing again
+class DirectoryWatcher
+{
+public:
+	DirectoryWatcher(in_string directory);
+
+	// Also tells when files in the folders are written to
+	DirectoryWatcher(const std::vector<std::string> &directories, bool watchContents);
+
+	~DirectoryWatcher();
+
+	DirectoryWatcher(const DirectoryWatcher &) = delete;
+	DirectoryWatcher &operator=(const DirectoryWatcher &) = delete;
+
+	// Doesn't block. Always true if a folder can't be watched, such as when it doesn't exist.
+	bool HasChanged();
+
+	// Block until something changes or timeoutMs goes by. Sleeps and returns true if a folder can't be watched.
+	bool WaitForChange(int timeoutMs);
+
+private:
+	// One inotify file descriptor, or a change notification handle per folder. Empty when not watching.
+	std::vector<intptr_t> _handles;
+};
+
 std::string GetCWD();
 
 bool SetCWD(in_string newCWD);
@@ -5,8 +5,9 @@
 #include "JSMVariable.hpp"
 #include "PlatformDefinitions.h"
 
+#include <cctype>
 #include <iostream>
-#include <regex>
+#include <string_view>
 
 // This class handles any kind of assignment command by binding to a JSM variable
 // of the parameterized type T. If T is not a base type, implement the following
@@ -25,23 +26,41 @@ protected:
 	// For example the two GYRO_SENS assignment commands will display MIN_GYRO_SENS and MAX_GYRO_SENS respectively.
 	const string _displayName;
 
-	virtual bool ParseData(in_string arguments) override
+	// Returns whether the arguments are empty or of the form \s*=\s*(.*), with the value after the equal sign
+	static bool splitAssignment(string_view arguments, string_view &value)
 	{
-		smatch results;
+		auto isSpace = [](char c) { return isspace(static_cast<unsigned char>(c)) != 0; };
+		string_view rest(arguments);
+		while (!rest.empty() && isSpace(rest.front()))
+			rest.remove_prefix(1);
+		if (rest.empty() || rest.front() != '=')
+		{
+			value = rest;
+			return arguments.empty();
+		}
+		rest.remove_prefix(1);
+		while (!rest.empty() && isSpace(rest.front()))
+			rest.remove_prefix(1);
+		value = rest;
+		return true;
+	}
+
+	virtual bool ParseData(string_view arguments) override
+	{
+		string_view value;
 		_ASSERT_EXPR(_parse, L"There is no function defined to parse this command.");
-		if (arguments.compare(0, 4, "HELP") == 0 && !_help.empty())
+		if (arguments.substr(0, 4) == "HELP" && !_help.empty())
 		{
 			// Show help.
 			COUT << _help << endl;
 		}
-		else if (arguments.empty() || regex_match(arguments, results, regex(R"(\s*=\s*(.*))")))
+		else if (splitAssignment(arguments, value))
 		{
-			string fwd_args(results.empty() ? arguments : results[1].str());
-			if (fwd_args.rfind("DEFAULT", 0) == 0)
+			if (value.substr(0, 7) == "DEFAULT")
 			{
 				_var.Reset();
 			}
-			else if (!_parse(this, fwd_args) && !_help.empty())
+			else if (!_parse(this, string(value)) && !_help.empty())
 			{
 				COUT << _help << endl
 				     << "The "; // Parsing has failed. Show help.
@@ -114,11 +133,9 @@ protected:
 		COUT << _displayName << " has been set to " << newValue << endl;
 	}
 
-	virtual unique_ptr<JSMCommand> GetModifiedCmd(char op, in_string chord) override
+	virtual unique_ptr<JSMCommand> GetModifiedCmd(char op, string_view chord) override
 	{
-		stringstream ss(chord);
-		ButtonID btn;
-		ss >> btn;
+		ButtonID btn = toButtonID(chord);
 		if (btn > ButtonID::NONE)
 		{
 			if (op == ',')
@@ -127,7 +144,7 @@ protected:
 				if (settingVar)
 				{
 					//Create Modeshift
-					string name = chord + op + _displayName;
+					string name = string(chord) + op + _displayName;
 					unique_ptr<JSMCommand> chordAssignment(new JSMAssignment<T>(name, *settingVar->AtChord(btn)));
 					chordAssignment->SetHelp(_help)->SetParser(bind(&JSMAssignment<T>::ModeshiftParser, btn, settingVar, _parse, placeholders::_1, placeholders::_2))->SetTaskOnDestruction(bind(&JSMSetting<T>::ProcessModeshiftRemoval, settingVar, btn));
 					return chordAssignment;
@@ -135,7 +152,7 @@ protected:
 				auto buttonVar = dynamic_cast<JSMButton*>(&_var);
 				if (buttonVar && btn > ButtonID::NONE)
 				{
-					string name = chord + op + _displayName;
+					string name = string(chord) + op + _displayName;
 					auto chordedVar = buttonVar->AtChord(btn);
 					// The reinterpret_cast is required for compilation, but settings will never run this code anyway.
 					unique_ptr<JSMCommand> chordAssignment(new JSMAssignment<T>(name, reinterpret_cast<JSMVariable<T>&>(*chordedVar)));
@@ -150,7 +167,7 @@ protected:
 				auto buttonVar = dynamic_cast<JSMButton*>(&_var);
 				if (buttonVar && btn > ButtonID::NONE)
 				{
-					string name = chord + op + _displayName;
+					string name = string(chord) + op + _displayName;
 					auto simPressVar = buttonVar->AtSimPress(btn);
 					unique_ptr<JSMCommand> simAssignment(new JSMAssignment<Mapping>(name, *simPressVar));
 					simAssignment->SetHelp(_help)->SetParser(_parse)->SetTaskOnDestruction(bind(&JSMButton::ProcessSimPressRemoval, buttonVar, btn, simPressVar));
@@ -177,6 +194,7 @@ public:
 		// Child Classes assign their own parser. Use bind to convert instance function call
 		// into a static function call.
 		SetParser(&JSMAssignment::DefaultParser);
+		SetOnlyChangesVariables();
 		if (_hasListener)
 		{
 			_listenerId = _var.AddOnChangeListener(bind(&JSMAssignment::DisplayNewValue, this, placeholders::_1));
@@ -212,5 +230,5 @@ public:
 template<>
 void JSMAssignment<Mapping>::DisplayNewValue(Mapping newValue)
 {
-	COUT << _name << " mapped to " << newValue._description << endl;
+	COUT << _name << " mapped to " << newValue.getDescription() << endl;
 }
@@ -2,10 +2,56 @@
 
 #include "JoyShockMapper.h"
 #include <sstream>
+#include <atomic>
+#include <array>
+#include <bitset>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 // Global ID generator
 static unsigned int _delegateID = 1;
 
+// Incremented every time any variable or chord changes. Code caching resolved values compares
+// it to the revision it last resolved against to know when to resolve them again.
+inline atomic<unsigned int> variablesRevision{ 0 };
+
+// Learns which variables, chords and sim presses a configuration changes while it is being loaded,
+// so that their final state can be put back later without loading the configuration again. See ProfileCache.
+class VariableObserver
+{
+public:
+	// Puts a variable, chord or sim press back in the state it was in when captured. This is done by assigning
+	// each value again, so listeners only hear about what actually differs from that state.
+	struct Restore
+	{
+		function<bool()> differs; // Whether it is in any other state now
+		function<void()> apply;
+	};
+
+	// Returns what puts the variable back in the state it is in when called
+	typedef function<Restore()> Capture;
+
+	virtual ~VariableObserver() = default;
+
+	// Called before the change. slot is -1 for the variable itself, or identifies one of its chords or sim presses.
+	virtual void OnChange(const void *variable, int slot, Capture capture) = 0;
+
+	// Called before the variable gets reset along with all its chords and sim presses. capture covers all of them.
+	virtual void OnReset(const void *variable, Capture capture) = 0;
+};
+
+// Only the thread loading the configuration is observed
+inline thread_local VariableObserver *variableObserver = nullptr;
+
+// While set, the calling thread changes copies of the variables instead, made the first time each is changed.
+// It reads those copies back, while other threads keep seeing the variables untouched. Copies are keyed by
+// the variable they were made from, and only run the listeners that only change other variables.
+typedef unordered_map<const void *, shared_ptr<void>> VariableShadow;
+inline thread_local VariableShadow *variableShadow = nullptr;
+
 // JSMVariable is a wrapper class for an underlying variable of type T.
 // This class allows other parts of the code be notified of when it changes value.
 // It also has a default value defined at construction that can be assigned on Reset.
@@ -26,12 +72,77 @@ protected:
 	// The variable value itself
 	T _value;
 
-	// Parts of the code can be notified of when _value changes.
-	map<unsigned int, OnChangeDelegate> _onChangeListeners;
+	struct Listener
+	{
+		unsigned int id;
+		OnChangeDelegate call;
+		bool onlyChangesVariables; // Also runs on the copies in a variableShadow
+	};
+
+	// Parts of the code can be notified of when _value changes. There are rarely more than a couple,
+	// so they're kept in a vector in order of registration.
+	vector<Listener> _onChangeListeners;
 
 	// The filtering function of the variable.
 	FilterDelegate _filter;
 
+	// Chords and sim presses are reported to the variableObserver, and copied in a variableShadow, by the variable
+	// holding them. Copies in a variableShadow are reported through the variable they were made from.
+	bool _nested = false;
+
+	// Incremented along with variablesRevision when the variable or one of its chords or sim presses changes.
+	// They all share it, so that what depends on one variable only is resolved again when that one changes.
+	// Copies in a variableShadow have none: only the thread that made them reads them.
+	shared_ptr<atomic<unsigned int>> _revision;
+
+	void Changed()
+	{
+		if (_revision)
+		{
+			variablesRevision++;
+			(*_revision)++;
+		}
+	}
+
+	// The copy of this variable in the variableShadow if there is one, or the variable itself
+	template<typename V = JSMVariable>
+	const V *Current() const
+	{
+		if (variableShadow && !_nested)
+		{
+			auto copy = variableShadow->find(this);
+			if (copy != variableShadow->end())
+			{
+				return static_cast<const V *>(static_cast<const JSMVariable *>(copy->second.get()));
+			}
+		}
+		return static_cast<const V *>(this);
+	}
+
+	// The copy of this variable to change instead while there is a variableShadow, made if need be. nullptr otherwise.
+	template<typename V = JSMVariable>
+	V *Shadowed()
+	{
+		if (!variableShadow || _nested)
+		{
+			return nullptr;
+		}
+		auto &copy = (*variableShadow)[this];
+		if (!copy)
+		{
+			copy = shared_ptr<JSMVariable>(Clone());
+		}
+		return static_cast<V *>(static_cast<JSMVariable *>(copy.get()));
+	}
+
+	// Turns a copy of a variable into one for a variableShadow
+	virtual void MakeShadow()
+	{
+		_onChangeListeners.erase(remove_if(_onChangeListeners.begin(), _onChangeListeners.end(), [](const auto &listener) { return !listener.onlyChangesVariables; }), _onChangeListeners.end());
+		_nested = true;
+		_revision.reset();
+	}
+
 	// The default filtering function simply accepts the new value.
 	static T NoFiltering(T old, T nu)
 	{
@@ -46,6 +157,7 @@ public:
 	  : _value(defaultValue)
 	  , _onChangeListeners()
 	  , _filter(&NoFiltering) // _filter is always valid
+	  , _revision(make_shared<atomic<unsigned int>>(0))
 	  , _defVal(defaultValue)
 	{
 	}
@@ -55,6 +167,8 @@ public:
 	  : _value(defaultValue)
 	  , _onChangeListeners() // Don't copy listeners. This is a different variable!
 	  , _filter(copy._filter)
+	  , _nested(true)
+	  , _revision(copy._revision)
 	  , _defVal(defaultValue)
 	{
 	}
@@ -64,6 +178,14 @@ public:
 		_onChangeListeners.clear();
 	}
 
+	// Copy for a variableShadow. Derived classes return their own type.
+	virtual JSMVariable *Clone() const
+	{
+		auto copy = new JSMVariable(*this);
+		copy->MakeShadow();
+		return copy;
+	}
+
 	// Sets the filtering function for this variable. Also applies
 	// the filter to it's current value.
 	virtual JSMVariable *SetFilter(FilterDelegate filterfunction)
@@ -73,13 +195,14 @@ public:
 		return this;
 	}
 
-	// Remember to call this listener when the value changes.
-	virtual unsigned int AddOnChangeListener(OnChangeDelegate listener, bool callListener = false)
+	// Remember to call this listener when the value changes. Listeners that do nothing but change other
+	// variables should say so, to keep them in line in a variableShadow too.
+	virtual unsigned int AddOnChangeListener(OnChangeDelegate listener, bool callListener = false, bool onlyChangesVariables = false)
 	{
-		_onChangeListeners[_delegateID] = listener;
+		_onChangeListeners.push_back({ _delegateID, listener, onlyChangesVariables });
 		if (callListener)
 		{
-			_onChangeListeners[_delegateID](_value);
+			_onChangeListeners.back().call(_value);
 		}
 		return _delegateID++;
 	}
@@ -87,7 +210,7 @@ public:
 	// Remove the listener from list
 	virtual bool RemoveOnChangeListener(unsigned int id)
 	{
-		auto found = _onChangeListeners.find(id);
+		auto found = find_if(_onChangeListeners.begin(), _onChangeListeners.end(), [id](const auto &listener) { return listener.id == id; });
 		if (found != _onChangeListeners.end())
 		{
 			_onChangeListeners.erase(found);
@@ -108,12 +231,18 @@ public:
 	// This enables easy usage of the variable within an operation.
 	virtual operator T() const
 	{
-		return _value;
+		return Current()->_value;
 	}
 
 	virtual const T &get() const
 	{
-		return _value;
+		return Current()->_value;
+	}
+
+	// See _revision
+	unsigned int Revision() const
+	{
+		return _revision->load(memory_order_relaxed);
 	}
 
 	// Value can be written by using operator =.
@@ -121,13 +250,28 @@ public:
 	// for changing the member _value
 	virtual T operator=(T newValue)
 	{
+		if (variableObserver && !_nested)
+		{
+			variableObserver->OnChange(this, -1, [this]() {
+				T value = get();
+				return VariableObserver::Restore{
+					[this, value]() { return get() != value; },
+					[this, value]() { operator=(value); }
+				};
+			});
+		}
+		if (auto copy = Shadowed())
+		{
+			return *copy = newValue;
+		}
 		T oldValue = _value;
 		_value = _filter(oldValue, newValue); // Pass new value through filtering
 		if (_value != oldValue)
 		{
+			Changed();
 			// Notify listeners of the change if there's a change
-			for (auto listener : _onChangeListeners)
-				listener.second(_value);
+			for (size_t i = 0; i < _onChangeListeners.size(); ++i)
+				_onChangeListeners[i].call(_value);
 		}
 		return _value; // Return actual value assign. Can be different from newValue because of filtering.
 	}
@@ -141,49 +285,200 @@ class ChordedVariable : public JSMVariable<T>
 
 protected:
 	// Each chord is a separate variable with its own listeners, but will use the same filtering and parsing.
-	map<ButtonID, JSMVariable<T>> _chordedVariables;
+	// ButtonID is a small dense enum, so chords are indexed by the chord button. Few are set, and a mapping
+	// is large, so they're allocated when created.
+	array<unique_ptr<JSMVariable<T>>, MAPPING_SIZE> _chordedVariables;
+
+	// Which chords above are set
+	bitset<MAPPING_SIZE> _chords;
+
+	static inline bool IsChord(ButtonID chord)
+	{
+		return chord > ButtonID::NONE && chord < ButtonID::SIZE;
+	}
+
+	bool EraseChord(ButtonID chord)
+	{
+		if (auto copy = Base::template Shadowed<ChordedVariable>())
+		{
+			return copy->EraseChord(chord);
+		}
+		if (IsChord(chord) && _chords.test(int(chord)))
+		{
+			_chordedVariables[int(chord)].reset();
+			_chords.reset(int(chord));
+			Base::Changed();
+			return true;
+		}
+		return false;
+	}
+
+	virtual void MakeShadow() override
+	{
+		Base::MakeShadow();
+		for (auto &chordedVariable : _chordedVariables)
+		{
+			if (chordedVariable)
+			{
+				chordedVariable.reset(chordedVariable->Clone());
+			}
+		}
+	}
 
 public:
 	ChordedVariable(T defval)
 	  : Base(defval)
 	  , _chordedVariables()
+	  , _chords()
+	{
+	}
+
+	ChordedVariable(const ChordedVariable &copy)
+	  : Base(copy)
+	  , _chordedVariables()
+	  , _chords(copy._chords)
+	{
+		for (int i = 0; i < MAPPING_SIZE; ++i)
+		{
+			if (copy._chordedVariables[i])
+			{
+				_chordedVariables[i].reset(new JSMVariable<T>(*copy._chordedVariables[i]));
+			}
+		}
+	}
+
+	virtual ChordedVariable *Clone() const override
 	{
+		auto copy = new ChordedVariable(*this);
+		copy->MakeShadow();
+		return copy;
 	}
 
-	// Get the chorded variable, creating one if required.
+	// Get the chorded variable, creating one if required. Returns nullptr if chord isn't a button.
 	JSMVariable<T> *AtChord(ButtonID chord)
 	{
-		auto existingChord = _chordedVariables.find(chord);
-		if (existingChord == _chordedVariables.end())
+		if (!IsChord(chord))
+		{
+			return nullptr;
+		}
+		if (variableObserver && !Base::_nested)
+		{
+			variableObserver->OnChange(this, int(chord), [this, chord]() {
+				auto chordedVariable = std::as_const(*this).AtChord(chord);
+				if (!chordedVariable)
+				{
+					return VariableObserver::Restore{
+						[this, chord]() { return std::as_const(*this).AtChord(chord) != nullptr; },
+						[this, chord]() { EraseChord(chord); }
+					};
+				}
+				T value = chordedVariable->get();
+				return VariableObserver::Restore{
+					[this, chord, value]() {
+						auto current = std::as_const(*this).AtChord(chord);
+						return !current || current->get() != value;
+					},
+					[this, chord, value]() { *AtChord(chord) = value; }
+				};
+			});
+		}
+		if (auto copy = Base::template Shadowed<ChordedVariable>())
+		{
+			return copy->AtChord(chord);
+		}
+		auto &chordedVariable = _chordedVariables[int(chord)];
+		if (!chordedVariable)
 		{
 			// Create the chord when requested, using the copy constructor.
-			_chordedVariables.emplace(chord, JSMVariable<T>(*this, Base::_defVal));
+			chordedVariable.reset(new JSMVariable<T>(*this, Base::_defVal));
+			_chords.set(int(chord));
+			Base::Changed();
 		}
-		return &_chordedVariables[chord];
+		return chordedVariable.get();
 	}
 
 	const JSMVariable<T> *AtChord(ButtonID chord) const
 	{
-		auto existingChord = _chordedVariables.find(chord);
-		return existingChord != _chordedVariables.end() ? &existingChord->second : nullptr;
+		return IsChord(chord) ? Base::template Current<ChordedVariable>()->_chordedVariables[int(chord)].get() : nullptr;
+	}
+
+	// Whether any chord is set. When there is none, the base value applies whatever the active chords are.
+	inline bool HasChords() const
+	{
+		return Base::template Current<ChordedVariable>()->_chords.any();
 	}
 
 	// Obtain the value with provided chord if any.
 	optional<T> get(ButtonID chord = ButtonID::NONE) const
 	{
+		auto current = Base::template Current<ChordedVariable>();
 		if (chord > ButtonID::NONE)
 		{
-			auto existingChord = _chordedVariables.find(chord);
-			return existingChord != _chordedVariables.end() ? optional<T>(T(existingChord->second)) : nullopt;
+			return IsChord(chord) && current->_chords.test(int(chord)) ? optional<T>(current->_chordedVariables[int(chord)]->get()) : nullopt;
 		}
-		return chord != ButtonID::INVALID ? optional(Base::_value) : nullopt;
+		return chord != ButtonID::INVALID ? optional(current->_value) : nullopt;
+	}
+
+	// Returns what puts the variable and all its chords back in their current state
+	virtual VariableObserver::Restore CaptureState()
+	{
+		auto current = Base::template Current<ChordedVariable>();
+		T value = current->_value;
+		vector<pair<ButtonID, T>> chords;
+		for (int i = 0; i < MAPPING_SIZE; ++i)
+		{
+			if (current->_chords.test(i))
+			{
+				chords.emplace_back(ButtonID(i), current->_chordedVariables[i]->get());
+			}
+		}
+		return {
+			[this, value, chords]() {
+				auto current = Base::template Current<ChordedVariable>();
+				return current->_value != value || current->_chords.count() != chords.size() ||
+				  any_of(chords.begin(), chords.end(), [current](const auto &chord) {
+					  return !current->_chords.test(int(chord.first)) || current->_chordedVariables[int(chord.first)]->get() != chord.second;
+				  });
+			},
+			[this, value, chords]() {
+				for (int i = 0; i < MAPPING_SIZE; ++i)
+				{
+					if (std::as_const(*this).AtChord(ButtonID(i)) && none_of(chords.begin(), chords.end(), [i](const auto &chord) { return int(chord.first) == i; }))
+					{
+						EraseChord(ButtonID(i));
+					}
+				}
+				for (auto &chord : chords)
+				{
+					*AtChord(chord.first) = chord.second;
+				}
+				static_cast<JSMVariable<T> &>(*this) = value;
+			}
+		};
 	}
 
 	// Resetting a chorded var always clears all chords.
 	virtual ChordedVariable<T> *Reset() override
 	{
+		if (variableObserver && !Base::_nested)
+		{
+			variableObserver->OnReset(this, [this]() { return CaptureState(); });
+		}
+		if (auto copy = Base::template Shadowed<ChordedVariable>())
+		{
+			copy->Reset();
+			return this;
+		}
 		JSMVariable<T>::Reset();
-		_chordedVariables.clear();
+		if (_chords.any())
+		{
+			for (auto &chordedVariable : _chordedVariables)
+			{
+				chordedVariable.reset();
+			}
+			_chords.reset();
+			Base::Changed();
+		}
 		return this;
 	}
 };
@@ -208,6 +503,13 @@ public:
 	{
 	}
 
+	virtual JSMSetting *Clone() const override
+	{
+		auto copy = new JSMSetting(*this);
+		copy->MakeShadow();
+		return copy;
+	}
+
 	virtual T operator=(T baseValue) override
 	{
 		return JSMVariable<T>::operator=(baseValue);
@@ -215,19 +517,24 @@ public:
 
 	inline void MarkModeshiftForRemoval(ButtonID modeshift)
 	{
+		if (auto copy = Base::template Shadowed<JSMSetting>())
+		{
+			copy->MarkModeshiftForRemoval(modeshift);
+			return;
+		}
 		_chordToRemove = modeshift;
 	}
 
 	void ProcessModeshiftRemoval(ButtonID modeshift)
 	{
-		if (_chordToRemove == modeshift)
+		if (auto copy = Base::template Shadowed<JSMSetting>())
 		{
-			auto modeshiftVar = Base::_chordedVariables.find(modeshift);
-			if (modeshiftVar != Base::_chordedVariables.end())
-			{
-				Base::_chordedVariables.erase(modeshiftVar);
-				_chordToRemove = ButtonID::NONE;
-			}
+			copy->ProcessModeshiftRemoval(modeshift);
+			return;
+		}
+		if (_chordToRemove == modeshift && Base::EraseChord(modeshift))
+		{
+			_chordToRemove = ButtonID::NONE;
 		}
 	}
 };
@@ -248,6 +555,34 @@ protected:
 	// Store listener IDs for its sim presses. This is required for Cross updates
 	map<ButtonID, unsigned int> _simListeners;
 
+	// Remove a sim press along with its listener entry, which would otherwise bring it back on Reset
+	void EraseSimPress(ButtonID chord)
+	{
+		if (auto copy = Shadowed<JSMButton>())
+		{
+			copy->EraseSimPress(chord);
+			return;
+		}
+		if (_simMappings.erase(chord) > 0)
+		{
+			Changed();
+		}
+		_simListeners.erase(chord);
+	}
+
+	virtual void MakeShadow() override
+	{
+		ChordedVariable<Mapping>::MakeShadow();
+		// Sim presses can't be assigned, so they're copied again. Their cross updates are kept, under the same id.
+		map<ButtonID, JSMVariable<Mapping>> simMappings;
+		for (auto &simPress : _simMappings)
+		{
+			unique_ptr<JSMVariable<Mapping>> copy(simPress.second.Clone());
+			simMappings.emplace(simPress.first, *copy);
+		}
+		_simMappings.swap(simMappings);
+	}
+
 public:
 	JSMButton(ButtonID id, Mapping def)
 	  : ChordedVariable(def)
@@ -265,29 +600,36 @@ public:
 		}
 	}
 
+	virtual JSMButton *Clone() const override
+	{
+		auto copy = new JSMButton(*this);
+		copy->MakeShadow();
+		return copy;
+	}
+
 	// Obtain the Variable for a sim press if any.
 	const ComboMap *getSimMap(ButtonID simBtn) const
 	{
 		if (simBtn > ButtonID::NONE)
 		{
-			auto existingSim = _simMappings.find(simBtn);
-			return existingSim != _simMappings.cend() ? &*existingSim : nullptr;
+			auto &simMappings = Current<JSMButton>()->_simMappings;
+			auto existingSim = simMappings.find(simBtn);
+			return existingSim != simMappings.cend() ? &*existingSim : nullptr;
 		}
 		return nullptr;
 	}
 
 	// Double Press mappings are stored in the chorded variables
-	const ComboMap *getDblPressMap() const
+	const JSMVariable<Mapping> *getDblPressMap() const
 	{
-		auto existingChord = _chordedVariables.find(_id);
-		return existingChord != _chordedVariables.end() ? &*existingChord : nullptr;
+		return AtChord(_id);
 	}
 
 	// Indicate whether any sim press mappings are present
 	// This function additionally removes any empty sim mappings.
 	inline bool HasSimMappings() const
 	{
-		return !_simMappings.empty();
+		return !Current<JSMButton>()->_simMappings.empty();
 	}
 
 	// Operator forwarding
@@ -331,15 +673,61 @@ public:
 		return string();
 	}
 
+	virtual VariableObserver::Restore CaptureState() override
+	{
+		auto restoreChords = ChordedVariable<Mapping>::CaptureState();
+		vector<pair<ButtonID, Mapping>> simPresses;
+		for (auto &simPress : Current<JSMButton>()->_simMappings)
+		{
+			simPresses.emplace_back(simPress.first, simPress.second.get());
+		}
+		return {
+			[this, restoreChords, simPresses]() {
+				// Both are in ButtonID order
+				auto &simMappings = Current<JSMButton>()->_simMappings;
+				return restoreChords.differs() || simMappings.size() != simPresses.size() ||
+				  !equal(simPresses.begin(), simPresses.end(), simMappings.begin(), [](const auto &kept, const auto &simPress) {
+					  return kept.first == simPress.first && kept.second == simPress.second.get();
+				  });
+			},
+			[this, restoreChords, simPresses]() {
+				restoreChords.apply();
+				for (auto simPress = _simMappings.begin(); simPress != _simMappings.end();)
+				{
+					ButtonID id = simPress->first;
+					bool keep = any_of(simPresses.begin(), simPresses.end(), [id](const auto &kept) { return kept.first == id; });
+					++simPress;
+					if (!keep)
+					{
+						EraseSimPress(id);
+					}
+				}
+				for (auto &simPress : simPresses)
+				{
+					*AtSimPress(simPress.first) = simPress.second;
+				}
+			}
+		};
+	}
+
 	// Resetting a button also clears all assigned sim presses
 	virtual JSMButton *Reset() override
 	{
 		ChordedVariable<Mapping>::Reset();
+		if (variableShadow && !_nested)
+		{
+			return this; // The copy was reset instead, sim presses included
+		}
 		for (auto id : _simListeners)
 		{
 			_simMappings[id.first].RemoveOnChangeListener(id.second);
 		}
-		_simMappings.clear();
+		if (!_simMappings.empty())
+		{
+			_simMappings.clear();
+			Changed();
+		}
+		_simListeners.clear();
 		return this;
 	}
 
@@ -348,13 +736,39 @@ public:
 	// to be updated when this value changes.
 	JSMVariable<Mapping> *AtSimPress(ButtonID chord)
 	{
+		if (variableObserver && !_nested)
+		{
+			// Sim presses come after all the chords
+			variableObserver->OnChange(this, MAPPING_SIZE + int(chord), [this, chord]() {
+				auto simPress = std::as_const(*this).AtSimPress(chord);
+				if (!simPress)
+				{
+					return VariableObserver::Restore{
+						[this, chord]() { return std::as_const(*this).AtSimPress(chord) != nullptr; },
+						[this, chord]() { EraseSimPress(chord); }
+					};
+				}
+				Mapping value = simPress->get();
+				return VariableObserver::Restore{
+					[this, chord, value]() {
+						auto current = std::as_const(*this).AtSimPress(chord);
+						return !current || current->get() != value;
+					},
+					[this, chord, value]() { *AtSimPress(chord) = value; }
+				};
+			});
+		}
+		if (auto copy = Shadowed<JSMButton>())
+		{
+			return copy->AtSimPress(chord);
+		}
 		auto existingSim = getSimMap(chord);
 		if (!existingSim)
 		{
 			JSMVariable<Mapping> var(*this, Mapping());
 			_simMappings.emplace(chord, var);
 			_simListeners[chord] = _simMappings[chord].AddOnChangeListener(
-			  bind(&SimPressCrossUpdate, chord, _id, placeholders::_1));
+			  bind(&SimPressCrossUpdate, chord, _id, placeholders::_1), false, true);
 		}
 		return &_simMappings[chord];
 	}
@@ -369,11 +783,7 @@ public:
 	{
 		if (value && value->get() == Mapping::NO_MAPPING)
 		{
-			auto chordVar = _chordedVariables.find(chord);
-			if (chordVar != _chordedVariables.end())
-			{
-				_chordedVariables.erase(chordVar);
-			}
+			EraseChord(chord);
 		}
 	}
 
@@ -381,11 +791,7 @@ public:
 	{
 		if (value && value->get() == Mapping::NO_MAPPING)
 		{
-			auto chordVar = _simMappings.find(chord);
-			if (chordVar != _simMappings.end())
-			{
-				_simMappings.erase(chordVar);
-			}
+			EraseSimPress(chord);
 		}
 	}
 };
@@ -97,6 +97,15 @@ typedef struct IMU_STATE
 	float gyroZ;
 } IMU_STATE;
 
+// A single gyro and accelerometer reading, with the time elapsed since the previous one according to the sensor
+typedef struct IMU_SAMPLE
+{
+	IMU_STATE imu;
+	float deltaTime; // in seconds
+} IMU_SAMPLE;
+
+#define JSL_MAX_IMU_SAMPLES 64
+
 typedef struct MOTION_STATE
 {
 	float quatW;
@@ -155,6 +164,24 @@ extern "C" JOY_SHOCK_API IMU_STATE JslGetIMUState(int deviceId);
 extern "C" JOY_SHOCK_API MOTION_STATE JslGetMotionState(int deviceId);
 extern "C" JOY_SHOCK_API TOUCH_STATE JslGetTouchState(int deviceId);
 
+// get every gyro and accelerometer sample received since the last call, oldest first. Returns the number of samples written
+extern "C" JOY_SHOCK_API int JslGetIMUSamples(int deviceId, IMU_SAMPLE* samples, int maxSamples);
+
+// time in seconds it took to read all devices on the last poll
+extern "C" JOY_SHOCK_API float JslGetUpdateDuration();
+
+// average time in seconds between two ticks of the polling thread, which processes controllers that didn't report meanwhile
+extern "C" JOY_SHOCK_API float JslGetTickPeriod();
+// number of ticks that were missed because the polling thread woke up too late for them
+extern "C" JOY_SHOCK_API int JslGetTickOverruns();
+extern "C" JOY_SHOCK_API void JslResetTickStats();
+
+// time in seconds the report being processed by the callback waited for its processing thread to pick it up
+extern "C" JOY_SHOCK_API float JslGetDispatchDelay(int deviceId);
+
+// time in seconds since the report being processed by the callback was received
+extern "C" JOY_SHOCK_API float JslGetReportAge(int deviceId);
+
 extern "C" JOY_SHOCK_API int JslGetButtons(int deviceId);
 
 // get thumbsticks
@@ -3,8 +3,12 @@
 #include "JSMVersion.h"
 #include "magic_enum.hpp"
 
+#include <array>
+#include <cstdint>
 #include <map>
+#include <memory>
 #include <functional>
+#include <string_view>
 
 // This header file is meant to be included among all core JSM source files
 // And as such it should contain only constants, types and functions related to them
@@ -347,6 +351,12 @@ enum class Switch : char
 	ON,
 	INVALID,
 }; // Used to parse autoload assignment
+enum class OutputDevice
+{
+	OS,
+	SHARED_MEMORY,
+	INVALID
+};
 enum class ControllerScheme
 {
 	NONE,
@@ -354,6 +364,21 @@ enum class ControllerScheme
 	DS4,
 	INVALID
 };
+enum class LogCategory
+{
+	BUTTONS,
+	FLICK,
+	RUMBLE,
+	VIGEM,
+	INVALID
+}; // Groups of messages printed while processing controller input
+enum class LogLevel
+{
+	OFF,
+	ON,
+	VERBOSE,
+	INVALID
+};
 
 // Workaround default string streaming operator
 class PathString : public string // Should be wstring
@@ -423,12 +448,12 @@ struct KeyCode
 		return code != 0;
 	}
 
-	inline bool operator==(const KeyCode &rhs)
+	inline bool operator==(const KeyCode &rhs) const
 	{
 		return code == rhs.code && name == rhs.name;
 	}
 
-	inline bool operator!=(const KeyCode &rhs)
+	inline bool operator!=(const KeyCode &rhs) const
 	{
 		return !operator==(rhs);
 	}
@@ -472,10 +497,8 @@ struct GyroSettings
 class DigitalButton;
 class JoyShock;
 
-typedef function<void(DigitalButton *)> OnEventAction;
-
 // This structure handles the mapping of a button, buy processing and action
-// to be done on tap, hold, turbo and others. It holds a map of actions to perform
+// to be done on tap, hold, turbo and others. It holds a table of actions to perform
 // when a specific event happens. This replaces the old Mapping structure.
 class Mapping
 {
@@ -498,22 +521,62 @@ public:
 		INVALID
 	};
 
+	// What an action does. Mapping::ProcessEvent runs them.
+	enum class Opcode : uint8_t
+	{
+		None,
+		PressKey,
+		ReleaseKey,
+		StartCalibration,
+		FinishCalibration,
+		ApplyGyroAction,
+		RemoveGyroAction,
+		RunCommand,
+		SetRumble,
+		StopRumble,
+	};
+
+	// Enough for 16 keys, each with an action to apply and one to release
+	static constexpr int MAX_ACTIONS = 32;
+
 	// Identifies having no binding mapped
 	static const Mapping NO_MAPPING;
 
 	// This functor nees to be set to way to validate a command line string;
 	static function<bool(in_string)> _isCommandValid;
 
-	string _description = "no input";
-	string _command;
-
 private:
-	map<BtnEvent, OnEventAction> _eventMapping;
+	// What the mapping was read from and how it's displayed. Variables copy mappings around on every change,
+	// so the strings are shared rather than copied, and kept out of the way of the actions ProcessEvent reads.
+	struct Text
+	{
+		string command;
+		string description;
+	};
+	static inline const Text NO_TEXT{ string(), "no input" };
+	shared_ptr<const Text> _text;
+
+	// One step of the mapping. It's plain data, so the table is copied with the mapping at no cost.
+	struct Action
+	{
+		const KeyCode *key = nullptr; // Shared by all mappings using the key, and never freed
+		uint8_t event = 0;            // BtnEvent
+		Opcode op = Opcode::None;
+		Opcode toggleOff = Opcode::None; // A toggle runs op when the key isn't toggled on yet, and toggleOff otherwise
+		bool isToggle = false;
+		bool isInstant = false; // Registers the event, to run the actions on OnInstantRelease shortly after
+		uint8_t rumble[2] = { 0, 0 };
+	};
+
+	// Actions run in the order they were added, when their event happens
+	array<Action, MAX_ACTIONS> _actions{};
+	int _actionCount = 0;
+	uint16_t _events = 0; // A bit for each BtnEvent that has actions
 	float _tapDurationMs = MAGIC_TAP_DURATION;
 	bool _hasViGEmBtn = false;
 
-	void InsertEventMapping(BtnEvent evt, OnEventAction action);
-	static void RunBothActions(DigitalButton *btn, OnEventAction action1, OnEventAction action2);
+	void InsertEventMapping(BtnEvent evt, const Action &action);
+	static void RunAction(Opcode op, const Action &action, DigitalButton &button);
 
 public:
 	Mapping() = default;
@@ -531,7 +594,7 @@ public:
 
 	inline bool isValid() const
 	{
-		return !_eventMapping.empty();
+		return _actionCount > 0;
 	}
 
 	inline float getTapDuration() const
@@ -539,10 +602,24 @@ public:
 		return _tapDurationMs;
 	}
 
+	inline const string &getCommand() const
+	{
+		return _text ? _text->command : NO_TEXT.command;
+	}
+
+	inline const string &getDescription() const
+	{
+		return _text ? _text->description : NO_TEXT.description;
+	}
+
+	// Only operator>> makes the text
+	friend istream &operator>>(istream &in, Mapping &mapping);
+
 	inline void clear()
 	{
-		_eventMapping.clear();
-		_description.clear();
+		_actionCount = 0;
+		_events = 0;
+		_text = make_shared<const Text>(Text{ getCommand(), string() });
 		_tapDurationMs = MAGIC_TAP_DURATION;
 		_hasViGEmBtn = false;
 	}
@@ -551,6 +628,9 @@ public:
 	{
 		return _hasViGEmBtn;
 	}
+
+	// Whether one of the actions toggles the key, given as interned by AddMapping
+	bool togglesKey(const KeyCode *key) const;
 };
 
 // This function is defined in main.cpp. It enables two sim press variables to
@@ -580,6 +660,8 @@ ostream &operator<<(ostream &out, E rhv)
 // types to and from string, or handles exceptions
 istream &operator>>(istream &in, ButtonID &rhv);
 ostream &operator<<(ostream &out, ButtonID rhv);
+// Same as operator>> on a single word, without a stream
+ButtonID toButtonID(string_view name);
 
 istream &operator>>(istream &in, FlickSnapMode &fsm);
 ostream &operator<<(ostream &out, FlickSnapMode fsm);
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "JoyShockLibrary.h"
+
+#include <array>
+#include <chrono>
+#include <map>
+#include <mutex>
+
+// A device's inputs as given to the callback. They are copied from the device when it is dispatched, so that
+// the backend can read the next report while this one is being processed.
+struct JslReport
+{
+	JOY_SHOCK_STATE state = {};
+	IMU_STATE imu = {};
+	TOUCH_STATE touch = {};
+
+	// Sensor samples received since the last callback, in the order they were reported
+	std::array<IMU_SAMPLE, JSL_MAX_IMU_SAMPLES> imuSamples;
+	int numImuSamples = 0;
+
+	// When the oldest report it holds arrived, when it was last handed over and when its processing started
+	std::chrono::steady_clock::time_point reportTime;
+	std::chrono::steady_clock::time_point postTime;
+	std::chrono::steady_clock::time_point startTime;
+};
+
+// What the JoyShockLibrary API knows about a controller, whichever backend reads it.
+// The base class also stands for unknown handles: an idle controller that ignores output.
+struct JslDevice
+{
+	virtual ~JslDevice() = default;
+
+	virtual int GetControllerType()
+	{
+		return 0;
+	}
+
+	virtual void SetLightColour(int colour)
+	{
+	}
+
+	virtual void SetRumble(int smallRumble, int bigRumble)
+	{
+	}
+
+	virtual void SetPlayerNumber(int number)
+	{
+	}
+
+	// Add the current IMU reading to the samples given to the next callback
+	void queueImuSample(float deltaTime);
+
+	// Flag the device so that it gets dispatched this cycle
+	void markFreshReport(std::chrono::steady_clock::time_point reportTime);
+
+	int split_type = JS_SPLIT_TYPE_FULL;
+	// Set when new data arrived from this device since its last callback
+	bool _hasFreshReport = false;
+	std::chrono::steady_clock::time_point _lastCallback;
+	// When the oldest report not yet given to the callback arrived
+	std::chrono::steady_clock::time_point _reportTime;
+
+	// Sensor samples received since the last callback, in the order they were reported
+	std::array<IMU_SAMPLE, JSL_MAX_IMU_SAMPLES> _imuSamples;
+	int _numImuSamples = 0;
+
+	JOY_SHOCK_STATE _state = {};
+	IMU_STATE _imu = {};
+	TOUCH_STATE _touch = {};
+
+	// What the callback in progress is processing. Only the device's processing thread touches it.
+	JslReport _report;
+	// A copy of _report for other threads, made when its callback starts. It doesn't hold the IMU samples,
+	// which only the callback drains. Read and written with _publishedLock held.
+	JslReport _published;
+	std::mutex _publishedLock;
+};
+
+// Where controller input comes from. The polling thread alternates between Wait() and Update(), then hands
+// every device with a fresh report, or that has been idle for a whole tick, to that device's processing thread.
+class JslBackend
+{
+public:
+	virtual ~JslBackend() = default;
+
+	// Called once, before the polling thread starts
+	virtual void Init()
+	{
+	}
+
+	// Number of devices Open() can be tried with
+	virtual int CountDevices() = 0;
+
+	// Returns nullptr if there is no usable controller at that index
+	virtual JslDevice *Open(int index) = 0;
+
+	// Block until input may be available, or until the deadline at the latest. The devices are not locked.
+	// Return false when no input is expected by then: the polling thread sleeps precisely until the deadline.
+	virtual bool Wait(std::chrono::steady_clock::time_point deadline) = 0;
+
+	// Bring every device up to date and mark those with new input. The devices are locked.
+	virtual void Update(const std::map<int, JslDevice *> &devices) = 0;
+
+	// Called after all devices are disposed of
+	virtual void Shutdown()
+	{
+	}
+};
+
+// Replace the backend before calling JslSetCallback. JoyShockLibrary takes ownership of it.
+// By default, controllers are read from SDL, or generated when JSM_SYNTHETIC_CONTROLLERS is set.
+void JslSetBackend(JslBackend *backend);
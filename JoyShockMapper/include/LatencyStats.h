@@ -0,0 +1,181 @@
+#pragma once
+
+#include "JoyShockMapper.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Steps of processing a controller report that get timed
+enum class LatencyStage
+{
+	SDL_UPDATE,  // Reading all controllers from SDL, shared by all devices
+	DISPATCH,    // Waiting for the controller's processing thread to pick the report up
+	IMU_READ,    // Fetching the motion samples of the report
+	MOTION,      // Sensor fusion in GamepadMotion
+	STICKS,      // Gyro smoothing and stick processing
+	BUTTONS,     // Button and trigger state machines
+	OUTPUT,      // Gyro mouse movement and sending the output frame to the OS
+	TOTAL,       // From receiving the report to the output being sent
+	TICK_JITTER, // Change in time between two consecutive reports
+	INVALID
+};
+
+// Histogram of durations with buckets of logarithmically increasing size, like HDR histograms.
+// Each power of 2 is split in SUB_BUCKETS linear buckets, so a value is known within ~6%.
+// Recording is lock free and doesn't allocate, so it can stay on in the input thread.
+class LatencyHistogram
+{
+public:
+	static constexpr int SUB_BUCKET_BITS = 4;
+	static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+	static constexpr int NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+	void Record(uint64_t nanoseconds)
+	{
+		_buckets[BucketIndex(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+		_count.fetch_add(1, std::memory_order_relaxed);
+		uint64_t max = _max.load(std::memory_order_relaxed);
+		while (nanoseconds > max && !_max.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	uint64_t Count() const
+	{
+		return _count.load(std::memory_order_relaxed);
+	}
+
+	uint64_t Max() const
+	{
+		return _max.load(std::memory_order_relaxed);
+	}
+
+	// Upper bound in nanoseconds of the bucket holding the given fraction of the recorded values
+	uint64_t Percentile(double fraction) const
+	{
+		uint64_t count = Count();
+		if (count == 0)
+		{
+			return 0;
+		}
+		uint64_t target = uint64_t(fraction * count + 0.5);
+		target = target < 1 ? 1 : target;
+		uint64_t seen = 0;
+		for (int i = 0; i < NUM_BUCKETS; ++i)
+		{
+			seen += _buckets[i].load(std::memory_order_relaxed);
+			if (seen >= target)
+			{
+				return std::min(BucketUpperBound(i), Max());
+			}
+		}
+		return Max();
+	}
+
+	void Reset()
+	{
+		for (auto &bucket : _buckets)
+		{
+			bucket.store(0, std::memory_order_relaxed);
+		}
+		_count.store(0, std::memory_order_relaxed);
+		_max.store(0, std::memory_order_relaxed);
+	}
+
+private:
+	static int BucketIndex(uint64_t value)
+	{
+		if (value < SUB_BUCKETS)
+		{
+			return int(value);
+		}
+		int msb = 0;
+		for (uint64_t v = value; v > 1; v >>= 1)
+		{
+			++msb;
+		}
+		int shift = msb - SUB_BUCKET_BITS;
+		return (shift + 1) * SUB_BUCKETS + int(value >> shift) - SUB_BUCKETS;
+	}
+
+	static uint64_t BucketUpperBound(int index)
+	{
+		if (index < SUB_BUCKETS)
+		{
+			return uint64_t(index);
+		}
+		int shift = index / SUB_BUCKETS - 1;
+		uint64_t mantissa = uint64_t(index % SUB_BUCKETS + SUB_BUCKETS);
+		return ((mantissa + 1) << shift) - 1;
+	}
+
+	std::array<std::atomic<uint32_t>, NUM_BUCKETS> _buckets{};
+	std::atomic<uint64_t> _count{ 0 };
+	std::atomic<uint64_t> _max{ 0 };
+};
+
+// Timings of every processing stage of one controller.
+// Mark() records the time elapsed since the previous mark in the given stage.
+class LatencyStats
+{
+public:
+	using clock = std::chrono::steady_clock;
+
+	// Start timing a new report. Also records how regular reports are.
+	void Begin(clock::time_point now)
+	{
+		if (_lastBegin != clock::time_point())
+		{
+			auto interval = now - _lastBegin;
+			auto jitter = interval > _lastInterval ? interval - _lastInterval : _lastInterval - interval;
+			Record(LatencyStage::TICK_JITTER, jitter);
+			_lastInterval = interval;
+		}
+		_lastBegin = _lastMark = now;
+	}
+
+	void Mark(LatencyStage stage)
+	{
+		auto now = clock::now();
+		Record(stage, now - _lastMark);
+		_lastMark = now;
+	}
+
+	// Restart the stage timer without recording, to leave out time spent waiting
+	void Skip()
+	{
+		_lastMark = clock::now();
+	}
+
+	void Record(LatencyStage stage, clock::duration duration)
+	{
+		auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+		_histograms[int(stage)].Record(nanoseconds > 0 ? uint64_t(nanoseconds) : 0);
+	}
+
+	void Record(LatencyStage stage, float seconds)
+	{
+		_histograms[int(stage)].Record(seconds > 0.f ? uint64_t(seconds * 1e9f) : 0);
+	}
+
+	const LatencyHistogram &operator[](LatencyStage stage) const
+	{
+		return _histograms[int(stage)];
+	}
+
+	void Reset()
+	{
+		for (auto &histogram : _histograms)
+		{
+			histogram.Reset();
+		}
+	}
+
+private:
+	std::array<LatencyHistogram, int(LatencyStage::INVALID)> _histograms;
+	clock::time_point _lastBegin;
+	clock::time_point _lastMark;
+	clock::duration _lastInterval{ 0 };
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "JoyShockMapper.h"
+
+#include <atomic>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+// Messages are printed by a background thread so that a slow console never holds up controller processing.
+// Producers only copy their message in a lock-free queue. If the queue is full the message is dropped.
+
+// Queue a message to be printed in the given color on the given stream
+void logMessage(std::ostream *stdio, uint16_t color, std::string &&message);
+
+// Queue a printf style message for std::cout, in the same color as COUT. It is formatted on the stack and copied
+// into the queue slot, which keeps the memory of the messages it held before: unlike COUT, it doesn't allocate
+// once the queue has gone round, so it's the one to use for messages sent on every controller report.
+void logFormat(const char *format, ...);
+
+// Wait until every message queued so far has been printed
+void flushLog();
+
+// Drop the messages the calling thread sends to std::cout while set. Errors still get through.
+void muteOutput(bool muted);
+
+extern std::atomic<LogLevel> logLevels[int(LogCategory::INVALID)];
+
+// Check this before building a message that belongs to a category
+inline bool isLogged(LogCategory category, LogLevel level = LogLevel::ON)
+{
+	return logLevels[int(category)].load(std::memory_order_relaxed) >= level;
+}
+
+inline void setLogLevel(LogCategory category, LogLevel level)
+{
+	logLevels[int(category)].store(level, std::memory_order_relaxed);
+}
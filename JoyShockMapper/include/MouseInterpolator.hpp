@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <utility>
+
+// Spreads the mouse motion of each controller report over the time until the next report is expected, so that
+// it can be sent in several smaller steps. The motion of a report is all sent by the time the next one is due.
+// If it is late, the motion can carry on at the same speed for a short while. What went too far is taken back
+// from the next report, so the total motion is the same as without interpolation.
+// Reports are pushed from the thread processing the controller and motion is pulled from the output thread.
+class MouseInterpolator
+{
+public:
+	using clock = std::chrono::steady_clock;
+
+	// Motion computed from a report processed at the given time
+	void Push(float x, float y, clock::time_point now)
+	{
+		std::lock_guard guard(_lock);
+		if (_lastPush != clock::time_point())
+		{
+			// Expect the next report after as long as this one took, within reason
+			_interval = std::clamp(now - _lastPush, clock::duration(std::chrono::microseconds(500)), clock::duration(std::chrono::milliseconds(100)));
+			float seconds = std::chrono::duration<float>(_interval).count();
+			_velocityX = x / seconds;
+			_velocityY = y / seconds;
+		}
+		_pendingX += x;
+		_pendingY += y;
+		_lastPush = _lastPull = now;
+		_due = now + _interval;
+	}
+
+	// Motion to send now. Once a report's motion is all sent, keep going at its speed for up to extrapolation.
+	std::pair<float, float> Pull(clock::time_point now, clock::duration extrapolation)
+	{
+		std::lock_guard guard(_lock);
+		// The report may have been processed after the output thread read the time
+		now = std::max(now, _lastPull);
+		float x = 0.f, y = 0.f;
+		if (now < _due)
+		{
+			float share = std::chrono::duration<float>(now - _lastPull) / std::chrono::duration<float>(_due - _lastPull);
+			x = _pendingX * share;
+			y = _pendingY * share;
+		}
+		else if (_lastPull < _due)
+		{
+			x = _pendingX;
+			y = _pendingY;
+		}
+		else if (now < _due + extrapolation)
+		{
+			float seconds = std::chrono::duration<float>(now - _lastPull).count();
+			x = _velocityX * seconds;
+			y = _velocityY * seconds;
+		}
+		_pendingX -= x;
+		_pendingY -= y;
+		_lastPull = now;
+		return { x, y };
+	}
+
+	// All the motion not sent yet, for when motion stops being pulled. The next report starts afresh.
+	std::pair<float, float> Take()
+	{
+		std::lock_guard guard(_lock);
+		std::pair<float, float> pending{ _pendingX, _pendingY };
+		_pendingX = _pendingY = 0.f;
+		_velocityX = _velocityY = 0.f;
+		_lastPush = _lastPull = _due = clock::time_point();
+		return pending;
+	}
+
+private:
+	std::mutex _lock;
+	clock::time_point _lastPush;
+	clock::time_point _lastPull;
+	clock::time_point _due;
+	clock::duration _interval = std::chrono::milliseconds(4);
+	float _pendingX = 0.f;
+	float _pendingY = 0.f;
+	float _velocityX = 0.f;
+	float _velocityY = 0.f;
+};
@@ -1,6 +1,10 @@
 #pragma once
 
+#include "Logger.h"
+
 #include <string>
+#include <iostream>
+#include <sstream>
 
 #ifdef _WIN32
 
@@ -14,19 +18,15 @@ constexpr uint16_t DEFAULT_COLOR = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUN
 
 static std::mutex print_mutex;
 
-template<std::ostream *stdio, uint16_t color>
-struct ColorStream : public std::stringstream
+// print the string on the stdio
+inline void printColored(std::ostream *stdio, uint16_t color, const std::string &text)
 {
-	// print the string on the stdio
-	~ColorStream()
-	{
-		std::lock_guard<std::mutex> guard(print_mutex);
-		HANDLE hStdout = GetStdHandle(STD_ERROR_HANDLE);
-		SetConsoleTextAttribute(hStdout, color);
-		(*stdio) << str();
-		SetConsoleTextAttribute(hStdout, DEFAULT_COLOR);
-	}
-};
+	std::lock_guard<std::mutex> guard(print_mutex);
+	HANDLE hStdout = GetStdHandle(STD_ERROR_HANDLE);
+	SetConsoleTextAttribute(hStdout, color);
+	(*stdio) << text;
+	SetConsoleTextAttribute(hStdout, DEFAULT_COLOR);
+}
 
 #define U(string) L##string
 
@@ -139,16 +139,21 @@ extern unsigned long GetCurrentProcessId();
 #define FOREGROUND_INTENSITY 0x0100 // text color is bold.
 #define DEFAULT_COLOR 37 // text color is white
 
+inline void printColored(std::ostream *stdio, uint16_t color, const std::string &text)
+{
+	(*stdio) << "\033[" << (color >> 8) << ';' << (color & 0x00FF) << 'm' << text << "\033[0;" << DEFAULT_COLOR << 'm';
+}
+
+#else
+#error "Unknown platform"
+#endif
+
+// Collects a message and hands it over to the logging thread when it goes out of scope
 template<std::ostream *stdio, uint16_t color>
 struct ColorStream : public std::stringstream
 {
 	~ColorStream()
 	{
-
-		(*stdio) << "\033[" << (color >> 8) << ';' << (color & 0x00FF) << 'm' << str() << "\033[0;" << DEFAULT_COLOR << 'm';
+		logMessage(stdio, color, str());
 	}
 };
-
-#else
-#error "Unknown platform"
-#endif
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "CmdRegistry.h"
+#include "JSMVariable.hpp"
+
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Loading a configuration parses every line, runs every command and notifies listeners at each step.
+// The first time a configuration is loaded through the cache, it is compiled into a profile: the final state
+// of every variable, chord and sim press it changed. Loading it again puts those back in one pass instead,
+// as long as none of the files read the first time have changed. Configurations running commands that do
+// more than changing variables, such as SLEEP or RECONNECT_CONTROLLERS, are always loaded from text.
+// Mappings hold functions, so profiles only live as long as the process does.
+// A profile only assigns what differs from the current state, all at once.
+class ProfileCache
+{
+public:
+	// Runs apply while nothing else reads variables
+	typedef function<void(const function<void()> &apply)> PauseDelegate;
+
+	// Returns true if the profile was applied from the cache
+	bool Load(CmdRegistry &registry, in_string path, const PauseDelegate &pause);
+
+	// Load a configuration again after it was edited, changing only what differs from the current state.
+	// It is first loaded quietly into a variableShadow to learn its final state without changing any variable.
+	// Returns false, having changed nothing, if the configuration runs other commands: Load it instead.
+	bool Reload(CmdRegistry &registry, in_string path, const PauseDelegate &pause);
+
+	// Whether the contents of any file read when the configuration was last loaded through the cache changed since.
+	// False while one of them can't be read, such as when an editor is in the middle of saving it.
+	bool HasChanged(in_string path);
+
+	// The files read when the configuration was last loaded through the cache, itself first
+	vector<string> Files(in_string path) const;
+
+	void Clear();
+
+private:
+	struct FileStamp
+	{
+		string path;
+		filesystem::file_time_type modified;
+		uintmax_t size;
+		uint64_t hash;
+	};
+
+	struct Profile
+	{
+		vector<FileStamp> files;
+		bool isCompiled = false; // Otherwise it runs other commands, and needs loading from text every time
+		vector<VariableObserver::Restore> resets; // Whole variables, with all their chords and sim presses
+		vector<VariableObserver::Restore> changes;
+	};
+
+	static bool Stamp(in_string path, FileStamp &stamp);
+
+	// Returns false if the file can't be read. It is only hashed again when its time or size changed, and
+	// when its contents are the same, the stamp takes the new time so that it isn't hashed again next time.
+	static bool Check(FileStamp &stamp, bool &changed);
+
+	static bool IsUpToDate(Profile &profile);
+
+	unordered_map<string, Profile> _profiles;
+};
@@ -0,0 +1,194 @@
+#pragma once
+
+// Layout of the shared memory segment JoyShockMapper writes its output to with OUTPUT_DEVICE = SHARED_MEMORY.
+// This header doesn't depend on anything else from JoyShockMapper so that a game or plugin can include it as is.
+//
+// The segment holds a ring of frames. Each frame is everything that changed during one tick: the mouse motion
+// as floats, without the rounding to whole pixels the OS needs, which keys and buttons are held, and the
+// orientation of each controller. Every slot is guarded by a sequence lock: its version is odd while the slot is
+// written, and a reader copies the frame and checks that the version didn't change meanwhile. Reading takes no
+// lock and no system call, and a reader can never block JoyShockMapper, however slow it is.
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+constexpr char SHARED_OUTPUT_NAME[] = "/joyshockmapper-output";
+constexpr uint32_t SHARED_OUTPUT_MAGIC = 0x4F4D534A; // "JSMO"
+constexpr uint32_t SHARED_OUTPUT_VERSION = 1;
+constexpr uint32_t SHARED_OUTPUT_SLOTS = 256; // A power of 2, so that sequence numbers wrap around the ring evenly
+constexpr int SHARED_OUTPUT_CONTROLLERS = 8;
+constexpr int SHARED_OUTPUT_KEY_WORDS = 8; // One bit per virtual key code, 0 to 255
+
+// Set in SharedOutputFrame::flags
+constexpr uint32_t SHARED_OUTPUT_HAS_POINTER = 1; // pointerX and pointerY were set at least once
+
+struct SharedOutputFrame
+{
+	uint64_t sequence;  // Starts at 1 and goes up by 1 with every frame
+	int64_t timestamp;  // When the frame was published, in nanoseconds of CLOCK_MONOTONIC
+	float mouseX;       // Relative mouse motion since the previous frame, in pixels
+	float mouseY;
+	double totalX;      // Sum of all the mouse motion so far. The difference between two frames is the motion
+	double totalY;      // in between, even when a reader skipped frames.
+	float pointerX;     // Last absolute mouse position, between 0 and 1 across the screen
+	float pointerY;
+	uint32_t flags;
+	uint32_t keys[SHARED_OUTPUT_KEY_WORDS];              // Bit n of keys[n / 32] is set while key code n is held
+	int32_t controllers[SHARED_OUTPUT_CONTROLLERS];      // Handle of the controller for each orientation, or -1
+	float orientation[SHARED_OUTPUT_CONTROLLERS][4];     // Quaternion as w, x, y, z
+
+	bool IsKeyDown(int key) const
+	{
+		return key >= 0 && key < SHARED_OUTPUT_KEY_WORDS * 32 && (keys[key / 32] >> (key % 32) & 1) != 0;
+	}
+};
+
+static_assert(std::is_trivially_copyable_v<SharedOutputFrame>);
+
+struct alignas(64) SharedOutputSlot
+{
+	std::atomic<uint64_t> version; // Odd while the frame is being written
+	SharedOutputFrame frame;
+};
+
+struct SharedOutputSegment
+{
+	uint32_t magic; // Written last, once the rest is ready
+	uint32_t version;
+	uint32_t slots;
+	uint32_t frameSize;
+	alignas(64) std::atomic<uint64_t> head; // Sequence of the latest complete frame, 0 before the first one
+	SharedOutputSlot ring[SHARED_OUTPUT_SLOTS];
+
+	bool IsValid() const
+	{
+		return magic == SHARED_OUTPUT_MAGIC && version == SHARED_OUTPUT_VERSION && slots == SHARED_OUTPUT_SLOTS && frameSize == sizeof(SharedOutputFrame);
+	}
+
+	// Copy the frame with the given sequence. Fails if it is being written, or was already overwritten by a newer one.
+	bool TryRead(uint64_t sequence, SharedOutputFrame &frame) const
+	{
+		const SharedOutputSlot &slot = ring[sequence % SHARED_OUTPUT_SLOTS];
+		uint64_t before = slot.version.load(std::memory_order_acquire);
+		if (before & 1)
+		{
+			return false;
+		}
+		std::memcpy(&frame, &slot.frame, sizeof(frame));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return slot.version.load(std::memory_order_relaxed) == before && frame.sequence == sequence;
+	}
+
+	// Copy the latest frame. Returns false if there is none yet.
+	bool ReadLatest(SharedOutputFrame &frame) const
+	{
+		for (;;)
+		{
+			uint64_t latest = head.load(std::memory_order_acquire);
+			if (latest == 0)
+			{
+				return false;
+			}
+			if (TryRead(latest, frame))
+			{
+				return true;
+			}
+		}
+	}
+
+	// Copy the frame following the last one read, whose sequence is given, and update it. Returns false when
+	// there is no new frame. A reader more than half a ring behind skips ahead, so that what it reads isn't
+	// overwritten before it gets there. totalX and totalY still account for the motion of the skipped frames.
+	bool ReadNext(uint64_t &last, SharedOutputFrame &frame) const
+	{
+		for (;;)
+		{
+			uint64_t latest = head.load(std::memory_order_acquire);
+			if (latest <= last)
+			{
+				return false;
+			}
+			uint64_t next = latest - last > SHARED_OUTPUT_SLOTS / 2 ? latest - SHARED_OUTPUT_SLOTS / 2 + 1 : last + 1;
+			if (TryRead(next, frame))
+			{
+				last = next;
+				return true;
+			}
+		}
+	}
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Readers in other processes need lock free atomics");
+
+#ifdef __linux__
+// Maps the segment read only. The segment stays in place while JoyShockMapper is closed and is reused when it
+// starts again, so a reader can be opened once and kept for as long as the game runs.
+class SharedOutputReader
+{
+public:
+	SharedOutputReader() = default;
+	SharedOutputReader(const SharedOutputReader &) = delete;
+	SharedOutputReader &operator=(const SharedOutputReader &) = delete;
+
+	~SharedOutputReader()
+	{
+		Close();
+	}
+
+	// Fails if JoyShockMapper never opened the segment
+	bool Open(const char *name = SHARED_OUTPUT_NAME)
+	{
+		Close();
+		int fd = shm_open(name, O_RDONLY, 0);
+		if (fd < 0)
+		{
+			return false;
+		}
+		struct stat info;
+		if (fstat(fd, &info) == 0 && size_t(info.st_size) >= sizeof(SharedOutputSegment))
+		{
+			void *address = mmap(nullptr, sizeof(SharedOutputSegment), PROT_READ, MAP_SHARED, fd, 0);
+			if (address != MAP_FAILED)
+			{
+				_segment = static_cast<const SharedOutputSegment *>(address);
+			}
+		}
+		close(fd);
+		if (_segment && !_segment->IsValid())
+		{
+			Close();
+		}
+		return _segment != nullptr;
+	}
+
+	void Close()
+	{
+		if (_segment)
+		{
+			munmap(const_cast<SharedOutputSegment *>(_segment), sizeof(SharedOutputSegment));
+			_segment = nullptr;
+		}
+	}
+
+	const SharedOutputSegment *operator->() const
+	{
+		return _segment;
+	}
+
+	explicit operator bool() const
+	{
+		return _segment != nullptr;
+	}
+
+private:
+	const SharedOutputSegment *_segment = nullptr;
+};
+#endif
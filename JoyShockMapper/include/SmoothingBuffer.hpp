@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+// Circular buffer of samples that keeps a running sum of the most recent ones, so that the average
+// over the window costs the same no matter how long the window is. Samples older than the window are
+// kept up to the buffer's capacity, so growing the window brings them back in just like it used to.
+class SmoothingBuffer
+{
+public:
+	SmoothingBuffer(size_t capacity = 64)
+	  : _samples(std::max<size_t>(capacity, 1), 0.0f)
+	{
+	}
+
+	// Set how many of the most recent samples are averaged. The buffer grows if it can't hold that many.
+	// Nothing changes when the window is the same, so it's fine to call with every sample.
+	void SetWindow(size_t window)
+	{
+		window = std::max<size_t>(window, 1);
+		if (window == _window)
+		{
+			return;
+		}
+		if (window > _samples.size())
+		{
+			Grow(window);
+		}
+		while (_window < window)
+		{
+			_sum += At(_window);
+			++_window;
+		}
+		while (_window > window)
+		{
+			--_window;
+			_sum -= At(_window);
+		}
+	}
+
+	size_t GetWindow() const
+	{
+		return _window;
+	}
+
+	void Push(float value)
+	{
+		// the oldest sample in the window falls out of it
+		_sum -= At(_window - 1);
+		_front = _front == 0 ? _samples.size() - 1 : _front - 1;
+		_samples[_front] = value;
+		_sum += value;
+		// adding and subtracting floats accumulates error, so recompute the sum once per lap of the buffer
+		if (++_pushesSinceResync >= _samples.size())
+		{
+			Resync();
+		}
+	}
+
+	float Sum() const
+	{
+		return _sum;
+	}
+
+	float Average() const
+	{
+		return _sum / _window;
+	}
+
+	// Multiply every sample, including those outside the window, by the same factor
+	void Scale(float factor)
+	{
+		for (float &sample : _samples)
+		{
+			sample *= factor;
+		}
+		_sum *= factor;
+	}
+
+	void Clear()
+	{
+		std::fill(_samples.begin(), _samples.end(), 0.0f);
+		_front = 0;
+		_sum = 0.0f;
+		_pushesSinceResync = 0;
+	}
+
+private:
+	// age 0 is the most recent sample
+	float At(size_t age) const
+	{
+		size_t index = _front + age;
+		return _samples[index >= _samples.size() ? index - _samples.size() : index];
+	}
+
+	void Grow(size_t minCapacity)
+	{
+		std::vector<float> samples(std::max(minCapacity, _samples.size() * 2), 0.0f);
+		for (size_t age = 0; age < _samples.size(); ++age)
+		{
+			samples[age] = At(age);
+		}
+		_samples.swap(samples);
+		_front = 0;
+	}
+
+	void Resync()
+	{
+		_sum = 0.0f;
+		for (size_t age = 0; age < _window; ++age)
+		{
+			_sum += At(age);
+		}
+		_pushesSinceResync = 0;
+	}
+
+	std::vector<float> _samples;
+	size_t _front = 0;
+	size_t _window = 1;
+	float _sum = 0.0f;
+	size_t _pushesSinceResync = 0;
+};
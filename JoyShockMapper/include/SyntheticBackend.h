@@ -0,0 +1,34 @@
+#pragma once
+
+#include "JslBackend.h"
+
+#include <chrono>
+
+// Generates controllers instead of reading real ones, so that polling, mapping and output can be exercised
+// without any hardware. All controllers send a report at the given rate. Their input comes from SyntheticInput:
+// it either follows a script that goes through every button, stick direction and gyro motion in turn, or
+// wanders randomly from a seed.
+class SyntheticBackend : public JslBackend
+{
+public:
+	SyntheticBackend(int numControllers, float reportRate, bool randomized, unsigned int seed = 0);
+
+	int CountDevices() override;
+
+	JslDevice *Open(int index) override;
+
+	bool Wait(std::chrono::steady_clock::time_point deadline) override;
+
+	void Update(const std::map<int, JslDevice *> &devices) override;
+
+private:
+	int _numControllers;
+	float _period; // seconds
+	bool _randomized;
+	unsigned int _seed;
+	std::chrono::steady_clock::time_point _nextReport;
+};
+
+// Reads the JSM_SYNTHETIC_CONTROLLERS environment variable, formatted as <count>[,<reports per second>[,random]].
+// For example "8,1000" makes 8 scripted controllers reporting at 1kHz. Returns nullptr when it isn't set.
+JslBackend *createSyntheticBackendFromEnvironment();
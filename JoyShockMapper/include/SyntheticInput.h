@@ -0,0 +1,34 @@
+#pragma once
+
+#include "JoyShockLibrary.h"
+
+#include <random>
+
+// The input of one generated controller. It either follows a script that goes through every button, stick direction
+// and gyro motion in turn, or wanders randomly from a seed. SyntheticBackend reads it, and jsm_replay records it.
+class SyntheticInput
+{
+public:
+	// Seconds the script takes to tap every button and then hold every button, after which it starts over
+	static float GetScriptDuration();
+
+	SyntheticInput(int index, unsigned int seed);
+
+	// Move on by deltaTime seconds
+	void Generate(float deltaTime, bool randomized);
+
+	JOY_SHOCK_STATE state = {};
+	IMU_STATE imu = {};
+	TOUCH_STATE touch = {};
+
+private:
+	void Script(float t);
+
+	void Wander(float deltaTime);
+
+	int _index;
+	float _time = 0.f;
+	std::mt19937 _rng;
+	float _targets[6] = {}; // left stick, right stick, triggers
+	float _gyroTargets[3] = {};
+};
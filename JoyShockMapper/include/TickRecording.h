@@ -0,0 +1,86 @@
+#pragma once
+
+#include "JoyShockMapper.h"
+#include "JoyShockLibrary.h"
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <set>
+
+// Everything the mapping pipeline reads from a controller to process one of its reports
+struct TickInput
+{
+	JOY_SHOCK_STATE state = {};
+	TOUCH_STATE touch = {};
+	float deltaTime = 0.f; // seconds since the previous report
+	int numImuSamples = 0;
+	IMU_SAMPLE imuSamples[JSL_MAX_IMU_SAMPLES];
+};
+
+// A controller appearing in a recording
+struct RecordedDevice
+{
+	int32_t handle = 0;
+	int32_t controllerType = 0;
+	int32_t splitType = JS_SPLIT_TYPE_FULL;
+	int32_t sharedButtonsHandle = -1; // Handle of the other joycon when both are merged into one controller
+};
+
+enum class TickRecordType
+{
+	DEVICE,
+	TICK,
+	END,
+	INVALID
+};
+
+// Writes the input of every processed report to a binary file, so that it can be replayed later.
+// The structures are written as they are in memory: recordings are meant to be replayed by the same build.
+class TickRecorder
+{
+public:
+	// Returns false if the file can't be created
+	bool Start(in_string path);
+
+	void Stop();
+
+	inline bool IsRecording() const
+	{
+		return _recording.load(std::memory_order_relaxed);
+	}
+
+	// Devices only get written once, the first time they are seen
+	bool HasDevice(int handle);
+
+	void Write(const RecordedDevice &device);
+
+	void Write(int handle, const TickInput &input);
+
+	size_t GetTickCount() const
+	{
+		return _tickCount;
+	}
+
+private:
+	std::mutex _mutex; // Reports of different devices can be processed on different threads
+	std::ofstream _file;
+	std::set<int> _devices;
+	std::atomic_bool _recording = false;
+	size_t _tickCount = 0;
+};
+
+// Reads a file written by TickRecorder, one record at a time
+class TickReader
+{
+public:
+	// Returns false if the file can't be opened or isn't a recording
+	bool Open(in_string path);
+
+	// Fills either device or handle and input, depending on the type of record returned
+	TickRecordType Read(RecordedDevice &device, int &handle, TickInput &input);
+
+private:
+	std::ifstream _file;
+};
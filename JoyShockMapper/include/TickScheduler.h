@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#ifdef __linux__
+#include <cerrno>
+#include <time.h>
+#endif
+
+// Paces a loop on absolute deadlines, one period apart. Time spent processing and waking up late doesn't add up
+// and make the period drift as it does with relative sleeps. When a whole period goes by past a deadline, the
+// deadlines missed are counted as overruns and skipped rather than caught up on in a burst.
+class TickScheduler
+{
+public:
+	using clock = std::chrono::steady_clock;
+
+	// A new period applies from the last tick
+	void SetPeriod(clock::duration period)
+	{
+		if (period != _period)
+		{
+			_period = period;
+			_deadline = (_lastTick == clock::time_point() ? clock::now() : _lastTick) + period;
+		}
+	}
+
+	// How long before the deadline to stop sleeping and spin instead, because the OS may wake threads up late
+	void SetSpin(clock::duration spin)
+	{
+		_spin = spin;
+	}
+
+	clock::duration Period() const
+	{
+		return _period;
+	}
+
+	clock::time_point Deadline() const
+	{
+		return _deadline;
+	}
+
+	void SleepUntilDeadline() const
+	{
+		SleepUntil(_deadline, _spin);
+	}
+
+	// Call once the deadline is reached to move on to the next one
+	void Advance(clock::time_point now)
+	{
+		if (_lastTick != clock::time_point())
+		{
+			_totalNanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(now - _lastTick).count(), std::memory_order_relaxed);
+			_ticks.fetch_add(1, std::memory_order_relaxed);
+		}
+		_lastTick = now;
+		_deadline += _period;
+		if (_deadline <= now)
+		{
+			_overruns.fetch_add((now - _deadline) / _period + 1, std::memory_order_relaxed);
+			_deadline = now + _period;
+		}
+	}
+
+	// Average time between two ticks in seconds, or 0 before there were two
+	float MeasuredPeriod() const
+	{
+		uint64_t ticks = _ticks.load(std::memory_order_relaxed);
+		return ticks == 0 ? 0.f : _totalNanoseconds.load(std::memory_order_relaxed) / 1e9f / ticks;
+	}
+
+	uint64_t Overruns() const
+	{
+		return _overruns.load(std::memory_order_relaxed);
+	}
+
+	// The statistics can be read and reset from any thread
+	void ResetStats()
+	{
+		_totalNanoseconds.store(0, std::memory_order_relaxed);
+		_ticks.store(0, std::memory_order_relaxed);
+		_overruns.store(0, std::memory_order_relaxed);
+	}
+
+	// On Linux, steady_clock is CLOCK_MONOTONIC, so its time points can be slept to with clock_nanosleep directly
+	static void SleepUntil(clock::time_point time, clock::duration spin = clock::duration::zero())
+	{
+		auto wakeUp = time - spin;
+#ifdef __linux__
+		auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(wakeUp.time_since_epoch()).count();
+		timespec absolute;
+		absolute.tv_sec = time_t(nanoseconds / 1000000000);
+		absolute.tv_nsec = long(nanoseconds % 1000000000);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &absolute, nullptr) == EINTR)
+		{
+		}
+#else
+		std::this_thread::sleep_until(wakeUp);
+#endif
+		while (clock::now() < time)
+		{
+		}
+	}
+
+private:
+	clock::duration _period{ 0 };
+	clock::duration _spin{ 0 };
+	clock::time_point _deadline;
+	clock::time_point _lastTick;
+	std::atomic<int64_t> _totalNanoseconds{ 0 };
+	std::atomic<uint64_t> _ticks{ 0 };
+	std::atomic<uint64_t> _overruns{ 0 };
+};
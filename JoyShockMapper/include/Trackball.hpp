@@ -0,0 +1,51 @@
+#pragma once
+
+#include "SmoothingBuffer.hpp"
+#include <cmath>
+
+// Keeps the recent history of one gyro axis so that it can keep rolling with the average of that
+// history once the trackball is engaged. Rather than decaying every sample each tick, decay is tracked
+// with a single scale factor: new samples are stored divided by it and the average is multiplied by it.
+class Trackball
+{
+public:
+	// Record a sample while the trackball is not engaged. window is the number of recent samples to average.
+	void Push(float value, size_t window)
+	{
+		_samples.SetWindow(window);
+		_samples.Push(value / _scale);
+	}
+
+	// Get the inertial value while the trackball is engaged, then decay the history by the given factor.
+	// The value never gets faster than maxSpeed.
+	float Roll(float decay, size_t window, float maxSpeed)
+	{
+		_samples.SetWindow(window);
+		float value = _samples.Average() * _scale;
+		_scale *= decay;
+		if (_scale < MinScale || _scale > 1.f / MinScale)
+		{
+			// fold the scale into the samples before new samples divided by it lose precision
+			_samples.Scale(_scale);
+			_scale = 1.f;
+		}
+		float speed = std::abs(value);
+		if (speed > maxSpeed)
+		{
+			value *= maxSpeed / speed;
+		}
+		return value;
+	}
+
+	void Reset()
+	{
+		_samples.Clear();
+		_scale = 1.f;
+	}
+
+private:
+	static constexpr float MinScale = 1e-4f;
+
+	SmoothingBuffer _samples;
+	float _scale = 1.f;
+};
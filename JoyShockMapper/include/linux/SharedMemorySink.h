@@ -0,0 +1,49 @@
+#pragma once
+
+#include "InputHelpers.h"
+#include "SharedMemoryOutput.h"
+
+#include <mutex>
+#include <string>
+
+// Publishes output to a POSIX shared memory segment for games to read, as laid out in SharedMemoryOutput.h.
+// Output from every thread adds up to the next frame, which is published when a thread flushes its output.
+// Writers take turns with a mutex. Readers don't take part in it, so they never wait on JoyShockMapper.
+class SharedMemorySink : public OutputSink
+{
+public:
+	// Opens or creates the segment. Check IsOpen() afterwards.
+	explicit SharedMemorySink(const std::string &name = SHARED_OUTPUT_NAME);
+
+	// The segment is left in place for readers that have it mapped, and for the next time it's opened
+	~SharedMemorySink();
+
+	SharedMemorySink(const SharedMemorySink &) = delete;
+	SharedMemorySink &operator=(const SharedMemorySink &) = delete;
+
+	bool IsOpen() const
+	{
+		return _segment != nullptr;
+	}
+
+	void pressKey(KeyCode key, bool pressed) override;
+
+	void moveMouse(float x, float y) override;
+
+	void setMouseNorm(float x, float y) override;
+
+	void setOrientation(int handle, float w, float x, float y, float z) override;
+
+	void flush() override;
+
+	// Release all keys, so that nothing stays held when output goes elsewhere
+	void releaseAll();
+
+private:
+	void publish();
+
+	SharedOutputSegment *_segment = nullptr;
+	std::mutex _lock;
+	SharedOutputFrame _next{}; // Frame being put together
+	bool _changed = false;
+};
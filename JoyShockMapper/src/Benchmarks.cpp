@@ -0,0 +1,393 @@
+// Micro-benchmarks of the input processing hot path, built into jsm_bench with the JSM_BENCHMARKS CMake option.
+// This file is included by main.cpp so that it can reach the classes and functions defined there.
+// Run jsm_bench --help for Google Benchmark's options, such as --benchmark_filter or --benchmark_out=<file>.
+
+#include <benchmark/benchmark.h>
+#include <filesystem>
+#ifdef __linux__
+#include "linux/SharedMemorySink.h"
+#endif
+
+namespace
+{
+CmdRegistry *benchRegistry = nullptr;
+
+// Replayed and benchmarked controllers get negative handles so that no output reaches a real controller
+int nextBenchHandle = -1000;
+
+shared_ptr<JoyShock> makeBenchController()
+{
+	return shared_ptr<JoyShock>(new JoyShock(nextBenchHandle--, JS_SPLIT_TYPE_FULL));
+}
+
+void configure(std::initializer_list<const char *> lines)
+{
+	for (auto line : lines)
+	{
+		benchRegistry->processLine(line);
+	}
+}
+
+// A sequence of button changes, with the time in milliseconds to let pass before each one
+struct ButtonStep
+{
+	ButtonID id;
+	bool pressed;
+	int waitMs;
+};
+
+// Each scenario drives a button through a group of BtnState transitions. Every call to updateButtonState
+// is counted as an item, including those where the button is held and only time passes.
+// allocs is the number of heap allocations per iteration, which should be 0.
+void BM_ButtonStates(benchmark::State &state, std::initializer_list<const char *> config, std::vector<ButtonStep> steps, std::vector<ButtonID> watched)
+{
+	configure(config);
+	auto jc = makeBenchController();
+	float turbo = jc->getSetting(SettingID::TURBO_PERIOD);
+	float hold = jc->getSetting(SettingID::HOLD_PRESS_TIME);
+	auto timeNow = chrono::steady_clock::time_point();
+	std::vector<bool> pressed(int(ButtonID::SIZE), false);
+	size_t calls = 0;
+	size_t allocations = heapAllocations;
+	for (auto _ : state)
+	{
+		for (const auto &step : steps)
+		{
+			// Let time pass in 1ms reports like a fast controller would, with every watched button updated each time
+			for (int ms = 0; ms < step.waitMs; ++ms)
+			{
+				timeNow += chrono::milliseconds(1);
+				for (auto id : watched)
+				{
+					jc->GetButton(id)->updateButtonState(pressed[int(id)], timeNow, turbo, hold);
+					++calls;
+				}
+			}
+			pressed[int(step.id)] = step.pressed;
+		}
+	}
+	state.SetItemsProcessed(calls);
+	state.counters["allocs"] = benchmark::Counter(double(heapAllocations - allocations), benchmark::Counter::kAvgIterations);
+	resetAllMappings();
+}
+
+// NoPress -> BtnPress -> TapRelease -> NoPress
+BENCHMARK_CAPTURE(BM_ButtonStates, Tap, { "UP = 1" },
+  { { ButtonID::UP, true, 0 }, { ButtonID::UP, false, 30 }, { ButtonID::UP, false, 300 } }, { ButtonID::UP });
+// BtnPress with hold and turbo events
+BENCHMARK_CAPTURE(BM_ButtonStates, HoldTurbo, { "DOWN = 2 3+" },
+  { { ButtonID::DOWN, true, 0 }, { ButtonID::DOWN, false, 600 }, { ButtonID::DOWN, false, 300 } }, { ButtonID::DOWN });
+// WaitSim -> SimPress -> SimRelease
+BENCHMARK_CAPTURE(BM_ButtonStates, SimPress, { "L = 4", "R = 5", "L+R = 6" },
+  { { ButtonID::L, true, 0 }, { ButtonID::R, true, 10 }, { ButtonID::L, false, 100 }, { ButtonID::R, false, 20 }, { ButtonID::R, false, 300 } },
+  { ButtonID::L, ButtonID::R });
+// DblPressStart -> DblPressNoPressTap -> DblPressPress, then DblPressStart -> DblPressNoPressHold -> BtnPress
+BENCHMARK_CAPTURE(BM_ButtonStates, DoublePress, { "LEFT = 7", "LEFT,LEFT = 8" },
+  { { ButtonID::LEFT, true, 0 }, { ButtonID::LEFT, false, 30 }, { ButtonID::LEFT, true, 50 }, { ButtonID::LEFT, false, 30 },
+    { ButtonID::LEFT, true, 300 }, { ButtonID::LEFT, false, 170 }, { ButtonID::LEFT, false, 400 } },
+  { ButtonID::LEFT });
+// BtnPress -> InstRelease -> NoPress
+BENCHMARK_CAPTURE(BM_ButtonStates, InstantRelease, { "RIGHT = !9_" },
+  { { ButtonID::RIGHT, true, 0 }, { ButtonID::RIGHT, false, 170 }, { ButtonID::RIGHT, false, 300 } }, { ButtonID::RIGHT });
+
+// Read a setting while state.range(0) buttons are held, each with a modeshift of that setting.
+// Resolve forces the chord stack to be walked every time, Cached is the usual case between button changes.
+void BM_GetSetting(benchmark::State &state, bool resolve)
+{
+	static const ButtonID chordButtons[] = { ButtonID::S, ButtonID::E, ButtonID::N, ButtonID::W, ButtonID::L, ButtonID::R, ButtonID::ZL, ButtonID::ZR };
+	auto jc = makeBenchController();
+	int depth = int(state.range(0));
+	for (int i = 0; i < depth; ++i)
+	{
+		string name(magic_enum::enum_name(chordButtons[i]));
+		benchRegistry->processLine(name + ",MIN_GYRO_SENS = " + to_string(i + 1));
+		benchRegistry->processLine(name + ",LEFT_STICK_MODE = AIM");
+		jc->btnCommon->chordStack.push_front(chordButtons[i]);
+		jc->btnCommon->chordStackRevision++;
+	}
+	for (auto _ : state)
+	{
+		if (resolve)
+		{
+			jc->btnCommon->chordStackRevision++;
+		}
+		benchmark::DoNotOptimize(jc->getSetting<FloatXY>(SettingID::MIN_GYRO_SENS));
+		benchmark::DoNotOptimize(jc->getSetting<StickMode>(SettingID::LEFT_STICK_MODE));
+		benchmark::DoNotOptimize(jc->getSetting(SettingID::IN_GAME_SENS));
+	}
+	resetAllMappings();
+}
+
+BENCHMARK_CAPTURE(BM_GetSetting, Resolve, true)->Arg(1)->Arg(4)->Arg(8);
+BENCHMARK_CAPTURE(BM_GetSetting, Cached, false)->Arg(1)->Arg(4)->Arg(8);
+
+// Smoothing window of state.range(0) samples, with input around the smoothing threshold so both paths are taken
+void BM_GetSmoothedGyro(benchmark::State &state)
+{
+	auto jc = makeBenchController();
+	int window = int(state.range(0));
+	float angle = 0.f;
+	for (auto _ : state)
+	{
+		angle += 0.01f;
+		float x = 4.f * cosf(angle), y = 4.f * sinf(angle * 1.3f);
+		float outX, outY;
+		jc->GetSmoothedGyro(x, y, sqrtf(x * x + y * y), 2.f, 8.f, window, outX, outY);
+		benchmark::DoNotOptimize(outX);
+		benchmark::DoNotOptimize(outY);
+	}
+}
+
+BENCHMARK(BM_GetSmoothedGyro)->Arg(1)->Arg(16)->Arg(128)->Arg(1024);
+
+// Record a window of state.range(0) samples while the trackball isn't engaged
+void BM_TrackballPush(benchmark::State &state)
+{
+	Trackball trackball;
+	size_t window = size_t(state.range(0));
+	float t = 0.f;
+	for (auto _ : state)
+	{
+		t += 0.001f;
+		trackball.Push(100.f * sinf(t), window);
+	}
+	benchmark::DoNotOptimize(trackball.Roll(1.f, window, 1000.f));
+}
+
+BENCHMARK(BM_TrackballPush)->Arg(16)->Arg(125)->Arg(1024);
+
+// Roll with a window of state.range(0) samples. The scale folds back into the samples every 120 or so rolls.
+void BM_TrackballRoll(benchmark::State &state)
+{
+	Trackball trackball;
+	size_t window = size_t(state.range(0));
+	for (size_t i = 0; i < window; ++i)
+	{
+		trackball.Push(100.f, window);
+	}
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(trackball.Roll(0.926f, window, 1000.f));
+	}
+}
+
+BENCHMARK(BM_TrackballRoll)->Arg(16)->Arg(125)->Arg(1024);
+
+void BM_ProcessMotion(benchmark::State &state)
+{
+	GamepadMotion motion;
+	float t = 0.f;
+	for (auto _ : state)
+	{
+		t += 0.001f;
+		motion.ProcessMotion(60.f * sinf(t * 2.f), 120.f * sinf(t * 4.4f), 5.f, 0.02f, 1.f, 0.01f, 0.001f);
+		float x, y, z;
+		motion.GetCalibratedGyro(x, y, z);
+		benchmark::DoNotOptimize(x);
+	}
+}
+
+BENCHMARK(BM_ProcessMotion);
+
+// The stick goes around in circles and returns to center once per lap, to cover flicks and rotations
+void BM_ProcessStick(benchmark::State &state)
+{
+	StickMode mode = StickMode(state.range(0));
+	state.SetLabel(string(magic_enum::enum_name(mode)));
+	auto jc = makeBenchController();
+	float mouseCalibrationFactor = 180.0f / PI / os_mouse_speed.get();
+	float lastX = 0.f, lastY = 0.f;
+	float angle = 0.f;
+	auto timeNow = chrono::steady_clock::time_point();
+	for (auto _ : state)
+	{
+		timeNow += chrono::milliseconds(1);
+		jc->time_now = timeNow;
+		angle = fmodf(angle + 0.01f, 2.f * PI);
+		float length = angle < 0.3f ? 0.f : 0.9f;
+		float x = length * cosf(angle), y = length * sinf(angle);
+		bool anyStickInput = false, lockMouse = false;
+		float camSpeedX = 0.f, camSpeedY = 0.f;
+		processStick(jc, x, y, lastX, lastY, 0.15f, 0.1f, RingMode::OUTER, mode,
+		  ButtonID::RRING, ButtonID::RLEFT, ButtonID::RRIGHT, ButtonID::RUP, ButtonID::RDOWN, ControllerOrientation::FORWARD,
+		  mouseCalibrationFactor, 0.001f, jc->right_acceleration, jc->right_last_cal, jc->is_flicking_right, jc->ignore_right_stick_mode,
+		  anyStickInput, lockMouse, camSpeedX, camSpeedY, &jc->right_scroll);
+		benchmark::DoNotOptimize(camSpeedX);
+		lastX = x;
+		lastY = y;
+	}
+}
+
+BENCHMARK(BM_ProcessStick)->DenseRange(int(StickMode::NO_MOUSE), int(StickMode::INVALID) - 1);
+
+// Flicks to a new direction every 100 reports, and rotates the stick in between
+void BM_HandleFlickStick(benchmark::State &state)
+{
+	auto jc = makeBenchController();
+	float mouseCalibrationFactor = 180.0f / PI / os_mouse_speed.get();
+	float lastX = 0.f, lastY = 0.f;
+	bool isFlicking = false;
+	int report = 0;
+	auto timeNow = chrono::steady_clock::time_point();
+	for (auto _ : state)
+	{
+		timeNow += chrono::milliseconds(1);
+		jc->time_now = timeNow;
+		++report;
+		float angle = (report / 100) * 2.4f + (report % 100) * 0.005f;
+		float length = report % 100 < 10 ? 0.f : 1.f;
+		float x = length * cosf(angle), y = length * sinf(angle);
+		benchmark::DoNotOptimize(handleFlickStick(x, y, lastX, lastY, length, isFlicking, jc, mouseCalibrationFactor, 0.001f, false, false));
+		lastX = x;
+		lastY = y;
+	}
+}
+
+BENCHMARK(BM_HandleFlickStick);
+
+// Lines typical of configuration files, from the simplest assignment to chorded and modeshifted mappings
+void BM_ProcessLine(benchmark::State &state, const char *line)
+{
+	for (auto _ : state)
+	{
+		benchRegistry->processLine(line);
+	}
+	resetAllMappings();
+}
+
+BENCHMARK_CAPTURE(BM_ProcessLine, Setting, "MIN_GYRO_SENS = 2.5 2");
+BENCHMARK_CAPTURE(BM_ProcessLine, Mapping, "R2 = LMOUSE");
+BENCHMARK_CAPTURE(BM_ProcessLine, TapHold, "E = R E\\");
+BENCHMARK_CAPTURE(BM_ProcessLine, Chord, "ZL,N = !1\\ LMOUSE+ !Q/");
+BENCHMARK_CAPTURE(BM_ProcessLine, Modeshift, "R3,RIGHT_STICK_MODE = MOUSE_AREA");
+BENCHMARK_CAPTURE(BM_ProcessLine, Comment, "# Nothing to do here");
+
+// Loading a 300 line configuration, like a complete AutoLoad profile
+void BM_LoadConfig(benchmark::State &state)
+{
+	static const char *lines[] = {
+		"# Shooter profile",
+		"RESET_MAPPINGS",
+		"MIN_GYRO_SENS = 2.5 2",
+		"MAX_GYRO_SENS = 4",
+		"MIN_GYRO_THRESHOLD = 5",
+		"MAX_GYRO_THRESHOLD = 75",
+		"RIGHT_STICK_MODE = FLICK",
+		"LEFT_STICK_MODE = NO_MOUSE # Movement is on WASD",
+		"W = 1 2",
+		"E = R E\\",
+		"S = SPACE",
+		"N = F",
+		"R2 = LMOUSE",
+		"L2 = RMOUSE",
+		"ZL,N = !1\\ LMOUSE+ !Q/",
+		"L+R = G",
+		"UP,UP = !ENTER\\ LSHIFT\\ !G\\ !L\\ !ENTER/",
+		"R3,RIGHT_STICK_MODE = MOUSE_AREA",
+		"GYRO_OFF = R3",
+		"LUP = W",
+		"LDOWN = S",
+		"LLEFT = A",
+		"LRIGHT = D",
+		"",
+	};
+	auto path = (filesystem::temp_directory_path() / "jsm_bench_config.txt").string();
+	{
+		ofstream file(path);
+		for (int i = 0; file && i < 300; ++i)
+		{
+			file << lines[i % size(lines)] << '\n';
+		}
+	}
+	for (auto _ : state)
+	{
+		benchRegistry->loadConfigFile(path);
+	}
+	state.SetItemsProcessed(state.iterations() * 300);
+	filesystem::remove(path);
+	resetAllMappings();
+}
+
+BENCHMARK(BM_LoadConfig)->Unit(benchmark::kMillisecond);
+
+#ifdef __linux__
+// A segment of its own, so that benchmarks don't disturb a game reading JoyShockMapper's output
+constexpr char BENCH_SHARED_OUTPUT[] = "/joyshockmapper-bench";
+
+// One tick of OUTPUT_DEVICE = SHARED_MEMORY: some mouse motion, the controller orientation and the frame published
+void BM_SharedMemoryPublish(benchmark::State &state)
+{
+	SharedMemorySink sink(BENCH_SHARED_OUTPUT);
+	float angle = 0.f;
+	for (auto _ : state)
+	{
+		angle += 0.01f;
+		sink.moveMouse(cosf(angle), sinf(angle));
+		sink.setOrientation(0, cosf(angle), sinf(angle), 0.f, 0.f);
+		sink.flush();
+	}
+	shm_unlink(BENCH_SHARED_OUTPUT);
+}
+
+BENCHMARK(BM_SharedMemoryPublish);
+
+// What a game pays to get the latest frame. With state.range(0) set, another thread publishes frames all along,
+// so reads are sometimes retried because the frame changed while it was copied.
+void BM_SharedMemoryReadLatest(benchmark::State &state)
+{
+	SharedMemorySink sink(BENCH_SHARED_OUTPUT);
+	SharedOutputReader reader;
+	if (!reader.Open(BENCH_SHARED_OUTPUT))
+	{
+		state.SkipWithError("The shared memory can't be opened");
+		return;
+	}
+	atomic<bool> writing{ state.range(0) != 0 };
+	state.SetLabel(writing ? "while publishing" : "idle");
+	thread writer([&sink, &writing] {
+		while (writing)
+		{
+			sink.moveMouse(0.5f, 0.f);
+			sink.flush();
+		}
+	});
+	SharedOutputFrame frame;
+	for (auto _ : state)
+	{
+		reader->ReadLatest(frame);
+		benchmark::DoNotOptimize(frame);
+	}
+	writing = false;
+	writer.join();
+	reader.Close();
+	shm_unlink(BENCH_SHARED_OUTPUT);
+}
+
+BENCHMARK(BM_SharedMemoryReadLatest)->Arg(0)->Arg(1);
+#endif
+} // namespace
+
+int runBenchmarks(CmdRegistry &commandRegistry, int argc, char *argv[])
+{
+	benchRegistry = &commandRegistry;
+	// Nothing pressed or moved during benchmarks should reach the OS, and nothing printed should reach the console.
+	// Commands print their result, so the console streams are muted and the results are reported on their own stream.
+	ReplayCapture discard(nullptr);
+	setOutputSink(&discard);
+	ostream results(cout.rdbuf());
+	auto coutBuffer = cout.rdbuf(nullptr);
+	auto cerrBuffer = cerr.rdbuf(nullptr);
+
+	benchmark::Initialize(&argc, argv);
+	benchmark::ConsoleReporter reporter;
+	reporter.SetOutputStream(&results);
+	reporter.SetErrorStream(&results);
+	benchmark::RunSpecifiedBenchmarks(&reporter);
+	benchmark::Shutdown();
+
+	flushLog();
+	cout.rdbuf(coutBuffer);
+	cerr.rdbuf(cerrBuffer);
+	setOutputSink(nullptr);
+	return 0;
+}
@@ -4,10 +4,35 @@
 #include <cctype>
 #include <iostream>
 #include <memory>
-#include <regex>
 #include <string>
 #include <fstream>
 
+namespace
+{
+// Same as \w and \s in regular expressions
+inline bool isWordChar(char c)
+{
+	return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+inline size_t skipSpaces(string_view line, size_t pos)
+{
+	while (pos < line.size() && isspace(static_cast<unsigned char>(line[pos])))
+		++pos;
+	return pos;
+}
+
+// A command or button name: [+-]?\w*
+inline size_t skipName(string_view line, size_t pos)
+{
+	if (pos < line.size() && (line[pos] == '+' || line[pos] == '-'))
+		++pos;
+	while (pos < line.size() && isWordChar(line[pos]))
+		++pos;
+	return pos;
+}
+} // namespace
+
 JSMCommand::JSMCommand(in_string name)
   : _parse()
   , _help("Enter README to bring up the user manual.")
@@ -34,20 +59,20 @@ JSMCommand* JSMCommand::SetHelp(in_string commandDescription)
 	return this;
 }
 
-unique_ptr<JSMCommand> JSMCommand::GetModifiedCmd(char op, in_string chord)
+unique_ptr<JSMCommand> JSMCommand::GetModifiedCmd(char op, string_view chord)
 {
 	return nullptr;
 }
 
-bool JSMCommand::ParseData(in_string arguments)
+bool JSMCommand::ParseData(string_view arguments)
 {
 	_ASSERT_EXPR(_parse, L"There is no function defined to parse this command.");
-	if (arguments.compare("HELP") == 0)
+	if (arguments == "HELP")
 	{
 		// Parsing has failed. Show help.
 		COUT << _help << endl;
 	}
-	else if (!_parse(this, arguments))
+	else if (!_parse(this, string(arguments)))
 	{
 		CERR << _help << endl;
 	}
@@ -67,14 +92,20 @@ bool CmdRegistry::loadConfigFile(string fileName)
 		fileName = fileName.substr(1, fileName.size() - 2);
 
 	ifstream file(fileName);
+	string filePath = fileName;
 	if (!file.is_open())
 	{
-		file.open(std::string{ BASE_JSM_CONFIG_FOLDER() } + fileName);
+		filePath = std::string{ BASE_JSM_CONFIG_FOLDER() } + fileName;
+		file.open(filePath);
 	}
 	if (file)
 	{
 		COUT << "Loading commands from file ";
 		COUT_INFO << fileName << endl;
+		if (_loadObserver)
+		{
+			_loadObserver->OnFileLoaded(filePath);
+		}
 		// https://stackoverflow.com/questions/6892754/creating-a-simple-configuration-file-and-parser-in-c
 		string line;
 		while (getline(file, line))
@@ -114,11 +145,13 @@ string_view CmdRegistry::strtrim(std::string_view str)
 // accepted.
 bool CmdRegistry::Add(JSMCommand* newCommand)
 {
-	// Check that the pointer is valid, that the name is valid.
-	if (newCommand && regex_match(newCommand->_name, regex(R"(^(\+|-|\w+)$)")))
+	// Check that the pointer is valid, that the name is valid: + or - or \w+
+	if (newCommand && !newCommand->_name.empty() &&
+	  (newCommand->_name == "+" || newCommand->_name == "-" || all_of(newCommand->_name.begin(), newCommand->_name.end(), isWordChar)))
 	{
 		// Unique pointers automatically delete the pointer on object destruction
 		_registry.emplace(newCommand->_name, unique_ptr<JSMCommand>(newCommand));
+		_index[newCommand->_name].push_back(newCommand);
 		return true;
 	}
 	delete newCommand;
@@ -128,18 +161,69 @@ bool CmdRegistry::Add(JSMCommand* newCommand)
 bool CmdRegistry::Remove(in_string name)
 {
 	// If I allow multiple commands with the same name, I should have a way to specify which one I want to remove.
-	CmdMap::iterator cmd = find_if(_registry.begin(), _registry.end(), bind(&CmdRegistry::findCommandWithName, name, placeholders::_1));
-	if (cmd != _registry.end())
+	auto entry = _index.find(name);
+	if (entry != _index.end())
 	{
-		_registry.erase(cmd);
+		// The first one added is also the first one in the multimap
+		if (entry->second.size() > 1)
+		{
+			entry->second.erase(entry->second.begin());
+			// The key views the name of the command going away, so view the one of the next command instead
+			auto node = _index.extract(entry);
+			node.key() = node.mapped().front()->_name;
+			_index.insert(move(node));
+		}
+		else
+			_index.erase(entry); // Before the command holding the key string goes away
+		_registry.erase(_registry.find(name));
 		return true;
 	}
 	return false;
 }
 
-bool CmdRegistry::findCommandWithName(in_string name, CmdMap::value_type& pair)
+const vector<JSMCommand*>* CmdRegistry::findCommands(string_view name) const
 {
-	return name == pair.first;
+	auto entry = _index.find(name);
+	return entry != _index.end() ? &entry->second : nullptr;
+}
+
+// Splits the line the same way as ^\s*([+-]?\w*)\s*([,+]\s*([+-]?\w*))?\s*([^#\n]*)(#\s*(.*))?$ would,
+// where the combo and operator are optional and the arguments keep their trailing spaces.
+bool CmdRegistry::tokenize(string_view line, CmdLine& parts)
+{
+	parts = CmdLine();
+	if (line.find('\n') != string_view::npos)
+	{
+		return false;
+	}
+	size_t pos = skipSpaces(line, 0);
+	size_t end = skipName(line, pos);
+	string_view first = line.substr(pos, end - pos);
+	pos = skipSpaces(line, end);
+	if (pos < line.size() && (line[pos] == ',' || line[pos] == '+'))
+	{
+		parts.combo = first;
+		parts.op = line[pos];
+		pos = skipSpaces(line, pos + 1);
+		end = skipName(line, pos);
+		parts.name = line.substr(pos, end - pos);
+		pos = skipSpaces(line, end);
+	}
+	else
+	{
+		parts.name = first;
+	}
+	size_t labelStart = line.find('#', pos);
+	if (labelStart == string_view::npos)
+	{
+		parts.arguments = line.substr(pos);
+	}
+	else
+	{
+		parts.arguments = line.substr(pos, labelStart - pos);
+		parts.label = line.substr(skipSpaces(line, labelStart + 1));
+	}
+	return true;
 }
 
 bool CmdRegistry::isCommandValid(in_string line)
@@ -150,79 +234,48 @@ bool CmdRegistry::isCommandValid(in_string line)
 		file.close();
 		return true;
 	}
-	smatch results;
-	string combo, name, arguments, label;
-	char op = '\0';
-	if (regex_match(line, results, regex(R"(^\s*([+-]?\w*)\s*([,+]\s*([+-]?\w*))?\s*([^#\n]*)(#\s*(.*))?$)")))
-	{
-		if (results[2].length() > 0)
-		{
-			combo = results[1];
-			op = results[2].str()[0];
-			name = results[3];
-		}
-		else
-		{
-			name = results[1];
-		}
-
-		arguments = results[4];
-		label = results[6];
-	}
-
-	bool hasProcessed = false;
-	CmdMap::iterator cmd = find_if(_registry.begin(), _registry.end(), bind(&CmdRegistry::findCommandWithName, name, placeholders::_1));
-	return cmd != _registry.end();
+	CmdLine parts;
+	tokenize(line, parts);
+	return findCommands(parts.name) != nullptr;
 }
 
 void CmdRegistry::processLine(const string& line)
 {
-	auto trimmedLine = std::string{ strtrim(line) };
+	string_view trimmedLine = strtrim(line);
 
-	if (!trimmedLine.empty() && trimmedLine.front() != '#' && !loadConfigFile(trimmedLine))
+	if (!trimmedLine.empty() && trimmedLine.front() != '#' && !loadConfigFile(string(trimmedLine)))
 	{
-		smatch results;
-		string combo, name, arguments, label;
-		char op = '\0';
-		// Break up the line of text in its relevant parts.
-		// Pro tip: use regex101.com to develop these beautiful monstrosities. :P
-		// Also, use raw strings R"(...)" to avoid the need to escape characters
-		// I dislike having to code in exception for + and - buttons not being \w characters
-		if (regex_match(trimmedLine, results, regex(R"(^\s*([+-]?\w*)\s*([,+]\s*([+-]?\w*))?\s*([^#\n]*)(#\s*(.*))?$)")))
-		{
-			if (results[2].length() > 0)
-			{
-				combo = results[1];
-				op = results[2].str()[0];
-				name = results[3];
-			}
-			else
-			{
-				name = results[1];
-			}
-
-			arguments = results[4];
-			label = results[6];
-		}
+		// Break up the line of text in its relevant parts. They view the line rather than copy it.
+		CmdLine parts;
+		tokenize(trimmedLine, parts);
+		string_view arguments = parts.arguments;
+		string_view combo = parts.combo;
 
 		bool hasProcessed = false;
-		CmdMap::iterator cmd = find_if(_registry.begin(), _registry.end(), bind(&CmdRegistry::findCommandWithName, name, placeholders::_1));
-		while (cmd != _registry.end())
+		if (auto commands = findCommands(parts.name))
 		{
-			if (combo.empty())
-			{
-				hasProcessed |= cmd->second->ParseData(arguments);
-			}
-			else
+			for (JSMCommand* cmd : *commands)
 			{
-				auto modCommand = cmd->second->GetModifiedCmd(op, combo);
-				if (modCommand)
+				if (combo.empty())
+				{
+					if (_loadObserver && !_loadObserver->OnCommand(*cmd))
+						hasProcessed = true;
+					else
+						hasProcessed |= cmd->ParseData(arguments);
+				}
+				else
 				{
-					hasProcessed |= modCommand->ParseData(arguments);
+					auto modCommand = cmd->GetModifiedCmd(parts.op, combo);
+					if (modCommand)
+					{
+						if (_loadObserver && !_loadObserver->OnCommand(*modCommand))
+							hasProcessed = true;
+						else
+							hasProcessed |= modCommand->ParseData(arguments);
+					}
+					// Any task set to be run on destruction is done here.
 				}
-				// Any task set to be run on destruction is done here.
 			}
-			cmd = find_if(++cmd, _registry.end(), bind(&CmdRegistry::findCommandWithName, name, placeholders::_1));
 		}
 
 		if (!hasProcessed)
@@ -243,15 +296,15 @@ void CmdRegistry::GetCommandList(vector<string>& outList)
 
 bool CmdRegistry::hasCommand(in_string name) const
 {
-	return _registry.find(name) != _registry.end();
+	return findCommands(name) != nullptr;
 }
 
 string CmdRegistry::GetHelp(in_string command)
 {
-	auto cmd = _registry.find(command);
-	if (cmd != _registry.end())
+	auto commands = findCommands(command);
+	if (commands)
 	{
-		return cmd->second->Help();
+		return commands->front()->Help();
 	}
 	return "";
 }
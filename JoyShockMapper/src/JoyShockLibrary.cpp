@@ -1,172 +1,381 @@
 #include "JoyShockLibrary.h"
+#include "JslBackend.h"
+#include "SyntheticBackend.h"
+#include "TickScheduler.h"
 #include "JSMVariable.hpp"
+#include "PlatformDefinitions.h"
 #include "SDL.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <thread>
 #define INCLUDE_MATH_DEFINES
 #include <cmath> // M_PI
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
-struct ControllerDevice;
-
-static std::map<int, ControllerDevice *> _controllerMap;
-bool keep_polling = true;
+static std::unique_ptr<JslBackend> _backend;
+static std::mutex _backendLock; // Devices are opened, updated and closed by one thread at a time
+static std::thread _pollThread;
+static std::atomic<bool> keep_polling{ true };
+// The device a DeviceWorker is calling back for, which getters called from the callback use without looking it up
+static thread_local int _callbackHandle = 0;
+static thread_local JslDevice *_callbackDevice = nullptr;
+static std::atomic<float> _updateDuration{ 0.f }; // seconds taken by the last backend update
+static TickScheduler _scheduler; // Ticks of the polling thread, driven by TICK_TIME
 class Joyshock;
 void (*g_callback)(int, JOY_SHOCK_STATE, JOY_SHOCK_STATE, IMU_STATE, IMU_STATE, float);
 
-std::mutex controller_lock;
-
 extern JSMVariable<float> tick_time;
+extern JSMVariable<float> tick_spin_time;
+extern JSMVariable<int> processing_cpu;
+extern JSMVariable<int> input_thread_priority;
+extern JSMVariable<int> input_thread_cpu;
+extern JSMVariable<Switch> lock_memory;
 
-static int pollDevices(void *obj)
-{
-	while (keep_polling)
+#ifndef _WIN32
+// The CPUs the process may run on, as restricted by cpusets or taskset. Read at startup, before any thread is pinned.
+static const cpu_set_t _processCpus = [] {
+	cpu_set_t cpus;
+	if (sched_getaffinity(0, sizeof(cpus), &cpus) != 0)
 	{
-		SDL_Delay(tick_time.get());
-
-		std::lock_guard guard(controller_lock);
-		for (auto iter = _controllerMap.begin(); iter != _controllerMap.end(); ++iter)
+		CPU_ZERO(&cpus);
+		for (int i = 0, numCpus = std::max(1, int(std::thread::hardware_concurrency())); i < numCpus; ++i)
 		{
-			SDL_GameControllerUpdate();
-			JOY_SHOCK_STATE dummy1;
-			IMU_STATE dummy2;
-			memset(&dummy1, 0, sizeof(dummy1));
-			memset(&dummy2, 0, sizeof(dummy2));
-			g_callback(iter->first, dummy1, dummy1, dummy2, dummy2, tick_time.get());
+			CPU_SET(i, &cpus);
 		}
 	}
+	return cpus;
+}();
+#endif
 
-	return 1;
+// Keep a thread on a single CPU. Negative values let it run on all the CPUs the process may use again.
+// Returns false if the thread can't run on that CPU.
+static bool pinThread(std::thread::native_handle_type thread, int cpu)
+{
+#ifdef _WIN32
+	DWORD_PTR processCpus, systemCpus;
+	GetProcessAffinityMask(GetCurrentProcess(), &processCpus, &systemCpus);
+	return cpu < int(sizeof(DWORD_PTR) * 8) && SetThreadAffinityMask(thread, cpu < 0 ? processCpus : DWORD_PTR(1) << cpu) != 0;
+#else
+	cpu_set_t cpus = _processCpus;
+	if (cpu >= 0)
+	{
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+	}
+	return pthread_setaffinity_np(thread, sizeof(cpus), &cpus) == 0;
+#endif
 }
 
-struct ControllerDevice
+// Give the calling thread the scheduling set with INPUT_THREAD_PRIORITY, or the closest it is allowed.
+// Sets a description of what was applied, and returns false if it isn't what was asked for.
+static bool prioritizeThread(int priority, std::string &applied)
 {
-	~ControllerDevice()
+#ifdef _WIN32
+	int level = priority <= 0 ? THREAD_PRIORITY_NORMAL : priority < 50 ? THREAD_PRIORITY_HIGHEST : THREAD_PRIORITY_TIME_CRITICAL;
+	if (!SetThreadPriority(GetCurrentThread(), level))
 	{
-		SDL_GameControllerClose(_sdlController);
+		applied = "unchanged priority, because it can't be set";
+		return false;
 	}
-
-	inline bool isValid()
+	applied = priority <= 0 ? "normal priority" : priority < 50 ? "highest priority" : "time critical priority";
+	return true;
+#else
+	sched_param param{};
+	if (priority > 0)
 	{
-		return _sdlController == nullptr;
+		param.sched_priority = std::min(priority, sched_get_priority_max(SCHED_FIFO));
+		if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0)
+		{
+			applied = "real-time priority " + std::to_string(param.sched_priority);
+			return true;
+		}
 	}
-	bool has_gyro = false;
-	bool has_accel = false;
-	int split_type = JS_SPLIT_TYPE_FULL;
-	SDL_GameController *_sdlController = nullptr;
-};
+	param.sched_priority = 0;
+	pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+	// Without the permission for real-time scheduling, settle for the lowest nice level allowed
+	pid_t thread = pid_t(syscall(SYS_gettid));
+	int nice = priority > 0 ? -20 : 0;
+	while (setpriority(PRIO_PROCESS, thread, nice) != 0 && nice < 0)
+	{
+		++nice;
+	}
+	if (priority <= 0)
+	{
+		applied = "normal priority";
+		return true;
+	}
+	applied = "nice level " + std::to_string(nice) + ", because real-time scheduling isn't permitted";
+	return false;
+#endif
+}
 
-int JslConnectDevices()
+// Keep the whole process in RAM, so that input processing never waits on a page fault
+static bool lockMemory(bool lock)
 {
-	return SDL_NumJoysticks();
+#ifdef _WIN32
+	return !lock; // There is no equivalent
+#else
+	return lock ? mlockall(MCL_CURRENT | MCL_FUTURE) == 0 : munlockall() == 0;
+#endif
 }
 
-int JslGetConnectedDeviceHandles(int *deviceHandleArray, int size)
+// Calls back for a single device on a thread of its own, so that a controller that is slow to process or to send
+// output to doesn't hold the others up. The polling thread only copies reports over.
+class DeviceWorker
 {
-	std::lock_guard guard(controller_lock);
-	auto iter = _controllerMap.begin();
-	while (iter != _controllerMap.end())
+public:
+	DeviceWorker(int handle, JslDevice *device, int cpu)
+	  : _handle(handle)
+	  , _device(device)
+	  , _thread(&DeviceWorker::Run, this)
 	{
-		delete iter->second;
-		iter = _controllerMap.erase(iter);
+		if (cpu >= 0 && !pinThread(_thread.native_handle(), cpu))
+		{
+			CERR << "Controller " << handle << " can't be processed on CPU " << cpu << ": it isn't available to JoyShockMapper" << endl;
+		}
 	}
-	for (int i = 0; i < size; i++)
+
+	~DeviceWorker()
+	{
+		Stop();
+	}
+
+	// Hand the device's current inputs over. If the previous ones weren't processed yet, they are merged.
+	void Post(std::chrono::steady_clock::time_point reportTime)
 	{
-		ControllerDevice *device = new ControllerDevice();
-		if (!SDL_IsGameController(i))
 		{
-			continue;
+			std::lock_guard guard(_lock);
+			if (!_hasPending)
+			{
+				_pending.numImuSamples = 0;
+				_pending.reportTime = reportTime;
+				_hasPending = true;
+			}
+			_pending.postTime = std::chrono::steady_clock::now();
+			_pending.state = _device->_state;
+			_pending.imu = _device->_imu;
+			_pending.touch = _device->_touch;
+			for (int i = 0; i < _device->_numImuSamples; ++i)
+			{
+				if (_pending.numImuSamples < JSL_MAX_IMU_SAMPLES)
+				{
+					_pending.imuSamples[_pending.numImuSamples++] = _device->_imuSamples[i];
+				}
+				else
+				{
+					// Fold what doesn't fit into the last sample rather than losing its time
+					IMU_SAMPLE &last = _pending.imuSamples[JSL_MAX_IMU_SAMPLES - 1];
+					last.imu = _device->_imuSamples[i].imu;
+					last.deltaTime += _device->_imuSamples[i].deltaTime;
+				}
+			}
+			_device->_numImuSamples = 0;
 		}
-		device->_sdlController = SDL_GameControllerOpen(i);
+		_wake.notify_one();
+	}
 
-		if (SDL_GameControllerHasSensor(device->_sdlController, SDL_SENSOR_GYRO))
+	// Returns once the callback in progress, if any, is over
+	void Stop()
+	{
 		{
-			device->has_gyro = true;
-			SDL_GameControllerSetSensorEnabled(device->_sdlController, SDL_SENSOR_GYRO, SDL_TRUE);
+			std::lock_guard guard(_lock);
+			_running = false;
 		}
-
-		if (SDL_GameControllerHasSensor(device->_sdlController, SDL_SENSOR_ACCEL))
+		_wake.notify_one();
+		if (_thread.joinable())
 		{
-			device->has_accel = true;
-			SDL_GameControllerSetSensorEnabled(device->_sdlController, SDL_SENSOR_ACCEL, SDL_TRUE);
+			_thread.join();
 		}
+	}
 
-		int vid = SDL_GameControllerGetVendor(device->_sdlController);
-		int pid = SDL_GameControllerGetProduct(device->_sdlController);
-		if (vid == 0x057e)
+private:
+	void Run()
+	{
+		_callbackHandle = _handle;
+		_callbackDevice = _device;
+		JOY_SHOCK_STATE lastState = {};
+		IMU_STATE lastImu = {};
+		auto lastCallback = std::chrono::steady_clock::now();
+		int priority = 0;
+		std::unique_lock lock(_lock);
+		while (true)
 		{
-			if (pid == 0x2006)
+			_wake.wait(lock, [this] { return _hasPending || !_running; });
+			if (!_running)
 			{
-				device->split_type = JS_SPLIT_TYPE_LEFT;
+				return;
 			}
-			else if (pid == 0x2007)
+			std::swap(_device->_report, _pending);
+			_hasPending = false;
+			lock.unlock();
+
+			auto now = std::chrono::steady_clock::now();
+			std::chrono::duration<float, std::milli> sinceLastCallback = now - lastCallback;
+			lastCallback = now;
+			JslReport &report = _device->_report;
+			report.startTime = now;
 			{
-				device->split_type = JS_SPLIT_TYPE_RIGHT;
+				std::lock_guard guard(_device->_publishedLock);
+				JslReport &published = _device->_published;
+				published.state = report.state;
+				published.imu = report.imu;
+				published.touch = report.touch;
+				published.reportTime = report.reportTime;
+				published.postTime = report.postTime;
+				published.startTime = report.startTime;
 			}
+			if (input_thread_priority.get() != priority)
+			{
+				priority = input_thread_priority.get();
+				std::string applied;
+				if (!prioritizeThread(priority, applied))
+				{
+					CERR << "Controller " << _handle << " is processed with " << applied << endl;
+				}
+			}
+			g_callback(_handle, report.state, lastState, report.imu, lastImu, sinceLastCallback.count());
+			lastState = report.state;
+			lastImu = report.imu;
+
+			lock.lock();
 		}
-		int handle = i + 1;
-		deviceHandleArray[i] = handle;
-		_controllerMap[handle] = device;
 	}
-	return _controllerMap.size();
-}
 
-void JslDisconnectAndDisposeAll()
+	int _handle;
+	JslDevice *_device;
+	std::mutex _lock;
+	std::condition_variable _wake;
+	JslReport _pending;
+	bool _hasPending = false;
+	bool _running = true;
+	std::thread _thread;
+};
+
+// The connected devices. Connecting controllers publishes a new map rather than changing this one, so that the polling
+// and processing threads read it without locking. A map is deleted, closing its devices, once the last of them let go.
+struct ControllerMap
 {
-	keep_polling = false;
-	controller_lock.lock();
-	auto iter = _controllerMap.begin();
-	while (iter != _controllerMap.end())
+	~ControllerMap()
 	{
-		delete iter->second;
-		iter = _controllerMap.erase(iter);
+		workers.clear();
+		for (auto &pair : devices)
+		{
+			delete pair.second;
+		}
 	}
-	controller_lock.unlock();
-	SDL_Delay(200);
 
-	SDL_Quit();
+	std::map<int, JslDevice *> devices;
+	std::map<int, std::unique_ptr<DeviceWorker>> workers;
+};
+
+static std::shared_ptr<const ControllerMap> _controllers = std::make_shared<ControllerMap>();
+
+static std::shared_ptr<const ControllerMap> controllers()
+{
+	return std::atomic_load(&_controllers);
 }
 
-JOY_SHOCK_STATE JslGetSimpleState(int deviceId)
+// Swap the published map, and wait for callbacks on the old devices to be over
+static void publish(std::shared_ptr<const ControllerMap> next)
 {
-	return JOY_SHOCK_STATE();
+	auto previous = std::atomic_exchange(&_controllers, std::shared_ptr<const ControllerMap>(std::move(next)));
+	for (auto &pair : previous->workers)
+	{
+		pair.second->Stop();
+	}
 }
 
-IMU_STATE JslGetIMUState(int deviceId)
+void JslDevice::queueImuSample(float deltaTime)
 {
-	IMU_STATE imuState;
-	memset(&imuState, 0, sizeof(imuState));
-	if (_controllerMap[deviceId]->has_gyro)
+	if (_numImuSamples < JSL_MAX_IMU_SAMPLES)
 	{
-		array<float, 3> gyro;
-		SDL_GameControllerGetSensorData(_controllerMap[deviceId]->_sdlController, SDL_SENSOR_GYRO, &gyro[0], 3);
-		constexpr float toDegPerSec = 180.f / M_PI;
-		imuState.gyroX = gyro[0] * toDegPerSec;
-		imuState.gyroY = gyro[1] * toDegPerSec;
-		imuState.gyroZ = gyro[2] * toDegPerSec;
+		_imuSamples[_numImuSamples++] = { _imu, deltaTime };
 	}
-	if (_controllerMap[deviceId]->has_accel)
+	else
 	{
-		array<float, 3> accel;
-		SDL_GameControllerGetSensorData(_controllerMap[deviceId]->_sdlController, SDL_SENSOR_ACCEL, &accel[0], 3);
-		constexpr float toGs = 1.f / 9.8f;
-		imuState.accelX = accel[0] * toGs;
-		imuState.accelY = accel[1] * toGs;
-		imuState.accelZ = accel[2] * toGs;
+		// The callback is late: fold the newest reading into the last sample rather than losing its time
+		IMU_SAMPLE &last = _imuSamples[JSL_MAX_IMU_SAMPLES - 1];
+		last.imu = _imu;
+		last.deltaTime += deltaTime;
 	}
-	return imuState;
 }
 
-MOTION_STATE JslGetMotionState(int deviceId)
+void JslDevice::markFreshReport(std::chrono::steady_clock::time_point reportTime)
 {
-	return MOTION_STATE();
+	if (!_hasFreshReport)
+	{
+		_hasFreshReport = true;
+		_reportTime = reportTime;
+	}
 }
 
-TOUCH_STATE JslGetTouchState(int deviceId)
+struct ControllerDevice : public JslDevice
 {
-	return TOUCH_STATE();
-}
+	// The last thread to let go of a device's map closes it, so this has to wait for the polling thread
+	~ControllerDevice()
+	{
+		std::lock_guard guard(_backendLock);
+		SDL_GameControllerClose(_sdlController);
+	}
 
-int JslGetButtons(int deviceId)
+	int GetControllerType() override
+	{
+		return SDL_GameControllerGetType(_sdlController);
+	}
+
+	void SetLightColour(int colour) override
+	{
+		std::lock_guard guard(_backendLock);
+		union
+		{
+			uint32_t raw;
+			uint8_t argb[4];
+		} uColour;
+		uColour.raw = colour;
+		SDL_GameControllerSetLED(_sdlController, uColour.argb[2], uColour.argb[1], uColour.argb[0]);
+	}
+
+	void SetRumble(int smallRumble, int bigRumble) override
+	{
+		std::lock_guard guard(_backendLock);
+		SDL_GameControllerRumble(_sdlController, smallRumble << 8, bigRumble << 8, tick_time.get() + 1);
+	}
+
+	void SetPlayerNumber(int number) override
+	{
+		std::lock_guard guard(_backendLock);
+		SDL_GameControllerSetPlayerIndex(_sdlController, number);
+	}
+
+	bool has_gyro = false;
+	bool has_accel = false;
+	SDL_GameController *_sdlController = nullptr;
+	SDL_JoystickID _instanceId = -1;
+
+	void queueGyroSample(const SDL_ControllerSensorEvent &event);
+	uint64_t _lastSensorTimestamp = 0;
+
+	// Copy of the device's inputs, taken once per poll cycle
+	void snapshot();
+};
+
+void ControllerDevice::snapshot()
 {
 	static const std::map<int, int> sdl2jsl = {
 		{ SDL_CONTROLLER_BUTTON_A, JSOFFSET_S },
@@ -192,85 +401,536 @@ int JslGetButtons(int deviceId)
 	int buttons = 0;
 	for (auto pair : sdl2jsl)
 	{
-		buttons |= SDL_GameControllerGetButton(_controllerMap[deviceId]->_sdlController, SDL_GameControllerButton(pair.first)) > 0 ? 1 << pair.second : 0;
+		buttons |= SDL_GameControllerGetButton(_sdlController, SDL_GameControllerButton(pair.first)) > 0 ? 1 << pair.second : 0;
 	}
-	switch (_controllerMap[deviceId]->split_type)
+	switch (GetControllerType())
 	{
 	case SDL_CONTROLLER_TYPE_PS4:
 	case SDL_CONTROLLER_TYPE_PS5:
-		buttons |= SDL_GameControllerGetButton(_controllerMap[deviceId]->_sdlController, SDL_CONTROLLER_BUTTON_TOUCHPAD) > 0 ? 1 << JSOFFSET_CAPTURE : 0;
+		buttons |= SDL_GameControllerGetButton(_sdlController, SDL_CONTROLLER_BUTTON_TOUCHPAD) > 0 ? 1 << JSOFFSET_CAPTURE : 0;
 		break;
 	default:
-		buttons |= SDL_GameControllerGetButton(_controllerMap[deviceId]->_sdlController, SDL_CONTROLLER_BUTTON_MISC1) > 0 ? 1 << JSOFFSET_CAPTURE : 0;
+		buttons |= SDL_GameControllerGetButton(_sdlController, SDL_CONTROLLER_BUTTON_MISC1) > 0 ? 1 << JSOFFSET_CAPTURE : 0;
+		break;
+	}
+	_state.buttons = buttons;
+
+	constexpr float toAxis = 1.f / SDL_JOYSTICK_AXIS_MAX;
+	_state.stickLX = SDL_GameControllerGetAxis(_sdlController, SDL_CONTROLLER_AXIS_LEFTX) * toAxis;
+	_state.stickLY = SDL_GameControllerGetAxis(_sdlController, SDL_CONTROLLER_AXIS_LEFTY) * toAxis;
+	_state.stickRX = SDL_GameControllerGetAxis(_sdlController, SDL_CONTROLLER_AXIS_RIGHTX) * toAxis;
+	_state.stickRY = SDL_GameControllerGetAxis(_sdlController, SDL_CONTROLLER_AXIS_RIGHTY) * toAxis;
+	_state.lTrigger = SDL_GameControllerGetAxis(_sdlController, SDL_CONTROLLER_AXIS_TRIGGERLEFT) * toAxis;
+	_state.rTrigger = SDL_GameControllerGetAxis(_sdlController, SDL_CONTROLLER_AXIS_TRIGGERRIGHT) * toAxis;
+
+	if (has_gyro)
+	{
+		array<float, 3> gyro;
+		SDL_GameControllerGetSensorData(_sdlController, SDL_SENSOR_GYRO, &gyro[0], 3);
+		constexpr float toDegPerSec = 180.f / M_PI;
+		_imu.gyroX = gyro[0] * toDegPerSec;
+		_imu.gyroY = gyro[1] * toDegPerSec;
+		_imu.gyroZ = gyro[2] * toDegPerSec;
+	}
+	if (has_accel)
+	{
+		array<float, 3> accel;
+		SDL_GameControllerGetSensorData(_sdlController, SDL_SENSOR_ACCEL, &accel[0], 3);
+		constexpr float toGs = 1.f / 9.8f;
+		_imu.accelX = accel[0] * toGs;
+		_imu.accelY = accel[1] * toGs;
+		_imu.accelZ = accel[2] * toGs;
+	}
+
+	uint8_t touchState = 0;
+	_touch.t0Down = SDL_GameControllerGetTouchpadFinger(_sdlController, 0, 0, &touchState, &_touch.t0X, &_touch.t0Y, nullptr) == 0 && touchState != 0;
+	_touch.t1Down = SDL_GameControllerGetTouchpadFinger(_sdlController, 0, 1, &touchState, &_touch.t1X, &_touch.t1Y, nullptr) == 0 && touchState != 0;
+}
+
+void ControllerDevice::queueGyroSample(const SDL_ControllerSensorEvent &event)
+{
+	constexpr float toDegPerSec = 180.f / M_PI;
+	_imu.gyroX = event.data[0] * toDegPerSec;
+	_imu.gyroY = event.data[1] * toDegPerSec;
+	_imu.gyroZ = event.data[2] * toDegPerSec;
+
+	// Use the sensor's own timestamps when the driver provides them, otherwise assume its nominal rate
+	float deltaTime;
+	if (event.timestamp_us != 0 && _lastSensorTimestamp != 0 && event.timestamp_us > _lastSensorTimestamp)
+	{
+		deltaTime = (event.timestamp_us - _lastSensorTimestamp) / 1000000.f;
+	}
+	else
+	{
+		float rate = SDL_GameControllerGetSensorDataRate(_sdlController, SDL_SENSOR_GYRO);
+		deltaTime = rate > 0.f ? 1.f / rate : tick_time.get() / 1000.f;
+	}
+	_lastSensorTimestamp = event.timestamp_us;
+	queueImuSample(deltaTime);
+}
+
+// Flag the device that emitted an input event so that it gets dispatched this cycle.
+// Sensor readings are also queued here, since SDL only keeps the latest one.
+static void handleEvent(const SDL_Event &event, const std::map<int, JslDevice *> &devices)
+{
+	SDL_JoystickID which;
+	switch (event.type)
+	{
+	case SDL_CONTROLLERAXISMOTION:
+		which = event.caxis.which;
+		break;
+	case SDL_CONTROLLERBUTTONDOWN:
+	case SDL_CONTROLLERBUTTONUP:
+		which = event.cbutton.which;
+		break;
+	case SDL_CONTROLLERTOUCHPADDOWN:
+	case SDL_CONTROLLERTOUCHPADMOTION:
+	case SDL_CONTROLLERTOUCHPADUP:
+		which = event.ctouchpad.which;
+		break;
+	case SDL_CONTROLLERSENSORUPDATE:
+		which = event.csensor.which;
 		break;
+	default:
+		return;
+	}
+	for (auto &pair : devices)
+	{
+		ControllerDevice *device = static_cast<ControllerDevice *>(pair.second);
+		if (device->_instanceId == which)
+		{
+			device->markFreshReport(std::chrono::steady_clock::now());
+			if (event.type == SDL_CONTROLLERSENSORUPDATE)
+			{
+				if (event.csensor.sensor == SDL_SENSOR_GYRO)
+				{
+					device->queueGyroSample(event.csensor);
+				}
+				else if (event.csensor.sensor == SDL_SENSOR_ACCEL)
+				{
+					// Paired with the next gyro reading
+					constexpr float toGs = 1.f / 9.8f;
+					device->_imu.accelX = event.csensor.data[0] * toGs;
+					device->_imu.accelY = event.csensor.data[1] * toGs;
+					device->_imu.accelZ = event.csensor.data[2] * toGs;
+				}
+			}
+			return;
+		}
+	}
+}
+
+class SdlBackend : public JslBackend
+{
+public:
+	void Init() override
+	{
+		SDL_SetHint(SDL_HINT_GAMECONTROLLER_USE_BUTTON_LABELS, "0");
+		SDL_SetHint(SDL_HINT_JOYSTICK_ALLOW_BACKGROUND_EVENTS, "1");
+		SDL_SetHint(SDL_HINT_JOYSTICK_HIDAPI_JOY_CONS, "1");
+		SDL_SetHint(SDL_HINT_JOYSTICK_HIDAPI_SWITCH_HOME_LED, "0");
+		SDL_SetHint(SDL_HINT_JOYSTICK_HIDAPI_PS4_RUMBLE, "1");
+		SDL_SetHint(SDL_HINT_JOYSTICK_HIDAPI_PS5_RUMBLE, "1");
+		SDL_SetHint(SDL_HINT_JOYSTICK_THREAD, "1");
+		SDL_Init(SDL_INIT_GAMECONTROLLER);
+	}
+
+	int CountDevices() override
+	{
+		return SDL_NumJoysticks();
+	}
+
+	JslDevice *Open(int index) override
+	{
+		if (!SDL_IsGameController(index))
+		{
+			return nullptr;
+		}
+		ControllerDevice *device = new ControllerDevice();
+		device->_sdlController = SDL_GameControllerOpen(index);
+		device->_instanceId = SDL_JoystickInstanceID(SDL_GameControllerGetJoystick(device->_sdlController));
+
+		if (SDL_GameControllerHasSensor(device->_sdlController, SDL_SENSOR_GYRO))
+		{
+			device->has_gyro = true;
+			SDL_GameControllerSetSensorEnabled(device->_sdlController, SDL_SENSOR_GYRO, SDL_TRUE);
+		}
+
+		if (SDL_GameControllerHasSensor(device->_sdlController, SDL_SENSOR_ACCEL))
+		{
+			device->has_accel = true;
+			SDL_GameControllerSetSensorEnabled(device->_sdlController, SDL_SENSOR_ACCEL, SDL_TRUE);
+		}
+
+		int vid = SDL_GameControllerGetVendor(device->_sdlController);
+		int pid = SDL_GameControllerGetProduct(device->_sdlController);
+		if (vid == 0x057e)
+		{
+			if (pid == 0x2006)
+			{
+				device->split_type = JS_SPLIT_TYPE_LEFT;
+			}
+			else if (pid == 0x2007)
+			{
+				device->split_type = JS_SPLIT_TYPE_RIGHT;
+			}
+		}
+		return device;
+	}
+
+	// Sleep until a controller sends a report rather than for a whole tick. Ticks are only a fallback
+	// so that time based bindings keep running on idle controllers. SDL waits in whole milliseconds,
+	// so it stops waiting on the last one before the deadline and the rest is slept precisely.
+	bool Wait(std::chrono::steady_clock::time_point deadline) override
+	{
+		auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+		_hasEvent = timeout.count() > 0 ? SDL_WaitEventTimeout(&_event, int(timeout.count())) == 1 : SDL_PollEvent(&_event) == 1;
+		return _hasEvent;
+	}
+
+	void Update(const std::map<int, JslDevice *> &devices) override
+	{
+		// Drain everything that arrived meanwhile so that a burst of reports results in a single callback
+		while (_hasEvent)
+		{
+			handleEvent(_event, devices);
+			_hasEvent = SDL_PollEvent(&_event) == 1;
+		}
+
+		// Pump SDL once for all controllers, so that every device is read at the same instant
+		SDL_GameControllerUpdate();
+		for (auto &pair : devices)
+		{
+			static_cast<ControllerDevice *>(pair.second)->snapshot();
+		}
+	}
+
+	void Shutdown() override
+	{
+		SDL_Quit();
+	}
+
+private:
+	SDL_Event _event;
+	bool _hasEvent = false;
+};
+
+static JslBackend &backend()
+{
+	if (!_backend)
+	{
+		_backend.reset(createSyntheticBackendFromEnvironment());
+		if (!_backend)
+		{
+			_backend.reset(new SdlBackend());
+		}
 	}
-	return buttons;
+	return *_backend;
+}
+
+void JslSetBackend(JslBackend *backend)
+{
+	_backend.reset(backend);
+}
+
+static int pollDevices()
+{
+	// Thread settings are applied by the polling thread itself, in between two updates
+	int priority = 0;
+	int cpu = -1;
+	Switch locked = Switch::OFF;
+	while (keep_polling)
+	{
+		if (input_thread_priority.get() != priority)
+		{
+			priority = input_thread_priority.get();
+			std::string applied;
+			if (prioritizeThread(priority, applied))
+			{
+				COUT << "Input threads now run with " << applied << endl;
+			}
+			else
+			{
+				CERR << "Input threads now run with " << applied << endl;
+			}
+		}
+		if (input_thread_cpu.get() != cpu)
+		{
+			cpu = input_thread_cpu.get();
+#ifdef _WIN32
+			bool pinned = pinThread(GetCurrentThread(), cpu);
+#else
+			bool pinned = pinThread(pthread_self(), cpu);
+#endif
+			if (!pinned)
+			{
+				CERR << "The input thread can't be pinned to CPU " << cpu << ": it isn't available to JoyShockMapper" << endl;
+			}
+		}
+		if (lock_memory.get() != locked)
+		{
+			locked = lock_memory.get();
+			if (!lockMemory(locked == Switch::ON))
+			{
+				CERR << "Memory can't be " << (locked == Switch::ON ? "locked: it isn't supported or permitted" : "unlocked") << endl;
+			}
+		}
+
+		using milliseconds = std::chrono::duration<float, std::milli>;
+		_scheduler.SetPeriod(std::chrono::duration_cast<TickScheduler::clock::duration>(milliseconds(tick_time.get())));
+		_scheduler.SetSpin(std::chrono::duration_cast<TickScheduler::clock::duration>(milliseconds(tick_spin_time.get())));
+		// Waiting only reads SDL's event queue, so devices can be opened and given output meanwhile
+		bool hasEvent = backend().Wait(_scheduler.Deadline());
+		if (!hasEvent)
+		{
+			_scheduler.SleepUntilDeadline();
+		}
+
+		// Devices disconnected meanwhile stay open until this is over
+		auto current = controllers();
+		auto updateStart = std::chrono::steady_clock::now();
+		{
+			std::lock_guard guard(_backendLock);
+			backend().Update(current->devices);
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		_updateDuration = std::chrono::duration<float>(now - updateStart).count();
+		// On a tick, controllers that weren't processed for a whole period are processed without a report
+		auto tick = _scheduler.Deadline();
+		bool isTick = now >= tick;
+		if (isTick)
+		{
+			_scheduler.Advance(now);
+		}
+		for (auto &pair : current->workers)
+		{
+			JslDevice *device = current->devices.at(pair.first);
+			if (!device->_hasFreshReport && !(isTick && device->_lastCallback <= tick - _scheduler.Period()))
+			{
+				continue;
+			}
+			pair.second->Post(device->_hasFreshReport ? device->_reportTime : now);
+			// Idle controllers stay on the tick grid however late the thread woke up
+			device->_lastCallback = device->_hasFreshReport ? now : tick;
+			device->_hasFreshReport = false;
+		}
+	}
+
+	return 1;
+}
+
+// A device found by its handle. It keeps the map it was found in, so that it stays open while it is used.
+struct DeviceRef
+{
+	std::shared_ptr<const ControllerMap> map; // Not needed by the device's own worker, which the map outlives
+	JslDevice *device;
+
+	JslDevice *operator->() const
+	{
+		return device;
+	}
+};
+
+// Unknown handles behave like an idle controller that ignores output, as they do in JoyShockLibrary.
+// Called from the device's own callback, this doesn't touch the map, so that workers don't contend on it.
+static DeviceRef findDevice(int deviceId)
+{
+	static JslDevice noDevice;
+	if (_callbackDevice && deviceId == _callbackHandle)
+	{
+		return { nullptr, _callbackDevice };
+	}
+	auto current = controllers();
+	auto iter = current->devices.find(deviceId);
+	JslDevice *device = iter != current->devices.end() ? iter->second : &noDevice;
+	return { std::move(current), device };
+}
+
+// Read the last report of a device. Its own callback reads the report it is processing, and other threads
+// the copy published when that callback started.
+template<typename Read>
+static auto readReport(int deviceId, Read read)
+{
+	auto device = findDevice(deviceId);
+	if (device.device == _callbackDevice)
+	{
+		return read(device->_report);
+	}
+	std::lock_guard guard(device->_publishedLock);
+	return read(device->_published);
+}
+int JslConnectDevices()
+{
+	return backend().CountDevices();
+}
+
+int JslGetConnectedDeviceHandles(int *deviceHandleArray, int size)
+{
+	// Devices are opened anew, so the previous ones have to be closed first
+	publish(std::make_shared<ControllerMap>());
+	auto next = std::make_shared<ControllerMap>();
+	int count = 0;
+	int firstCpu = processing_cpu.get();
+	int numCpus = std::max(1, int(std::thread::hardware_concurrency()));
+	std::unique_lock guard(_backendLock);
+	for (int i = 0; i < size; i++)
+	{
+		JslDevice *device = backend().Open(i);
+		if (device == nullptr)
+		{
+			continue;
+		}
+		int handle = i + 1;
+		next->devices[handle] = device;
+		next->workers[handle].reset(new DeviceWorker(handle, device, firstCpu < 0 ? -1 : (firstCpu + count) % numCpus));
+		deviceHandleArray[count++] = handle;
+	}
+	guard.unlock();
+	publish(next);
+	return count;
+}
+
+void JslDisconnectAndDisposeAll()
+{
+	keep_polling = false;
+	if (_pollThread.joinable())
+	{
+		_pollThread.join();
+	}
+	// Joins the device threads, after which nothing else holds the devices and they are closed right away
+	publish(std::make_shared<ControllerMap>());
+	backend().Shutdown();
+}
+
+JOY_SHOCK_STATE JslGetSimpleState(int deviceId)
+{
+	return readReport(deviceId, [](const JslReport &report) { return report.state; });
+}
+
+IMU_STATE JslGetIMUState(int deviceId)
+{
+	return readReport(deviceId, [](const JslReport &report) { return report.imu; });
+}
+
+int JslGetIMUSamples(int deviceId, IMU_SAMPLE *samples, int maxSamples)
+{
+	// Only the device's own callback drains its samples
+	auto device = findDevice(deviceId);
+	if (device.device != _callbackDevice)
+	{
+		return 0;
+	}
+	int count = std::min(device->_report.numImuSamples, maxSamples);
+	std::copy_n(device->_report.imuSamples.begin(), count, samples);
+	device->_report.numImuSamples = 0;
+	return count;
+}
+
+float JslGetUpdateDuration()
+{
+	return _updateDuration;
+}
+
+float JslGetDispatchDelay(int deviceId)
+{
+	return readReport(deviceId, [](const JslReport &report) { return std::chrono::duration<float>(report.startTime - report.postTime).count(); });
+}
+
+float JslGetTickPeriod()
+{
+	return _scheduler.MeasuredPeriod();
+}
+
+int JslGetTickOverruns()
+{
+	return int(_scheduler.Overruns());
+}
+
+void JslResetTickStats()
+{
+	_scheduler.ResetStats();
+}
+
+float JslGetReportAge(int deviceId)
+{
+	auto reportTime = readReport(deviceId, [](const JslReport &report) { return report.reportTime; });
+	return std::chrono::duration<float>(std::chrono::steady_clock::now() - reportTime).count();
+}
+
+MOTION_STATE JslGetMotionState(int deviceId)
+{
+	return MOTION_STATE();
+}
+
+TOUCH_STATE JslGetTouchState(int deviceId)
+{
+	return readReport(deviceId, [](const JslReport &report) { return report.touch; });
+}
+
+int JslGetButtons(int deviceId)
+{
+	return readReport(deviceId, [](const JslReport &report) { return report.state.buttons; });
 }
 
 float JslGetLeftX(int deviceId)
 {
-	return SDL_GameControllerGetAxis(_controllerMap[deviceId]->_sdlController, SDL_CONTROLLER_AXIS_LEFTX) / (float)SDL_JOYSTICK_AXIS_MAX;
+	return readReport(deviceId, [](const JslReport &report) { return report.state.stickLX; });
 }
 
 float JslGetLeftY(int deviceId)
 {
-	return SDL_GameControllerGetAxis(_controllerMap[deviceId]->_sdlController, SDL_CONTROLLER_AXIS_LEFTY) / (float)SDL_JOYSTICK_AXIS_MAX;
-	;
+	return readReport(deviceId, [](const JslReport &report) { return report.state.stickLY; });
 }
 
 float JslGetRightX(int deviceId)
 {
-	return SDL_GameControllerGetAxis(_controllerMap[deviceId]->_sdlController, SDL_CONTROLLER_AXIS_RIGHTX) / (float)SDL_JOYSTICK_AXIS_MAX;
+	return readReport(deviceId, [](const JslReport &report) { return report.state.stickRX; });
 }
 
 float JslGetRightY(int deviceId)
 {
-	return SDL_GameControllerGetAxis(_controllerMap[deviceId]->_sdlController, SDL_CONTROLLER_AXIS_RIGHTY) / (float)SDL_JOYSTICK_AXIS_MAX;
+	return readReport(deviceId, [](const JslReport &report) { return report.state.stickRY; });
 }
 
 float JslGetLeftTrigger(int deviceId)
 {
-	return SDL_GameControllerGetAxis(_controllerMap[deviceId]->_sdlController, SDL_CONTROLLER_AXIS_TRIGGERLEFT) / (float)SDL_JOYSTICK_AXIS_MAX;
+	return readReport(deviceId, [](const JslReport &report) { return report.state.lTrigger; });
 }
 
 float JslGetRightTrigger(int deviceId)
 {
-	return SDL_GameControllerGetAxis(_controllerMap[deviceId]->_sdlController, SDL_CONTROLLER_AXIS_TRIGGERRIGHT) / (float)SDL_JOYSTICK_AXIS_MAX;
+	return readReport(deviceId, [](const JslReport &report) { return report.state.rTrigger; });
 }
 
 float JslGetGyroX(int deviceId)
 {
-	if (_controllerMap[deviceId]->has_gyro)
-	{
-		float rawGyro[3];
-		SDL_GameControllerGetSensorData(_controllerMap[deviceId]->_sdlController, SDL_SENSOR_GYRO, rawGyro, 3);
-	}
-	return float();
+	return readReport(deviceId, [](const JslReport &report) { return report.imu.gyroX; });
 }
 
 float JslGetGyroY(int deviceId)
 {
-	return float();
+	return readReport(deviceId, [](const JslReport &report) { return report.imu.gyroY; });
 }
 
 float JslGetGyroZ(int deviceId)
 {
-	return float();
+	return readReport(deviceId, [](const JslReport &report) { return report.imu.gyroZ; });
 }
 
 float JslGetAccelX(int deviceId)
 {
-	return float();
+	return readReport(deviceId, [](const JslReport &report) { return report.imu.accelX; });
 }
 
 float JslGetAccelY(int deviceId)
 {
-	return float();
+	return readReport(deviceId, [](const JslReport &report) { return report.imu.accelY; });
 }
 
 float JslGetAccelZ(int deviceId)
 {
-	return float();
+	return readReport(deviceId, [](const JslReport &report) { return report.imu.accelZ; });
 }
 
 int JslGetTouchId(int deviceId, bool secondTouch)
@@ -280,32 +940,20 @@ int JslGetTouchId(int deviceId, bool secondTouch)
 
 bool JslGetTouchDown(int deviceId, bool secondTouch)
 {
-	uint8_t touchState = 0;
-	if (SDL_GameControllerGetTouchpadFinger(_controllerMap[deviceId]->_sdlController, 0, secondTouch ? 1 : 0, &touchState, nullptr, nullptr, nullptr) == 0)
-	{
-		return touchState != 0;
-	}
-	return false;
+	auto touch = readReport(deviceId, [](const JslReport &report) { return report.touch; });
+	return secondTouch ? touch.t1Down : touch.t0Down;
 }
 
 float JslGetTouchX(int deviceId, bool secondTouch)
 {
-	float x = 0;
-	if (SDL_GameControllerGetTouchpadFinger(_controllerMap[deviceId]->_sdlController, 0, secondTouch ? 1 : 0, nullptr, nullptr, &x, nullptr) == 0)
-	{
-		return x;
-	}
-	return x;
+	auto touch = readReport(deviceId, [](const JslReport &report) { return report.touch; });
+	return secondTouch ? touch.t1X : touch.t0X;
 }
 
 float JslGetTouchY(int deviceId, bool secondTouch)
 {
-	float y = 0;
-	if (SDL_GameControllerGetTouchpadFinger(_controllerMap[deviceId]->_sdlController, 0, secondTouch ? 1 : 0, nullptr, nullptr, &y, nullptr) == 0)
-	{
-		return y;
-	}
-	return y;
+	auto touch = readReport(deviceId, [](const JslReport &report) { return report.touch; });
+	return secondTouch ? touch.t1Y : touch.t0Y;
 }
 
 float JslGetStickStep(int deviceId)
@@ -350,17 +998,9 @@ void JslSetCalibrationOffset(int deviceId, float xOffset, float yOffset, float z
 
 void JslSetCallback(void (*callback)(int, JOY_SHOCK_STATE, JOY_SHOCK_STATE, IMU_STATE, IMU_STATE, float))
 {
-	SDL_SetHint(SDL_HINT_GAMECONTROLLER_USE_BUTTON_LABELS, "0");
-	SDL_SetHint(SDL_HINT_JOYSTICK_ALLOW_BACKGROUND_EVENTS, "1");
-	SDL_SetHint(SDL_HINT_JOYSTICK_HIDAPI_JOY_CONS, "1");
-	SDL_SetHint(SDL_HINT_JOYSTICK_HIDAPI_SWITCH_HOME_LED, "0");
-	SDL_SetHint(SDL_HINT_JOYSTICK_HIDAPI_PS4_RUMBLE, "1");
-	SDL_SetHint(SDL_HINT_JOYSTICK_HIDAPI_PS5_RUMBLE, "1");
-	SDL_SetHint(SDL_HINT_JOYSTICK_THREAD, "1");
-	SDL_Init(SDL_INIT_GAMECONTROLLER);
+	backend().Init();
 	g_callback = callback;
-	SDL_Thread *controllerThread = SDL_CreateThread(pollDevices, "Poll Devices", nullptr);
-	SDL_DetachThread(controllerThread);
+	_pollThread = std::thread(&pollDevices);
 }
 
 void JslSetTouchCallback(void (*callback)(int, TOUCH_STATE, TOUCH_STATE, float))
@@ -370,12 +1010,12 @@ void JslSetTouchCallback(void (*callback)(int, TOUCH_STATE, TOUCH_STATE, float))
 
 int JslGetControllerType(int deviceId)
 {
-	return SDL_GameControllerGetType(_controllerMap[deviceId]->_sdlController);
+	return findDevice(deviceId)->GetControllerType();
 }
 
 int JslGetControllerSplitType(int deviceId)
 {
-	return _controllerMap[deviceId]->split_type;
+	return findDevice(deviceId)->split_type;
 }
 
 int JslGetControllerColour(int deviceId)
@@ -385,21 +1025,15 @@ int JslGetControllerColour(int deviceId)
 
 void JslSetLightColour(int deviceId, int colour)
 {
-	union
-	{
-		uint32_t raw;
-		uint8_t argb[4];
-	} uColour;
-	uColour.raw = colour;
-	SDL_GameControllerSetLED(_controllerMap[deviceId]->_sdlController, uColour.argb[2], uColour.argb[1], uColour.argb[0]);
+	findDevice(deviceId)->SetLightColour(colour);
 }
 
 void JslSetRumble(int deviceId, int smallRumble, int bigRumble)
 {
-	SDL_GameControllerRumble(_controllerMap[deviceId]->_sdlController, smallRumble << 8, bigRumble << 8, tick_time.get() + 1);
+	findDevice(deviceId)->SetRumble(smallRumble, bigRumble);
 }
 
 void JslSetPlayerNumber(int deviceId, int number)
 {
-	SDL_GameControllerSetPlayerIndex(_controllerMap[deviceId]->_sdlController, number);
+	findDevice(deviceId)->SetPlayerNumber(number);
 }
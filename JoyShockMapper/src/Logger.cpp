@@ -0,0 +1,249 @@
+#include "Logger.h"
+#include "PlatformDefinitions.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+std::atomic<LogLevel> logLevels[int(LogCategory::INVALID)] = {
+	LogLevel::ON, // BUTTONS
+	LogLevel::ON, // FLICK
+	LogLevel::ON, // RUMBLE
+	LogLevel::ON, // VIGEM
+};
+
+namespace
+{
+// Bounded multiple producer, single consumer queue. Each slot carries a sequence number telling
+// whether it is free for the producer that claimed it or ready for the consumer.
+// See http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+class LogQueue
+{
+public:
+	static constexpr size_t CAPACITY = 8192; // Must be a power of 2
+
+	LogQueue()
+	{
+		for (size_t i = 0; i < CAPACITY; ++i)
+		{
+			_slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	// Text is either a string to move in, or a string_view to copy into the memory the slot already has
+	template<typename Text>
+	bool Push(std::ostream *stdio, uint16_t color, Text &&text)
+	{
+		size_t position = _enqueuePos.load(std::memory_order_relaxed);
+		Slot *slot;
+		while (true)
+		{
+			slot = &_slots[position & (CAPACITY - 1)];
+			size_t sequence = slot->sequence.load(std::memory_order_acquire);
+			intptr_t diff = intptr_t(sequence) - intptr_t(position);
+			if (diff == 0)
+			{
+				if (_enqueuePos.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+			{
+				return false; // full
+			}
+			else
+			{
+				position = _enqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+		slot->stdio = stdio;
+		slot->color = color;
+		slot->text = std::forward<Text>(text);
+		slot->sequence.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Only the printing thread may call this
+	template<typename Visitor>
+	bool Pop(Visitor visit)
+	{
+		Slot &slot = _slots[_dequeuePos & (CAPACITY - 1)];
+		if (slot.sequence.load(std::memory_order_acquire) != _dequeuePos + 1)
+		{
+			return false; // empty, or the producer hasn't finished writing it
+		}
+		visit(slot.stdio, slot.color, slot.text);
+		slot.text.clear();
+		slot.sequence.store(_dequeuePos + CAPACITY, std::memory_order_release);
+		++_dequeuePos;
+		return true;
+	}
+
+private:
+	struct Slot
+	{
+		std::atomic<size_t> sequence;
+		std::ostream *stdio = nullptr;
+		uint16_t color = 0;
+		std::string text;
+	};
+
+	std::array<Slot, CAPACITY> _slots;
+	alignas(64) std::atomic<size_t> _enqueuePos = 0;
+	alignas(64) size_t _dequeuePos = 0;
+};
+
+class Logger
+{
+public:
+	Logger()
+	  : _thread(&Logger::Run, this)
+	{
+	}
+
+	~Logger()
+	{
+		_continue = false;
+		_wakeUp.notify_one();
+		_thread.join();
+	}
+
+	template<typename Text>
+	bool Push(std::ostream *stdio, uint16_t color, Text &&text)
+	{
+		if (!_queue.Push(stdio, color, std::forward<Text>(text)))
+		{
+			_dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		_queued.fetch_add(1, std::memory_order_release);
+		_wakeUp.notify_one();
+		return true;
+	}
+
+	void Flush()
+	{
+		auto target = _queued.load(std::memory_order_acquire);
+		std::unique_lock<std::mutex> lock(_mutex);
+		_printedSome.wait_for(lock, std::chrono::seconds(1), [this, target] { return _printed >= target; });
+	}
+
+private:
+	void Run()
+	{
+		while (_continue)
+		{
+			{
+				// Producers don't take the lock to notify, so a wake up can be missed. The timeout bounds the delay.
+				std::unique_lock<std::mutex> lock(_mutex);
+				_wakeUp.wait_for(lock, std::chrono::milliseconds(10));
+			}
+			Drain();
+		}
+		Drain();
+	}
+
+	void Drain()
+	{
+		size_t count = 0;
+		while (_queue.Pop(&printColored))
+		{
+			++count;
+		}
+		if (auto dropped = _dropped.exchange(0, std::memory_order_relaxed))
+		{
+			printColored(&std::cerr, FOREGROUND_YELLOW | FOREGROUND_INTENSITY, std::to_string(dropped) + " log messages were dropped\n");
+		}
+		if (count > 0)
+		{
+			std::cout.flush();
+			std::lock_guard<std::mutex> guard(_mutex);
+			_printed += count;
+			_printedSome.notify_all();
+		}
+	}
+
+	LogQueue _queue;
+	std::atomic<size_t> _queued = 0;
+	std::atomic<size_t> _dropped = 0;
+	size_t _printed = 0; // guarded by _mutex
+	std::atomic_bool _continue = true;
+	std::mutex _mutex;
+	std::condition_variable _wakeUp;
+	std::condition_variable _printedSome;
+	std::thread _thread;
+};
+
+std::atomic_bool loggerDestroyed = false;
+
+thread_local bool outputMuted = false;
+
+Logger *getLogger()
+{
+	static struct LoggerHolder
+	{
+		Logger logger;
+		~LoggerHolder()
+		{
+			loggerDestroyed = true;
+		}
+	} holder;
+	return &holder.logger;
+}
+} // namespace
+
+void logMessage(std::ostream *stdio, uint16_t color, std::string &&message)
+{
+	if (outputMuted && stdio == &std::cout)
+	{
+		return;
+	}
+	if (loggerDestroyed)
+	{
+		// Static destructors running after the logging thread is gone
+		printColored(stdio, color, message);
+		return;
+	}
+	getLogger()->Push(stdio, color, std::move(message));
+}
+
+void logFormat(const char *format, ...)
+{
+	if (outputMuted)
+	{
+		return;
+	}
+	char buffer[256];
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+	if (length < 0)
+	{
+		return;
+	}
+	std::string_view message(buffer, std::min(size_t(length), sizeof(buffer) - 1));
+	if (loggerDestroyed)
+	{
+		printColored(&std::cout, FOREGROUND_GREEN, std::string(message));
+		return;
+	}
+	getLogger()->Push(&std::cout, FOREGROUND_GREEN, message);
+}
+
+void flushLog()
+{
+	if (!loggerDestroyed)
+	{
+		getLogger()->Flush();
+	}
+}
+
+void muteOutput(bool muted)
+{
+	outputMuted = muted;
+}
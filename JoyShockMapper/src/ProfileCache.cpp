@@ -0,0 +1,298 @@
+#include "ProfileCache.h"
+#include "JSMVariable.hpp"
+#include "Logger.h"
+#include "PlatformDefinitions.h"
+
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <set>
+
+namespace
+{
+// Watches a configuration being loaded to learn what it changes
+class ProfileCompiler : public VariableObserver, public LoadObserver
+{
+public:
+	vector<string> files;
+	bool compilable = true;
+
+	// In a shadow, the configuration changes copies of the variables instead, and commands that do more
+	// than changing variables are skipped
+	ProfileCompiler(CmdRegistry &registry, bool shadow = false)
+	  : _registry(registry)
+	  , _shadowed(shadow)
+	{
+		_registry.SetLoadObserver(this);
+		variableObserver = this;
+		if (_shadowed)
+		{
+			variableShadow = &_shadow;
+		}
+	}
+
+	~ProfileCompiler()
+	{
+		Detach();
+		if (_shadowed)
+		{
+			variableShadow = nullptr;
+		}
+	}
+
+	void OnChange(const void *variable, int slot, Capture capture) override
+	{
+		// Only the final state matters
+		if (_changed.emplace(variable, slot).second)
+		{
+			_captures.push_back(capture);
+		}
+	}
+
+	void OnReset(const void *variable, Capture capture) override
+	{
+		if (_reset.insert(variable).second)
+		{
+			_resetCaptures.push_back(capture);
+		}
+	}
+
+	void OnFileLoaded(in_string path) override
+	{
+		files.push_back(path);
+	}
+
+	bool OnCommand(const JSMCommand &cmd) override
+	{
+		compilable &= cmd.OnlyChangesVariables();
+		return !_shadowed || cmd.OnlyChangesVariables();
+	}
+
+	// Call once loading is over. In a shadow, the final state is read from the copies.
+	void Compile(vector<Restore> &resets, vector<Restore> &changes)
+	{
+		Detach();
+		resets.clear();
+		for (auto &capture : _resetCaptures)
+		{
+			resets.push_back(capture());
+		}
+		changes.clear();
+		changes.reserve(_captures.size());
+		for (auto &capture : _captures)
+		{
+			changes.push_back(capture());
+		}
+	}
+
+private:
+	void Detach()
+	{
+		variableObserver = nullptr;
+		_registry.SetLoadObserver(nullptr);
+	}
+
+	CmdRegistry &_registry;
+	bool _shadowed;
+	VariableShadow _shadow;
+	set<pair<const void *, int>> _changed;
+	vector<Capture> _captures;
+	set<const void *> _reset;
+	vector<Capture> _resetCaptures;
+};
+
+// Only pauses if anything differs from the current state
+void applyProfile(const vector<VariableObserver::Restore> &resets, const vector<VariableObserver::Restore> &changes, const ProfileCache::PauseDelegate &pause)
+{
+	vector<const function<void()> *> applies;
+	for (auto restores : { &resets, &changes })
+	{
+		for (auto &restore : *restores)
+		{
+			if (restore.differs())
+			{
+				applies.push_back(&restore.apply);
+			}
+		}
+	}
+	if (!applies.empty())
+	{
+		pause([&applies]() {
+			for (auto apply : applies)
+			{
+				(*apply)();
+			}
+		});
+	}
+}
+} // namespace
+
+bool ProfileCache::Stamp(in_string path, FileStamp &stamp)
+{
+	error_code error, sizeError;
+	stamp.path = path;
+	stamp.modified = filesystem::last_write_time(path, error);
+	stamp.size = filesystem::file_size(path, sizeError);
+	ifstream file(path, ios::binary);
+	if (error || sizeError || !file)
+	{
+		return false;
+	}
+	string content((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	stamp.hash = 0xcbf29ce484222325ull; // FNV-1a
+	for (char c : content)
+	{
+		stamp.hash = (stamp.hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+	}
+	return true;
+}
+
+bool ProfileCache::Check(FileStamp &stamp, bool &changed)
+{
+	error_code error, sizeError;
+	auto modified = filesystem::last_write_time(stamp.path, error);
+	auto size = filesystem::file_size(stamp.path, sizeError);
+	if (error || sizeError)
+	{
+		return false;
+	}
+	changed = false;
+	if (modified == stamp.modified && size == stamp.size)
+	{
+		return true;
+	}
+	FileStamp now;
+	if (!Stamp(stamp.path, now))
+	{
+		return false;
+	}
+	changed = now.hash != stamp.hash;
+	if (!changed)
+	{
+		stamp = move(now);
+	}
+	return true;
+}
+
+bool ProfileCache::IsUpToDate(Profile &profile)
+{
+	for (auto &file : profile.files)
+	{
+		bool changed;
+		if (!Check(file, changed) || changed)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ProfileCache::Load(CmdRegistry &registry, in_string path, const PauseDelegate &pause)
+{
+	auto cached = _profiles.find(path);
+	if (cached != _profiles.end())
+	{
+		if (cached->second.isCompiled && IsUpToDate(cached->second))
+		{
+			COUT << "Applying compiled profile ";
+			COUT_INFO << path << endl;
+			applyProfile(cached->second.resets, cached->second.changes, pause);
+			return true;
+		}
+		_profiles.erase(cached);
+	}
+
+	Profile profile;
+	{
+		ProfileCompiler compiler(registry);
+		registry.processLine(path);
+		for (auto &file : compiler.files)
+		{
+			profile.files.emplace_back();
+			if (!Stamp(file, profile.files.back()))
+			{
+				return false;
+			}
+		}
+		if (profile.files.empty())
+		{
+			return false;
+		}
+		profile.isCompiled = compiler.compilable;
+		if (profile.isCompiled)
+		{
+			compiler.Compile(profile.resets, profile.changes);
+		}
+	}
+	_profiles.emplace(path, move(profile));
+	return false;
+}
+
+bool ProfileCache::Reload(CmdRegistry &registry, in_string path, const PauseDelegate &pause)
+{
+	Profile profile;
+	{
+		ProfileCompiler compiler(registry, true);
+		muteOutput(true);
+		registry.processLine(path);
+		muteOutput(false);
+		profile.isCompiled = compiler.compilable && !compiler.files.empty();
+		for (auto &file : compiler.files)
+		{
+			profile.files.emplace_back();
+			profile.isCompiled &= Stamp(file, profile.files.back());
+		}
+		if (profile.isCompiled)
+		{
+			compiler.Compile(profile.resets, profile.changes);
+		}
+	}
+	if (!profile.isCompiled)
+	{
+		return false;
+	}
+	COUT << "Applying changes from ";
+	COUT_INFO << path << endl;
+	applyProfile(profile.resets, profile.changes, pause);
+	_profiles[path] = move(profile);
+	return true;
+}
+
+bool ProfileCache::HasChanged(in_string path)
+{
+	auto cached = _profiles.find(path);
+	if (cached == _profiles.end())
+	{
+		return false;
+	}
+	bool changed = false;
+	for (auto &file : cached->second.files)
+	{
+		bool fileChanged;
+		if (!Check(file, fileChanged))
+		{
+			return false;
+		}
+		changed |= fileChanged;
+	}
+	return changed;
+}
+
+vector<string> ProfileCache::Files(in_string path) const
+{
+	vector<string> files;
+	auto cached = _profiles.find(path);
+	if (cached != _profiles.end())
+	{
+		for (auto &file : cached->second.files)
+		{
+			files.push_back(file.path);
+		}
+	}
+	return files;
+}
+
+void ProfileCache::Clear()
+{
+	_profiles.clear();
+}
@@ -0,0 +1,118 @@
+#include "SyntheticBackend.h"
+#include "SyntheticInput.h"
+#include "TickScheduler.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+namespace
+{
+struct SyntheticDevice : public JslDevice
+{
+	SyntheticDevice(int index, unsigned int seed)
+	  : _input(index, seed)
+	{
+		_imu = _input.imu;
+	}
+
+	int GetControllerType() override
+	{
+		return JS_TYPE_DS4; // Has everything: gyro, touchpad and light bar
+	}
+
+	void Generate(float deltaTime, bool randomized)
+	{
+		_input.Generate(deltaTime, randomized);
+		_state = _input.state;
+		_imu = _input.imu;
+		_touch = _input.touch;
+		queueImuSample(deltaTime);
+	}
+
+private:
+	SyntheticInput _input;
+};
+} // namespace
+
+SyntheticBackend::SyntheticBackend(int numControllers, float reportRate, bool randomized, unsigned int seed)
+  : _numControllers(numControllers)
+  , _period(1.f / std::max(reportRate, 1.f))
+  , _randomized(randomized)
+  , _seed(seed)
+{
+}
+
+int SyntheticBackend::CountDevices()
+{
+	return _numControllers;
+}
+
+JslDevice *SyntheticBackend::Open(int index)
+{
+	return index < _numControllers ? new SyntheticDevice(index, _seed) : nullptr;
+}
+
+bool SyntheticBackend::Wait(std::chrono::steady_clock::time_point deadline)
+{
+	if (_nextReport > deadline)
+	{
+		return false;
+	}
+	TickScheduler::SleepUntil(_nextReport);
+	return true;
+}
+
+void SyntheticBackend::Update(const std::map<int, JslDevice *> &devices)
+{
+	auto now = std::chrono::steady_clock::now();
+	auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(_period));
+	if (_nextReport == std::chrono::steady_clock::time_point())
+	{
+		_nextReport = now;
+	}
+	int reports = 0;
+	while (_nextReport <= now && reports < JSL_MAX_IMU_SAMPLES)
+	{
+		for (auto &pair : devices)
+		{
+			static_cast<SyntheticDevice *>(pair.second)->Generate(_period, _randomized);
+		}
+		_nextReport += period;
+		++reports;
+	}
+	if (_nextReport <= now)
+	{
+		// Too far behind to catch up: drop reports the way a congested connection would
+		_nextReport = now + period;
+	}
+	if (reports > 0)
+	{
+		for (auto &pair : devices)
+		{
+			pair.second->markFreshReport(now);
+		}
+	}
+}
+
+JslBackend *createSyntheticBackendFromEnvironment()
+{
+	const char *setting = ::getenv("JSM_SYNTHETIC_CONTROLLERS");
+	if (setting == nullptr)
+	{
+		return nullptr;
+	}
+	std::stringstream ss(setting);
+	std::string count, rate, mode;
+	std::getline(ss, count, ',');
+	std::getline(ss, rate, ',');
+	std::getline(ss, mode, ',');
+	int numControllers = std::atoi(count.c_str());
+	if (numControllers <= 0)
+	{
+		return nullptr;
+	}
+	float reportRate = rate.empty() ? 1000.f : float(std::atof(rate.c_str()));
+	return new SyntheticBackend(numControllers, reportRate, mode == "random");
+}
@@ -0,0 +1,130 @@
+#include "SyntheticInput.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+constexpr float TAU = 6.28318530718f;
+constexpr int NUM_BUTTONS = JSOFFSET_SR + 1;
+constexpr float SLOT_DURATION = 0.5f; // Each button gets that long on each lap
+
+// Move value towards target in about a tenth of a second, whatever the report rate
+float approach(float value, float target, float deltaTime)
+{
+	return value + (target - value) * std::min(1.f, deltaTime * 10.f);
+}
+} // namespace
+
+float SyntheticInput::GetScriptDuration()
+{
+	return 2 * NUM_BUTTONS * SLOT_DURATION;
+}
+
+SyntheticInput::SyntheticInput(int index, unsigned int seed)
+  : _index(index)
+  , _rng(seed + index)
+{
+	// Resting flat on a table
+	imu.accelY = 1.f;
+}
+
+void SyntheticInput::Generate(float deltaTime, bool randomized)
+{
+	_time += deltaTime;
+	if (randomized)
+	{
+		Wander(deltaTime);
+	}
+	else
+	{
+		Script(_time + _index * 0.37f); // Don't make all controllers do the same thing at the same time
+	}
+}
+
+void SyntheticInput::Script(float t)
+{
+	// Left stick goes around in circles, right stick flicks in a new direction every second
+	state.stickLX = 0.8f * cosf(TAU * 0.5f * t);
+	state.stickLY = 0.8f * sinf(TAU * 0.5f * t);
+	float flickAngle = floorf(t) * 2.4f;
+	float flickAmount = fmodf(t, 1.f) < 0.3f ? 1.f : 0.f;
+	state.stickRX = flickAmount * cosf(flickAngle);
+	state.stickRY = flickAmount * sinf(flickAngle);
+
+	// Triggers slowly go through soft and full pulls
+	state.lTrigger = 1.f - fabsf(fmodf(t * 0.5f, 2.f) - 1.f);
+	state.rTrigger = 1.f - fabsf(fmodf(t * 0.5f + 1.f, 2.f) - 1.f);
+
+	// One button at a time, with taps on the first lap and holds on the next
+	int slot = int(t / SLOT_DURATION);
+	bool hold = (slot / NUM_BUTTONS) % 2 == 1;
+	state.buttons = t - slot * SLOT_DURATION < (hold ? 0.45f : 0.08f) ? 1 << (slot % NUM_BUTTONS) : 0;
+
+	// Turning left and right while nodding up and down
+	imu.gyroX = 60.f * sinf(TAU * 0.3f * t);
+	imu.gyroY = 120.f * sinf(TAU * 0.7f * t);
+	imu.gyroZ = 0.f;
+
+	touch.t0Down = fmodf(t, 2.f) < 1.f;
+	touch.t0X = fmodf(t, 1.f);
+	touch.t0Y = 0.5f;
+}
+
+void SyntheticInput::Wander(float deltaTime)
+{
+	std::uniform_real_distribution<float> unit(-1.f, 1.f);
+	std::normal_distribution<float> noise(0.f, 1.f);
+	auto every = [&](float seconds) { return std::uniform_real_distribution<float>(0.f, seconds)(_rng) < deltaTime; };
+
+	// Every so often, pick new positions for the sticks and triggers to move to
+	if (every(0.3f))
+	{
+		for (float &target : _targets)
+		{
+			target = unit(_rng);
+		}
+		// Keep sticks within their circle
+		for (int stick = 0; stick < 4; stick += 2)
+		{
+			float length = sqrtf(_targets[stick] * _targets[stick] + _targets[stick + 1] * _targets[stick + 1]);
+			if (length > 1.f)
+			{
+				_targets[stick] /= length;
+				_targets[stick + 1] /= length;
+			}
+		}
+	}
+	state.stickLX = approach(state.stickLX, _targets[0], deltaTime);
+	state.stickLY = approach(state.stickLY, _targets[1], deltaTime);
+	state.stickRX = approach(state.stickRX, _targets[2], deltaTime);
+	state.stickRY = approach(state.stickRY, _targets[3], deltaTime);
+	state.lTrigger = approach(state.lTrigger, fabsf(_targets[4]), deltaTime);
+	state.rTrigger = approach(state.rTrigger, fabsf(_targets[5]), deltaTime);
+
+	for (int button = 0; button < NUM_BUTTONS; ++button)
+	{
+		if (every(0.4f))
+		{
+			state.buttons ^= 1 << button;
+		}
+	}
+
+	if (every(0.2f))
+	{
+		for (float &target : _gyroTargets)
+		{
+			target = noise(_rng) * 200.f;
+		}
+	}
+	imu.gyroX = approach(imu.gyroX, _gyroTargets[0], deltaTime) + noise(_rng) * 0.5f;
+	imu.gyroY = approach(imu.gyroY, _gyroTargets[1], deltaTime) + noise(_rng) * 0.5f;
+	imu.gyroZ = approach(imu.gyroZ, _gyroTargets[2], deltaTime) + noise(_rng) * 0.5f;
+
+	if (every(1.f))
+	{
+		touch.t0Down = !touch.t0Down;
+	}
+	touch.t0X = std::clamp(touch.t0X + unit(_rng) * 0.05f, 0.f, 1.f);
+	touch.t0Y = std::clamp(touch.t0Y + unit(_rng) * 0.05f, 0.f, 1.f);
+}
@@ -0,0 +1,127 @@
+#include "TickRecording.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+constexpr char MAGIC[4] = { 'J', 'S', 'M', 'R' };
+constexpr uint32_t VERSION = 1;
+
+template<typename T>
+void writeRaw(std::ostream &out, const T &value)
+{
+	out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template<typename T>
+bool readRaw(std::istream &in, T &value)
+{
+	return bool(in.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+} // namespace
+
+bool TickRecorder::Start(in_string path)
+{
+	std::lock_guard<std::mutex> guard(_mutex);
+	if (_file.is_open())
+	{
+		_file.close();
+	}
+	_file.open(path, std::ios::binary | std::ios::trunc);
+	if (!_file)
+	{
+		_recording = false;
+		return false;
+	}
+	_file.write(MAGIC, sizeof(MAGIC));
+	writeRaw(_file, VERSION);
+	_devices.clear();
+	_tickCount = 0;
+	_recording = true;
+	return true;
+}
+
+void TickRecorder::Stop()
+{
+	std::lock_guard<std::mutex> guard(_mutex);
+	_recording = false;
+	if (_file.is_open())
+	{
+		_file.close();
+	}
+}
+
+bool TickRecorder::HasDevice(int handle)
+{
+	std::lock_guard<std::mutex> guard(_mutex);
+	return _devices.find(handle) != _devices.end();
+}
+
+void TickRecorder::Write(const RecordedDevice &device)
+{
+	std::lock_guard<std::mutex> guard(_mutex);
+	if (!_recording || !_devices.insert(device.handle).second)
+	{
+		return;
+	}
+	writeRaw(_file, uint8_t(TickRecordType::DEVICE));
+	writeRaw(_file, device);
+}
+
+void TickRecorder::Write(int handle, const TickInput &input)
+{
+	std::lock_guard<std::mutex> guard(_mutex);
+	if (!_recording)
+	{
+		return;
+	}
+	writeRaw(_file, uint8_t(TickRecordType::TICK));
+	writeRaw(_file, int32_t(handle));
+	writeRaw(_file, input.deltaTime);
+	writeRaw(_file, input.state);
+	writeRaw(_file, input.touch);
+	uint8_t numImuSamples = uint8_t(std::min(input.numImuSamples, JSL_MAX_IMU_SAMPLES));
+	writeRaw(_file, numImuSamples);
+	_file.write(reinterpret_cast<const char *>(input.imuSamples), numImuSamples * sizeof(IMU_SAMPLE));
+	++_tickCount;
+}
+
+bool TickReader::Open(in_string path)
+{
+	_file.open(path, std::ios::binary);
+	char magic[sizeof(MAGIC)];
+	uint32_t version;
+	return _file.read(magic, sizeof(magic)) && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0 &&
+	  readRaw(_file, version) && version == VERSION;
+}
+
+TickRecordType TickReader::Read(RecordedDevice &device, int &handle, TickInput &input)
+{
+	uint8_t type;
+	if (!readRaw(_file, type))
+	{
+		return TickRecordType::END;
+	}
+	switch (TickRecordType(type))
+	{
+	case TickRecordType::DEVICE:
+		return readRaw(_file, device) ? TickRecordType::DEVICE : TickRecordType::INVALID;
+	case TickRecordType::TICK:
+	{
+		int32_t recordedHandle;
+		uint8_t numImuSamples;
+		if (readRaw(_file, recordedHandle) && readRaw(_file, input.deltaTime) && readRaw(_file, input.state) &&
+		  readRaw(_file, input.touch) && readRaw(_file, numImuSamples) && numImuSamples <= JSL_MAX_IMU_SAMPLES &&
+		  _file.read(reinterpret_cast<char *>(input.imuSamples), numImuSamples * sizeof(IMU_SAMPLE)))
+		{
+			handle = recordedHandle;
+			input.numImuSamples = numImuSamples;
+			return TickRecordType::TICK;
+		}
+		return TickRecordType::INVALID;
+	}
+	default:
+		return TickRecordType::INVALID;
+	}
+}
@@ -1,7 +1,11 @@
 #include "InputHelpers.h"
+#include "linux/SharedMemorySink.h"
 
 #include <array>
 #include <atomic>
+#include <bitset>
+#include <cerrno>
+#include <chrono>
 #include <cmath>
 #include <cstring>
 #include <functional>
@@ -9,11 +13,14 @@
 #include <thread>
 #include <vector>
 #include <memory>
+#include <mutex>
 
 #include <libevdev/libevdev-uinput.h>
 
 #include <dirent.h>
+#include <poll.h>
 #include <unistd.h>
+#include <sys/inotify.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
 #include <termios.h>
@@ -27,8 +34,32 @@ using X11Atom = unsigned long;
 
 #define UINPUT_DEVICE "/dev/uinput"
 
+// The X11 property change event, laid out as in Xlib.h
+struct X11PropertyEvent
+{
+	int type;
+	unsigned long serial;
+	int send_event;
+	void *display;
+	X11Window window;
+	X11Atom atom;
+	unsigned long time;
+	int state;
+};
+
+union X11Event
+{
+	int type;
+	X11PropertyEvent property;
+	long pad[24];
+};
+
+constexpr int X11_PROPERTY_NOTIFY{ 28 };
+constexpr long X11_PROPERTY_CHANGE_MASK{ 1L << 22 };
+
 static void *X11Display{ nullptr };
 static X11Atom _NET_WM_PID{ 0 };
+static X11Atom _NET_ACTIVE_WINDOW{ 0 };
 
 static void *(*XOpenDisplay)(const char *);
 static int (*XGetInputFocus)(void *, X11Window *, int *);
@@ -36,6 +67,11 @@ static int (*XFetchName)(void *, X11Window, char **);
 static X11Atom (*XInternAtom)(void *, const char *, int);
 static int (*XGetWindowProperty)(void *, X11Window, X11Atom, long, long, int, X11Atom, X11Atom *, int *, unsigned long *, unsigned long *, unsigned char **);
 static int (*XFree)(void *);
+static X11Window (*XDefaultRootWindow)(void *);
+static int (*XSelectInput)(void *, X11Window, long);
+static int (*XPending)(void *);
+static int (*XNextEvent)(void *, X11Event *);
+static int (*XConnectionNumber)(void *);
 
 // Windows' mouse speed settings translate non-linearly to speed.
 // Thankfully, the mappings are available here:
@@ -306,6 +342,7 @@ public:
 public:
 	VirtualInputDevice(Device device) noexcept
 	  : device_{ libevdev_new() }
+	  , type_{ device }
 	{
 		if (device == Device::MOUSE)
 		{
@@ -351,40 +388,17 @@ public:
 	}
 
 public:
+	// Events are collected into a frame and only sent to the kernel when the frame is flushed. Each thread has a
+	// frame of its own, so that a thread flushing doesn't send half of what another one is putting together.
+
 	void press_key(WORD key) noexcept
 	{
-		auto error =
-		  libevdev_uinput_write_event(uinput_device_, EV_KEY, windows_key_to_evdev_key(key), 1);
-		if (error != 0)
-		{
-			std::fprintf(stderr, "Failed to to simulate key press: %s\n", std::strerror(-error));
-			return;
-		}
-
-		error = libevdev_uinput_write_event(uinput_device_, EV_SYN, SYN_REPORT, 0);
-		if (error != 0)
-		{
-			std::fprintf(stderr, "Failed to to simulate key press: %s\n", std::strerror(-error));
-			return;
-		}
+		queue_key(windows_key_to_evdev_key(key), 1);
 	}
 
 	void release_key(WORD key) noexcept
 	{
-		auto error =
-		  libevdev_uinput_write_event(uinput_device_, EV_KEY, windows_key_to_evdev_key(key), 0);
-		if (error != 0)
-		{
-			std::fprintf(stderr, "Failed to to simulate key release: %s\n", std::strerror(-error));
-			return;
-		}
-
-		error = libevdev_uinput_write_event(uinput_device_, EV_SYN, SYN_REPORT, 0);
-		if (error != 0)
-		{
-			std::fprintf(stderr, "Failed to to simulate key release: %s\n", std::strerror(-error));
-			return;
-		}
+		queue_key(windows_key_to_evdev_key(key), 0);
 	}
 
 	void click_key(WORD key) noexcept
@@ -395,72 +409,113 @@ public:
 
 	void mouse_move_relative(std::int32_t x, std::int32_t y) noexcept
 	{
-		auto error = libevdev_uinput_write_event(uinput_device_, EV_REL, REL_X, x);
-		if (error != 0)
-		{
-			std::fprintf(stderr, "Failed to to simulate mouse move: %s\n", std::strerror(-error));
-			return;
-		}
+		Frame &frame = thread_frame();
+		frame.rel_x += x;
+		frame.rel_y += y;
+	}
 
-		error = libevdev_uinput_write_event(uinput_device_, EV_REL, REL_Y, y);
-		if (error != 0)
-		{
-			std::fprintf(stderr, "Failed to to simulate mouse move: %s\n", std::strerror(-error));
-			return;
-		}
+	void mouse_move_absolute(std::int32_t x, std::int32_t y) noexcept
+	{
+		Frame &frame = thread_frame();
+		queue_event(frame, EV_ABS, ABS_X, x);
+		queue_event(frame, EV_ABS, ABS_Y, y);
+	}
 
-		error = libevdev_uinput_write_event(uinput_device_, EV_SYN, SYN_REPORT, 0);
-		if (error != 0)
-		{
-			std::fprintf(stderr, "Failed to to simulate mouse move: %s\n", std::strerror(-error));
-			return;
-		}
+	void mouse_scroll(std::int32_t amount) noexcept
+	{
+		thread_frame().rel_wheel += amount;
 	}
 
-	void mouse_move_absolute(std::int32_t x, std::int32_t y) noexcept
+	// Send everything the calling thread collected since its last flush with a single write, ending with a
+	// SYN_REPORT. The kernel injects each write as a whole, so frames from different threads don't interleave.
+	void flush() noexcept
 	{
-		auto error = libevdev_uinput_write_event(uinput_device_, EV_ABS, ABS_X, x);
-		if (error != 0)
+		Frame &frame = thread_frame();
+		if (frame.rel_x != 0)
 		{
-			std::fprintf(stderr, "Failed to to simulate mouse move: %s\n", std::strerror(-error));
-			return;
+			queue_event(frame, EV_REL, REL_X, frame.rel_x);
 		}
+		if (frame.rel_y != 0)
+		{
+			queue_event(frame, EV_REL, REL_Y, frame.rel_y);
+		}
+		if (frame.rel_wheel != 0)
+		{
+			queue_event(frame, EV_REL, REL_WHEEL, frame.rel_wheel);
+		}
+		frame.rel_x = frame.rel_y = frame.rel_wheel = 0;
 
-		error = libevdev_uinput_write_event(uinput_device_, EV_ABS, ABS_Y, y);
-		if (error != 0)
+		if (frame.events.empty())
 		{
-			std::fprintf(stderr, "Failed to to simulate mouse move: %s\n", std::strerror(-error));
 			return;
 		}
+		queue_event(frame, EV_SYN, SYN_REPORT, 0);
 
-		error = libevdev_uinput_write_event(uinput_device_, EV_SYN, SYN_REPORT, 0);
-		if (error != 0)
+		if (uinput_device_ != nullptr)
 		{
-			std::fprintf(stderr, "Failed to to simulate mouse move: %s\n", std::strerror(-error));
-			return;
+			const auto size = frame.events.size() * sizeof(input_event);
+			const auto written = ::write(libevdev_uinput_get_fd(uinput_device_), frame.events.data(), size);
+			if (written < 0)
+			{
+				std::fprintf(stderr, "Failed to to simulate input: %s\n", std::strerror(errno));
+			}
+			else if (static_cast<std::size_t>(written) != size)
+			{
+				std::fprintf(stderr, "Failed to to simulate input: only %zd of %zu bytes written\n", written, size);
+			}
 		}
+		frame.events.clear();
+		frame.keys.reset();
 	}
 
-	void mouse_scroll(std::int32_t amount) noexcept
+private:
+	struct Frame
 	{
-		auto error = libevdev_uinput_write_event(uinput_device_, EV_REL, REL_WHEEL, amount);
-		if (error != 0)
+		std::vector<input_event> events;
+		std::bitset<KEY_CNT> keys;
+		std::int32_t rel_x{ 0 };
+		std::int32_t rel_y{ 0 };
+		std::int32_t rel_wheel{ 0 };
+	};
+
+	// There is one device of each type, so the calling thread's frame for this device is found by its type
+	Frame &thread_frame() noexcept
+	{
+		thread_local Frame frames[2];
+		return frames[int(type_)];
+	}
+
+	static void queue_event(Frame &frame, std::uint16_t type, std::uint16_t code, std::int32_t value) noexcept
+	{
+		input_event event{};
+		event.type = type;
+		event.code = code;
+		event.value = value;
+		frame.events.push_back(event);
+	}
+
+	void queue_key(std::uint16_t code, std::int32_t value) noexcept
+	{
+		if (code == 0 || code >= KEY_CNT)
 		{
-			std::fprintf(stderr, "Failed to to simulate mouse scroll: %s\n", std::strerror(-error));
 			return;
 		}
-
-		error = libevdev_uinput_write_event(uinput_device_, EV_SYN, SYN_REPORT, 0);
-		if (error != 0)
+		Frame &frame = thread_frame();
+		if (frame.keys.test(code))
 		{
-			std::fprintf(stderr, "Failed to to simulate mouse move: %s\n", std::strerror(-error));
-			return;
+			// The same key changed twice in this frame: end the frame here so that the press and release
+			// aren't merged into a single report and lost.
+			queue_event(frame, EV_SYN, SYN_REPORT, 0);
+			frame.keys.reset();
 		}
+		frame.keys.set(code);
+		queue_event(frame, EV_KEY, code, value);
 	}
 
 private:
 	libevdev *device_;
 	libevdev_uinput *uinput_device_{ nullptr };
+	Device type_;
 };
 
 // get the user's mouse sensitivity multiplier from the user. In Windows it's an int, but who cares?
@@ -475,8 +530,95 @@ namespace
 {
 VirtualInputDevice mouse{ VirtualInputDevice::Device::MOUSE };
 VirtualInputDevice keyboard{ VirtualInputDevice::Device::KEYBOARD };
+
+// Number of output frames open on this thread. Output made outside of a frame is sent right away.
+thread_local int outputFrameDepth = 0;
+
+thread_local OutputSink *outputSink = nullptr;
+
+// Takes the place of the virtual devices for threads without a sink of their own. Controller threads may be
+// sending output to the shared memory sink when another device is picked, so once opened it stays open.
+std::atomic<OutputSink *> deviceSink{ nullptr };
+std::unique_ptr<SharedMemorySink> sharedMemory;
+
+OutputSink *currentSink()
+{
+	return outputSink ? outputSink : deviceSink.load(std::memory_order_acquire);
+}
+
+template<typename Output>
+void flushOutsideFrame(Output &output)
+{
+	if (outputFrameDepth == 0)
+	{
+		output.flush();
+	}
+}
 } // namespace
 
+void beginOutputFrame()
+{
+	++outputFrameDepth;
+}
+
+void flushOutputFrame()
+{
+	if (outputFrameDepth > 0 && --outputFrameDepth > 0)
+	{
+		return;
+	}
+	if (auto sink = currentSink())
+	{
+		sink->flush();
+		return;
+	}
+	mouse.flush();
+	keyboard.flush();
+}
+
+void setOutputSink(OutputSink *sink)
+{
+	outputSink = sink;
+}
+
+bool hasOutputSink()
+{
+	return outputSink != nullptr;
+}
+
+bool setOutputDevice(OutputDevice device)
+{
+	if (device != OutputDevice::SHARED_MEMORY)
+	{
+		deviceSink = nullptr;
+		if (sharedMemory)
+		{
+			sharedMemory->releaseAll();
+		}
+		return true;
+	}
+	if (!sharedMemory)
+	{
+		auto sink = std::make_unique<SharedMemorySink>();
+		if (!sink->IsOpen())
+		{
+			return false;
+		}
+		sharedMemory = std::move(sink);
+	}
+	deviceSink = sharedMemory.get();
+	return true;
+}
+
+void setOrientation(int handle, float w, float x, float y, float z)
+{
+	if (auto sink = currentSink())
+	{
+		sink->setOrientation(handle, w, x, y, z);
+		flushOutsideFrame(*sink);
+	}
+}
+
 // send mouse button
 int pressMouse(WORD vkKey, bool isPressed)
 {
@@ -485,6 +627,7 @@ int pressMouse(WORD vkKey, bool isPressed)
 		if (isPressed)
 		{
 			mouse.mouse_scroll(1);
+			flushOutsideFrame(mouse);
 		}
 
 		return 0;
@@ -495,6 +638,7 @@ int pressMouse(WORD vkKey, bool isPressed)
 		if (isPressed)
 		{
 			mouse.mouse_scroll(-1);
+			flushOutsideFrame(mouse);
 		}
 
 		return 0;
@@ -508,6 +652,7 @@ int pressMouse(WORD vkKey, bool isPressed)
 	{
 		mouse.release_key(vkKey);
 	}
+	flushOutsideFrame(mouse);
 
 	return 0;
 }
@@ -517,6 +662,12 @@ int pressKey(KeyCode vkKey, bool pressed)
 {
 	if (vkKey == 0)
 		return 0;
+	if (auto sink = currentSink())
+	{
+		sink->pressKey(vkKey, pressed);
+		flushOutsideFrame(*sink);
+		return 0;
+	}
 	if (vkKey.code <= V_WHEEL_DOWN)
 	{
 		// Highest mouse ID
@@ -531,31 +682,54 @@ int pressKey(KeyCode vkKey, bool pressed)
 	{
 		keyboard.release_key(vkKey.code);
 	}
+	flushOutsideFrame(keyboard);
 
 	return 0;
 }
 
 float accumulatedX = 0;
 float accumulatedY = 0;
+std::mutex accumulatedLock; // Each controller moves the mouse from its own thread
 
 void moveMouse(float x, float y)
 {
-	accumulatedX += x;
-	accumulatedY += y;
+	if (auto sink = currentSink())
+	{
+		sink->moveMouse(x, y);
+		flushOutsideFrame(*sink);
+		return;
+	}
+	int applicableX, applicableY;
+	{
+		std::lock_guard<std::mutex> guard(accumulatedLock);
+		accumulatedX += x;
+		accumulatedY += y;
 
-	int applicableX = (int)accumulatedX;
-	int applicableY = (int)accumulatedY;
+		applicableX = (int)accumulatedX;
+		applicableY = (int)accumulatedY;
 
-	accumulatedX -= applicableX;
-	accumulatedY -= applicableY;
+		accumulatedX -= applicableX;
+		accumulatedY -= applicableY;
+	}
 
-	mouse.mouse_move_relative(applicableX, applicableY);
+	if (applicableX != 0 || applicableY != 0)
+	{
+		mouse.mouse_move_relative(applicableX, applicableY);
+		flushOutsideFrame(mouse);
+	}
 	// printf("%0.4f %0.4f\n", accumulatedX, accumulatedY);
 }
 
 void setMouseNorm(float x, float y)
 {
+	if (auto sink = currentSink())
+	{
+		sink->setMouseNorm(x, y);
+		flushOutsideFrame(*sink);
+		return;
+	}
 	mouse.mouse_move_absolute(std::roundf(65535.0f * x), std::roundf(65535.0f * y));
+	flushOutsideFrame(mouse);
 }
 
 bool WriteToConsole(const std::string &command)
@@ -587,7 +761,8 @@ void initConsole(std::function<void()>)
 {
 }
 
-std::tuple<std::string, std::string> GetActiveWindowName()
+// The display is only used by the autoload thread
+static void loadX11()
 {
 	if (X11Display == nullptr)
 	{
@@ -601,11 +776,25 @@ std::tuple<std::string, std::string> GetActiveWindowName()
 			XInternAtom = reinterpret_cast<decltype(XInternAtom)>(::dlsym(libX11, "XInternAtom"));
 			XGetWindowProperty = reinterpret_cast<decltype(XGetWindowProperty)>(::dlsym(libX11, "XGetWindowProperty"));
 			XFree = reinterpret_cast<decltype(XFree)>(::dlsym(libX11, "XFree"));
+			XDefaultRootWindow = reinterpret_cast<decltype(XDefaultRootWindow)>(::dlsym(libX11, "XDefaultRootWindow"));
+			XSelectInput = reinterpret_cast<decltype(XSelectInput)>(::dlsym(libX11, "XSelectInput"));
+			XPending = reinterpret_cast<decltype(XPending)>(::dlsym(libX11, "XPending"));
+			XNextEvent = reinterpret_cast<decltype(XNextEvent)>(::dlsym(libX11, "XNextEvent"));
+			XConnectionNumber = reinterpret_cast<decltype(XConnectionNumber)>(::dlsym(libX11, "XConnectionNumber"));
 
 			X11Display = XOpenDisplay(nullptr);
-			_NET_WM_PID = XInternAtom(X11Display, "_NET_WM_PID", true);
+			if (X11Display != nullptr)
+			{
+				_NET_WM_PID = XInternAtom(X11Display, "_NET_WM_PID", true);
+				_NET_ACTIVE_WINDOW = XInternAtom(X11Display, "_NET_ACTIVE_WINDOW", true);
+			}
 		}
 	}
+}
+
+std::tuple<std::string, std::string> GetActiveWindowName()
+{
+	loadX11();
 
 	std::tuple<std::string, std::string> result;
 
@@ -664,6 +853,106 @@ std::tuple<std::string, std::string> GetActiveWindowName()
 	return result;
 }
 
+bool WaitForFocusChange(int timeoutMs)
+{
+	static bool watching = false;
+	if (!watching)
+	{
+		loadX11();
+		// Window managers following EWMH update _NET_ACTIVE_WINDOW on the root window
+		if (X11Display == nullptr || _NET_ACTIVE_WINDOW == 0 || XSelectInput == nullptr || XNextEvent == nullptr)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds{ timeoutMs });
+			return true;
+		}
+		XSelectInput(X11Display, XDefaultRootWindow(X11Display), X11_PROPERTY_CHANGE_MASK);
+		watching = true;
+		return true; // Whatever is in focus right now hasn't been looked at yet
+	}
+
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds{ timeoutMs };
+	pollfd connection{ XConnectionNumber(X11Display), POLLIN, 0 };
+	bool focusChanged = false;
+	while (true)
+	{
+		// Events may already have been read from the connection by other calls
+		while (XPending(X11Display) > 0)
+		{
+			X11Event event;
+			XNextEvent(X11Display, &event);
+			focusChanged |= event.type == X11_PROPERTY_NOTIFY && event.property.atom == _NET_ACTIVE_WINDOW;
+		}
+		auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+		if (focusChanged || remaining <= 0 || ::poll(&connection, 1, int(remaining)) <= 0)
+		{
+			return focusChanged;
+		}
+	}
+}
+
+DirectoryWatcher::DirectoryWatcher(in_string directory)
+  : DirectoryWatcher(std::vector<std::string>{ directory }, false)
+{
+}
+
+DirectoryWatcher::DirectoryWatcher(const std::vector<std::string> &directories, bool watchContents)
+{
+	int fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0)
+	{
+		return;
+	}
+	uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+	if (watchContents)
+	{
+		mask |= IN_CLOSE_WRITE;
+	}
+	for (auto &directory : directories)
+	{
+		if (::inotify_add_watch(fd, directory.c_str(), mask) < 0)
+		{
+			::close(fd);
+			return;
+		}
+	}
+	_handles.push_back(fd);
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+	for (auto handle : _handles)
+	{
+		::close(int(handle));
+	}
+}
+
+bool DirectoryWatcher::HasChanged()
+{
+	if (_handles.empty())
+	{
+		return true;
+	}
+	// Only whether anything happened matters, so the events are drained without being looked at
+	alignas(inotify_event) char events[4096];
+	bool changed = false;
+	while (::read(int(_handles.front()), events, sizeof(events)) > 0)
+	{
+		changed = true;
+	}
+	return changed;
+}
+
+bool DirectoryWatcher::WaitForChange(int timeoutMs)
+{
+	if (_handles.empty())
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+		return true;
+	}
+	pollfd notifications{ int(_handles.front()), POLLIN, 0 };
+	return ::poll(&notifications, 1, timeoutMs) > 0 && HasChanged();
+}
+
 std::vector<std::string> ListDirectory(std::string directory)
 {
 	std::vector<std::string> fileListing;
@@ -730,20 +1019,27 @@ bool isConsoleMinimized()
 
 PollingThread::~PollingThread()
 {
-	if (_continue)
+	Stop();
+	// Let poll function cleanup
+	if (_thread)
 	{
-		Stop();
-		std::this_thread::sleep_for(std::chrono::milliseconds{ _sleepTimeMs });
+		pthread_join(_thread, nullptr);
 	}
-	// Let poll function cleanup
-	pthread_join(_thread, nullptr);
 }
 
 bool PollingThread::Start()
 {
 	if (_thread && !_continue) // thread is running but hasn't stopped yet
 	{
-		std::this_thread::sleep_for(std::chrono::milliseconds{ _sleepTimeMs });
+		// Loop content may block for a while, so wait for the thread to end instead of guessing.
+		// Not forever though: it could be waiting on a lock held by the caller.
+		timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += 2;
+		if (pthread_timedjoin_np(_thread, nullptr, &deadline) == 0)
+		{
+			_thread = 0;
+		}
 	}
 	if (!_thread) // thread is clear
 	{
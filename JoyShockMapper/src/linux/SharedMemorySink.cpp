@@ -0,0 +1,167 @@
+#include "linux/SharedMemorySink.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+SharedMemorySink::SharedMemorySink(const std::string &name)
+{
+	int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+	if (fd < 0)
+	{
+		std::fprintf(stderr, "Failed to open shared memory %s: %s\n", name.c_str(), std::strerror(errno));
+		return;
+	}
+	void *address = MAP_FAILED;
+	if (ftruncate(fd, sizeof(SharedOutputSegment)) == 0)
+	{
+		address = mmap(nullptr, sizeof(SharedOutputSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	if (address == MAP_FAILED)
+	{
+		std::fprintf(stderr, "Failed to map shared memory %s: %s\n", name.c_str(), std::strerror(errno));
+		close(fd);
+		return;
+	}
+	close(fd);
+	_segment = static_cast<SharedOutputSegment *>(address);
+
+	for (auto &controller : _next.controllers)
+	{
+		controller = -1;
+	}
+	if (_segment->IsValid())
+	{
+		// Carry on from the last frame, so that readers still mapping it don't see the sequence go back
+		_next.sequence = _segment->head.load(std::memory_order_acquire);
+		SharedOutputFrame last;
+		if (_segment->TryRead(_next.sequence, last))
+		{
+			_next.totalX = last.totalX;
+			_next.totalY = last.totalY;
+		}
+	}
+	else
+	{
+		// Brand new, or left behind by another version
+		std::memset(static_cast<void *>(_segment), 0, sizeof(SharedOutputSegment));
+		new (_segment) SharedOutputSegment();
+		_segment->version = SHARED_OUTPUT_VERSION;
+		_segment->slots = SHARED_OUTPUT_SLOTS;
+		_segment->frameSize = sizeof(SharedOutputFrame);
+		std::atomic_thread_fence(std::memory_order_release);
+		_segment->magic = SHARED_OUTPUT_MAGIC;
+	}
+	// Keys held by the last run are released
+	_changed = true;
+	publish();
+}
+
+SharedMemorySink::~SharedMemorySink()
+{
+	if (_segment)
+	{
+		releaseAll();
+		munmap(_segment, sizeof(SharedOutputSegment));
+	}
+}
+
+void SharedMemorySink::pressKey(KeyCode key, bool pressed)
+{
+	if (key.code >= SHARED_OUTPUT_KEY_WORDS * 32)
+	{
+		return;
+	}
+	std::lock_guard<std::mutex> guard(_lock);
+	uint32_t bit = 1u << (key.code % 32);
+	if (pressed)
+	{
+		_next.keys[key.code / 32] |= bit;
+	}
+	else
+	{
+		_next.keys[key.code / 32] &= ~bit;
+	}
+	_changed = true;
+}
+
+void SharedMemorySink::moveMouse(float x, float y)
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	_next.mouseX += x;
+	_next.mouseY += y;
+	_changed = true;
+}
+
+void SharedMemorySink::setMouseNorm(float x, float y)
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	_next.pointerX = x;
+	_next.pointerY = y;
+	_next.flags |= SHARED_OUTPUT_HAS_POINTER;
+	_changed = true;
+}
+
+void SharedMemorySink::setOrientation(int handle, float w, float x, float y, float z)
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	// Each controller keeps the first free slot it finds. Once all are taken, other controllers are left out.
+	int slot = -1;
+	for (int i = 0; i < SHARED_OUTPUT_CONTROLLERS && slot < 0; ++i)
+	{
+		if (_next.controllers[i] == handle || _next.controllers[i] == -1)
+		{
+			slot = i;
+		}
+	}
+	if (slot < 0)
+	{
+		return;
+	}
+	_next.controllers[slot] = handle;
+	_next.orientation[slot][0] = w;
+	_next.orientation[slot][1] = x;
+	_next.orientation[slot][2] = y;
+	_next.orientation[slot][3] = z;
+	_changed = true;
+}
+
+void SharedMemorySink::flush()
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	publish();
+}
+
+void SharedMemorySink::releaseAll()
+{
+	std::lock_guard<std::mutex> guard(_lock);
+	std::memset(_next.keys, 0, sizeof(_next.keys));
+	_changed = true;
+	publish();
+}
+
+void SharedMemorySink::publish()
+{
+	if (!_changed || !_segment)
+	{
+		return;
+	}
+	_next.sequence++;
+	_next.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	_next.totalX += _next.mouseX;
+	_next.totalY += _next.mouseY;
+
+	SharedOutputSlot &slot = _segment->ring[_next.sequence % SHARED_OUTPUT_SLOTS];
+	uint64_t version = slot.version.load(std::memory_order_relaxed) & ~uint64_t(1); // Even if a writer died halfway
+	slot.version.store(version + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	std::memcpy(&slot.frame, &_next, sizeof(_next));
+	slot.version.store(version + 2, std::memory_order_release);
+	_segment->head.store(_next.sequence, std::memory_order_release);
+
+	_next.mouseX = 0.f;
+	_next.mouseY = 0.f;
+	_changed = false;
+}
@@ -5,12 +5,24 @@
 #include "Whitelister.h"
 #include "TrayIcon.h"
 #include "JSMAssignment.hpp"
+#include "SmoothingBuffer.hpp"
+#include "Trackball.hpp"
+#include "MouseInterpolator.hpp"
+#include "TickScheduler.h"
+#include "LatencyStats.h"
+#include "TickRecording.h"
+#include "ProfileCache.h"
+#include "SharedMemoryOutput.h"
 #include "quatMaths.cpp"
 #include "win32/Gamepad.h"
+#ifdef JSM_REPLAY_TOOL
+#include "SyntheticInput.h"
+#endif
 
 #include <mutex>
 #include <deque>
 #include <iomanip>
+#include <limits>
 
 #pragma warning(disable : 4996) // Disable deprecated API warnings
 
@@ -81,24 +93,43 @@ JSMSetting<float> hold_press_time = JSMSetting<float>(SettingID::HOLD_PRESS_TIME
 JSMVariable<float> sim_press_window = JSMVariable<float>(50.0f);
 JSMVariable<float> dbl_press_window = JSMVariable<float>(200.0f);
 JSMVariable<float> tick_time = JSMSetting<float>(SettingID::TICK_TIME, 3);
+JSMVariable<float> tick_spin_time = JSMVariable<float>(0.f);
+JSMVariable<float> output_rate = JSMVariable<float>(0.f);
+JSMVariable<float> output_extrapolation = JSMVariable<float>(0.f);
 JSMSetting<Color> light_bar = JSMSetting<Color>(SettingID::LIGHT_BAR, 0xFFFFFF);
 JSMSetting<FloatXY> scroll_sens = JSMSetting<FloatXY>(SettingID::SCROLL_SENS, { 30.f, 30.f });
 JSMVariable<Switch> autoloadSwitch = JSMVariable<Switch>(Switch::ON);
 JSMVariable<Switch> hide_minimized = JSMVariable<Switch>(Switch::OFF);
 JSMVariable<ControllerScheme> virtual_controller = JSMVariable<ControllerScheme>(ControllerScheme::NONE);
+JSMVariable<int> processing_cpu = JSMVariable<int>(-1);
+JSMVariable<int> input_thread_priority = JSMVariable<int>(0);
+JSMVariable<int> input_thread_cpu = JSMVariable<int>(-1);
+JSMVariable<Switch> lock_memory = JSMVariable<Switch>(Switch::OFF);
+JSMVariable<OutputDevice> output_device = JSMVariable<OutputDevice>(OutputDevice::OS);
 
 JSMVariable<PathString> currentWorkingDir = JSMVariable<PathString>(GetCWD());
 vector<JSMButton> mappings; // array enables use of for each loop and other i/f
 mutex loading_lock;
 
-float os_mouse_speed = 1.0;
-float last_flick_and_rotation = 0.0;
+// Variables rather than plain floats so that RESET_MAPPINGS can be compiled in a profile
+JSMVariable<float> os_mouse_speed = JSMVariable<float>(1.0f);
+JSMVariable<float> last_flick_and_rotation = JSMVariable<float>(0.0f);
 unique_ptr<PollingThread> autoLoadThread;
+unique_ptr<PollingThread> watchThread;
+string watchedConfig; // Empty when WATCH is off
+ProfileCache watchedProfiles;
 unique_ptr<PollingThread> minimizeThread;
+thread outputThread; // Sends mouse motion at OUTPUT_RATE while it isn't 0
+atomic<bool> isOutputStageRunning{ false };
 unique_ptr<TrayIcon> tray;
 bool devicesCalibrating = false;
 Whitelister whitelister(false);
 unordered_map<int, shared_ptr<JoyShock>> handle_to_joyshock;
+// Reports of different controllers are processed on different threads. They look controllers up in a copy of
+// handle_to_joyshock that is published once it is done changing, and never wait for the console to do so.
+shared_ptr<const unordered_map<int, shared_ptr<JoyShock>>> tick_joyshocks = make_shared<unordered_map<int, shared_ptr<JoyShock>>>();
+TickRecorder tickRecorder;
+atomic<size_t> heapAllocations{ 0 }; // Only counted by jsm_replay and jsm_bench
 
 // This class holds all the logic related to a single digital button. It does not hold the mapping but only a reference
 // to it. It also contains it's various states, flags and data.
@@ -116,21 +147,38 @@ public:
 			{
 				_vigemController.reset(new Gamepad(virtual_controller.get(), virtualControllerCallback));
 			}
+			// Only so many keys are held at once: pressing buttons shouldn't have to grow these
+			gyroActionQueue.reserve(32);
+			activeTogglesQueue.reserve(32);
 		}
-		deque<pair<ButtonID, KeyCode>> gyroActionQueue; // Queue of gyro control actions currently in effect
-		deque<pair<ButtonID, KeyCode>> activeTogglesQueue;
+		// Keys are interned by Mapping, so they are compared by address
+		vector<pair<ButtonID, const KeyCode *>> gyroActionQueue; // Queue of gyro control actions currently in effect
+		vector<pair<ButtonID, const KeyCode *>> activeTogglesQueue;
 		deque<ButtonID> chordStack; // Represents the current active buttons in order from most recent to latest
+		unsigned int chordStackRevision = 0; // Incremented on every change of the chord stack
 		unique_ptr<Gamepad> _vigemController;
 		function<DigitalButton *(ButtonID)> _getMatchingSimBtn;
 		mutex callback_lock; // Needs to be in the common struct for both joycons to use the same
 		function<void(int small, int big)> _rumble;
 	};
 
-	static bool findQueueItem(pair<ButtonID, KeyCode> &pair, ButtonID btn)
+	static bool findQueueItem(pair<ButtonID, const KeyCode *> &pair, ButtonID btn)
 	{
 		return btn == pair.first;
 	}
 
+	// A mapping with the name it is displayed with. Once made, it never changes: buttons share it rather than copy it.
+	struct PressMapping
+	{
+		Mapping mapping;
+		string name;
+
+		inline void ProcessEvent(BtnEvent evt, DigitalButton &button) const
+		{
+			mapping.ProcessEvent(evt, button, name);
+		}
+	};
+
 	DigitalButton(shared_ptr<DigitalButton::Common> btnCommon, ButtonID id, int deviceHandle, GamepadMotion *gamepadMotion)
 	  : _id(id)
 	  , _btnState(BtnState::NoPress)
@@ -138,6 +186,7 @@ public:
 	  , _mapping(mappings[int(_id)])
 	  , _press_times()
 	  , _keyToRelease()
+	  , _compiledRevision(0)
 	  , _turboCount(0)
 	  , _simPressMaster(nullptr)
 	  , _instantReleaseQueue()
@@ -151,8 +200,12 @@ public:
 	shared_ptr<Common> _common;
 	const JSMButton &_mapping;
 	chrono::steady_clock::time_point _press_times;
-	unique_ptr<Mapping> _keyToRelease; // At key press, remember what to release
-	string _nameToRelease;
+	shared_ptr<const PressMapping> _keyToRelease; // At key press, remember what to release
+	// Every mapping the button can press, made again when the button's variable changes so that presses don't copy mappings
+	shared_ptr<const PressMapping> _baseMapping;
+	array<shared_ptr<const PressMapping>, MAPPING_SIZE> _chordMappings; // Including the double press, at _id
+	array<shared_ptr<const PressMapping>, MAPPING_SIZE> _simPressMappings;
+	unsigned int _compiledRevision;
 	unsigned int _turboCount;
 	DigitalButton *_simPressMaster;
 	vector<BtnEvent> _instantReleaseQueue;
@@ -164,7 +217,7 @@ public:
 		if (instant != _instantReleaseQueue.end())
 		{
 			//COUT << "Button " << _id << " releases instant " << instantEvent << endl;
-			_keyToRelease->ProcessEvent(BtnEvent::OnInstantRelease, *this, _nameToRelease);
+			_keyToRelease->ProcessEvent(BtnEvent::OnInstantRelease, *this);
 			_instantReleaseQueue.erase(instant);
 			return true;
 		}
@@ -184,8 +237,8 @@ public:
 				}
 				if (elapsed_time > hold_ms)
 				{
-					_keyToRelease->ProcessEvent(BtnEvent::OnHold, *this, _nameToRelease);
-					_keyToRelease->ProcessEvent(BtnEvent::OnTurbo, *this, _nameToRelease);
+					_keyToRelease->ProcessEvent(BtnEvent::OnHold, *this);
+					_keyToRelease->ProcessEvent(BtnEvent::OnTurbo, *this);
 					_turboCount++;
 				}
 			}
@@ -197,7 +250,7 @@ public:
 				}
 				if (floorf((elapsed_time - hold_ms) / turbo_ms) >= _turboCount)
 				{
-					_keyToRelease->ProcessEvent(BtnEvent::OnTurbo, *this, _nameToRelease);
+					_keyToRelease->ProcessEvent(BtnEvent::OnTurbo, *this);
 					_turboCount++;
 				}
 				if (elapsed_time > hold_ms + _turboCount * turbo_ms + MAGIC_INSTANT_DURATION)
@@ -208,16 +261,16 @@ public:
 		}
 		else // not pressed
 		{
-			_keyToRelease->ProcessEvent(BtnEvent::OnRelease, *this, _nameToRelease);
+			_keyToRelease->ProcessEvent(BtnEvent::OnRelease, *this);
 			if (_turboCount == 0)
 			{
-				_keyToRelease->ProcessEvent(BtnEvent::OnTap, *this, _nameToRelease);
+				_keyToRelease->ProcessEvent(BtnEvent::OnTap, *this);
 				_btnState = BtnState::TapRelease;
 				_press_times = time_now; // Start counting tap duration
 			}
 			else
 			{
-				_keyToRelease->ProcessEvent(BtnEvent::OnHoldRelease, *this, _nameToRelease);
+				_keyToRelease->ProcessEvent(BtnEvent::OnHoldRelease, *this);
 				if (_instantReleaseQueue.empty())
 				{
 					_btnState = BtnState::NoPress;
@@ -232,18 +285,47 @@ public:
 		}
 	}
 
-	Mapping *GetPressMapping()
+	void CompileMappings()
+	{
+		unsigned int revision = _mapping.Revision();
+		if (_baseMapping && revision == _compiledRevision)
+		{
+			return;
+		}
+		_compiledRevision = revision;
+		_baseMapping.reset(new PressMapping{ _mapping.JSMVariable<Mapping>::get(), _mapping.getName() });
+		for (int i = 0; i < MAPPING_SIZE; ++i)
+		{
+			auto chord = _mapping.AtChord(ButtonID(i));
+			_chordMappings[i].reset(chord ? new PressMapping{ chord->get(), _mapping.getName(ButtonID(i)) } : nullptr);
+			auto simPress = _mapping.AtSimPress(ButtonID(i));
+			_simPressMappings[i].reset(simPress ? new PressMapping{ simPress->get(), _mapping.getSimPressName(ButtonID(i)) } : nullptr);
+		}
+		ClearStaleToggles();
+	}
+
+	const PressMapping *GetPressMapping()
 	{
 		if (!_keyToRelease)
 		{
+			CompileMappings();
+			if (!_mapping.HasChords())
+			{
+				_keyToRelease = _baseMapping;
+				return _keyToRelease.get();
+			}
 			// Look at active chord mappings starting with the latest activates chord
 			for (auto activeChord = _common->chordStack.cbegin(); activeChord != _common->chordStack.cend(); activeChord++)
 			{
-				auto binding = _mapping.get(*activeChord);
+				if (*activeChord == ButtonID::NONE)
+				{
+					_keyToRelease = _baseMapping;
+					return _keyToRelease.get();
+				}
+				auto &binding = _chordMappings[int(*activeChord)];
 				if (binding && *activeChord != _id)
 				{
-					_keyToRelease.reset(new Mapping(*binding));
-					_nameToRelease = _mapping.getName(*activeChord);
+					_keyToRelease = binding;
 					return _keyToRelease.get();
 				}
 			}
@@ -260,14 +342,14 @@ public:
 		_gamepadMotion->StartContinuousCalibration();
 	}
 
-	void FinishCalibration()
+	void FinishCalibration(const KeyCode *calibrate)
 	{
 		_gamepadMotion->PauseContinuousCalibration();
 		COUT << "Gyro calibration set" << endl;
-		ClearAllActiveToggle(KeyCode("CALIBRATE"));
+		ClearAllActiveToggle(calibrate);
 	}
 
-	void ApplyGyroAction(KeyCode gyroAction)
+	void ApplyGyroAction(const KeyCode *gyroAction)
 	{
 		_common->gyroActionQueue.push_back({ _id, gyroAction });
 	}
@@ -275,7 +357,7 @@ public:
 	void RemoveGyroAction()
 	{
 		auto gyroAction = find_if(_common->gyroActionQueue.begin(), _common->gyroActionQueue.end(),
-		  [this](auto pair) {
+		  [this](const auto &pair) {
 			  // On a sim press, release the master button (the one who triggered the press)
 			  return pair.first == (_simPressMaster ? _simPressMaster->_id : _id);
 		  });
@@ -291,7 +373,7 @@ public:
 		_common->_rumble(smallRumble, bigRumble);
 	}
 
-	void ApplyBtnPress(KeyCode key)
+	void ApplyBtnPress(const KeyCode &key)
 	{
 		if (key.code >= X_UP && key.code <= X_START || key.code == PS_HOME || key.code == PS_PAD_CLICK)
 		{
@@ -304,35 +386,47 @@ public:
 		}
 	}
 
-	void ApplyBtnRelease(KeyCode key)
+	void ApplyBtnRelease(const KeyCode *key)
 	{
-		if (key.code >= X_UP && key.code <= X_START || key.code == PS_HOME || key.code == PS_PAD_CLICK)
+		if (key->code >= X_UP && key->code <= X_START || key->code == PS_HOME || key->code == PS_PAD_CLICK)
 		{
 			if (_common->_vigemController)
-				_common->_vigemController->setButton(key, false);
+				_common->_vigemController->setButton(*key, false);
 		}
-		else if (key.code != NO_HOLD_MAPPED)
+		else if (key->code != NO_HOLD_MAPPED)
 		{
-			pressKey(key, false);
+			pressKey(*key, false);
 			ClearAllActiveToggle(key);
 		}
 	}
 
-	void ApplyButtonToggle(KeyCode key, function<void(DigitalButton *)> apply, function<void(DigitalButton *)> release)
+	// Returns false if the key is already toggled on by this button, and takes it off the queue.
+	// Not every action run to toggle off releases something that would, like a command.
+	bool ToggleOn(const KeyCode *key)
 	{
-		auto currentlyActive = find_if(_common->activeTogglesQueue.begin(), _common->activeTogglesQueue.end(),
-		  [this, key](pair<ButtonID, KeyCode> pair) {
-			  return pair.first == _id && pair.second == key;
-		  });
+		auto currentlyActive = find(_common->activeTogglesQueue.begin(), _common->activeTogglesQueue.end(), make_pair(_id, key));
 		if (currentlyActive == _common->activeTogglesQueue.end())
 		{
-			apply(this);
-			_common->activeTogglesQueue.push_front({ _id, key });
-		}
-		else
-		{
-			release(this); // The bound action here should always erase the active toggle from the queue
+			_common->activeTogglesQueue.push_back({ _id, key });
+			return true;
 		}
+		_common->activeTogglesQueue.erase(currentlyActive);
+		return false;
+	}
+
+	// Take keys this button toggled on off the queue once none of its mappings toggles them anymore,
+	// otherwise they would stay there for good.
+	void ClearStaleToggles()
+	{
+		auto togglesKey = [](const shared_ptr<const PressMapping> &binding, const KeyCode *key) {
+			return binding && binding->mapping.togglesKey(key);
+		};
+		auto &toggles = _common->activeTogglesQueue;
+		toggles.erase(remove_if(toggles.begin(), toggles.end(), [&](const pair<ButtonID, const KeyCode *> &pair) {
+			return pair.first == _id && !togglesKey(_baseMapping, pair.second) &&
+			  none_of(_chordMappings.begin(), _chordMappings.end(), bind(togglesKey, placeholders::_1, pair.second)) &&
+			  none_of(_simPressMappings.begin(), _simPressMappings.end(), bind(togglesKey, placeholders::_1, pair.second));
+		}), toggles.end());
 	}
 
 	void RegisterInstant(BtnEvent evt)
@@ -341,24 +435,15 @@ public:
 		_instantReleaseQueue.push_back(evt);
 	}
 
-	void ClearAllActiveToggle(KeyCode key)
+	void ClearAllActiveToggle(const KeyCode *key)
 	{
-		std::function<bool(pair<ButtonID, KeyCode>)> isSameKey = [key](pair<ButtonID, KeyCode> pair) {
-			return pair.second == key;
-		};
-
-		for (auto currentlyActive = find_if(_common->activeTogglesQueue.begin(), _common->activeTogglesQueue.end(), isSameKey);
-		     currentlyActive != _common->activeTogglesQueue.end();
-		     currentlyActive = find_if(_common->activeTogglesQueue.begin(), _common->activeTogglesQueue.end(), isSameKey))
-		{
-			_common->activeTogglesQueue.erase(currentlyActive);
-		}
+		auto &toggles = _common->activeTogglesQueue;
+		toggles.erase(remove_if(toggles.begin(), toggles.end(), [key](const pair<ButtonID, const KeyCode *> &pair) { return pair.second == key; }), toggles.end());
 	}
 
 	void SyncSimPress(DigitalButton &btn)
 	{
-		_keyToRelease.reset(new Mapping(*btn._keyToRelease));
-		_nameToRelease = btn._nameToRelease;
+		_keyToRelease = btn._keyToRelease;
 		_simPressMaster = &btn;
 		//COUT << btn << " is the master button" << endl;
 	}
@@ -367,7 +452,6 @@ public:
 	{
 		_keyToRelease.reset();
 		_instantReleaseQueue.clear();
-		_nameToRelease.clear();
 		_turboCount = 0;
 	}
 
@@ -388,12 +472,14 @@ public:
 				{
 					//COUT << "Button " << index << " is released!" << endl;
 					_common->chordStack.erase(foundChord); // The chord is released
+					_common->chordStackRevision++;
 				}
 			}
 			else if (foundChord == _common->chordStack.end())
 			{
 				//COUT << "Button " << index << " is pressed!" << endl;
 				_common->chordStack.push_front(_id); // Always push at the fromt to make it a stack
+				_common->chordStackRevision++;
 			}
 		}
 
@@ -415,7 +501,7 @@ public:
 				else
 				{
 					_btnState = BtnState::BtnPress;
-					GetPressMapping()->ProcessEvent(BtnEvent::OnPress, *this, _nameToRelease);
+					GetPressMapping()->ProcessEvent(BtnEvent::OnPress, *this);
 				}
 			}
 			break;
@@ -429,9 +515,9 @@ public:
 				CheckInstantRelease(BtnEvent::OnRelease);
 				CheckInstantRelease(BtnEvent::OnTap);
 			}
-			if (pressed || GetPressDurationMS(time_now) > _keyToRelease->getTapDuration())
+			if (pressed || GetPressDurationMS(time_now) > _keyToRelease->mapping.getTapDuration())
 			{
-				GetPressMapping()->ProcessEvent(BtnEvent::OnTapRelease, *this, _nameToRelease);
+				GetPressMapping()->ProcessEvent(BtnEvent::OnTapRelease, *this);
 				_btnState = BtnState::NoPress;
 				ClearKey();
 			}
@@ -444,15 +530,15 @@ public:
 			if (pressed && simBtn)
 			{
 				_btnState = BtnState::SimPress;
-				_press_times = time_now;                                                   // Reset Timer
-				_keyToRelease.reset(new Mapping(_mapping.AtSimPress(simBtn->_id)->get())); // Make a copy
-				_nameToRelease = _mapping.getSimPressName(simBtn->_id);
+				_press_times = time_now; // Reset Timer
+				CompileMappings();
+				_keyToRelease = _simPressMappings[int(simBtn->_id)];
 
 				simBtn->_btnState = BtnState::SimPress;
 				simBtn->_press_times = time_now;
 				simBtn->SyncSimPress(*this);
 
-				_keyToRelease->ProcessEvent(BtnEvent::OnPress, *this, _nameToRelease);
+				_keyToRelease->ProcessEvent(BtnEvent::OnPress, *this);
 			}
 			else if (!pressed || GetPressDurationMS(time_now) > sim_press_window)
 			{
@@ -466,7 +552,7 @@ public:
 				else
 				{
 					_btnState = BtnState::BtnPress;
-					GetPressMapping()->ProcessEvent(BtnEvent::OnPress, *this, _nameToRelease);
+					GetPressMapping()->ProcessEvent(BtnEvent::OnPress, *this);
 					//_press_times = time_now;
 				}
 			}
@@ -501,7 +587,7 @@ public:
 		case BtnState::DblPressStart:
 			if (GetPressDurationMS(time_now) > dbl_press_window)
 			{
-				GetPressMapping()->ProcessEvent(BtnEvent::OnPress, *this, _nameToRelease);
+				GetPressMapping()->ProcessEvent(BtnEvent::OnPress, *this);
 				_btnState = BtnState::BtnPress;
 				//_press_times = time_now; // Reset Timer
 			}
@@ -522,15 +608,15 @@ public:
 			{
 				_btnState = BtnState::BtnPress;
 				_press_times = time_now; // Reset Timer to raise a tap
-				GetPressMapping()->ProcessEvent(BtnEvent::OnPress, *this, _nameToRelease);
+				GetPressMapping()->ProcessEvent(BtnEvent::OnPress, *this);
 			}
 			else if (pressed)
 			{
 				_btnState = BtnState::DblPressPress;
 				_press_times = time_now;
-				_keyToRelease.reset(new Mapping(_mapping.getDblPressMap()->second));
-				_nameToRelease = _mapping.getName(_id);
-				_mapping.getDblPressMap()->second.get().ProcessEvent(BtnEvent::OnPress, *this, _nameToRelease);
+				CompileMappings();
+				_keyToRelease = _chordMappings[int(_id)];
+				_keyToRelease->ProcessEvent(BtnEvent::OnPress, *this);
 			}
 			break;
 		case BtnState::DblPressNoPressHold:
@@ -538,15 +624,15 @@ public:
 			{
 				_btnState = BtnState::BtnPress;
 				// Don't reset timer to preserve hold press behaviour
-				GetPressMapping()->ProcessEvent(BtnEvent::OnPress, *this, _nameToRelease);
+				GetPressMapping()->ProcessEvent(BtnEvent::OnPress, *this);
 			}
 			else if (pressed)
 			{
 				_btnState = BtnState::DblPressPress;
 				_press_times = time_now;
-				_keyToRelease.reset(new Mapping(_mapping.getDblPressMap()->second));
-				_nameToRelease = _mapping.getName(_id);
-				_mapping.getDblPressMap()->second.get().ProcessEvent(BtnEvent::OnPress, *this, _nameToRelease);
+				CompileMappings();
+				_keyToRelease = _chordMappings[int(_id)];
+				_keyToRelease->ProcessEvent(BtnEvent::OnPress, *this);
 			}
 			break;
 		case BtnState::DblPressPress:
@@ -572,43 +658,98 @@ public:
 
 ostream &operator<<(ostream &out, Mapping mapping)
 {
-	out << mapping._command;
+	out << mapping.getCommand();
 	return out;
 }
 
+// One key of a mapping with its modifiers: [!^]<key>[\/+'_]
+struct MappingToken
+{
+	char actionModifier = '\0';
+	string_view key;
+	char eventModifier = '\0';
+};
+
+// Reads the next key of a mapping off the front of rest, along with the spaces after it. It splits the mapping
+// the same way as \s*([!\^]?)((\".*?\")|\w*[0-9A-Z]|\W)([\\\/+'_]?)\s*(.*) would, backtracking included.
+// Returns false when that wouldn't match.
+static bool nextMappingToken(string_view &rest, MappingToken &token)
+{
+	auto isWordChar = [](char c) { return isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+	auto isSpace = [](char c) { return isspace(static_cast<unsigned char>(c)) != 0; };
+	// A quoted command, a name ending with a digit or capital letter, or any other single symbol
+	auto readKey = [&](size_t pos) {
+		if (pos >= rest.size())
+			return string_view();
+		if (rest[pos] == '"')
+		{
+			size_t close = rest.find('"', pos + 1);
+			if (close != string_view::npos)
+				return rest.substr(pos, close + 1 - pos);
+		}
+		size_t end = pos;
+		while (end < rest.size() && isWordChar(rest[end]))
+			++end;
+		while (end > pos && !(rest[end - 1] >= '0' && rest[end - 1] <= '9' || rest[end - 1] >= 'A' && rest[end - 1] <= 'Z'))
+			--end;
+		if (end > pos)
+			return rest.substr(pos, end - pos);
+		return isWordChar(rest[pos]) ? string_view() : rest.substr(pos, 1);
+	};
+
+	token = MappingToken();
+	size_t start = 0;
+	while (start < rest.size() && isSpace(rest[start]))
+		++start;
+	if (start < rest.size() && (rest[start] == '!' || rest[start] == '^'))
+	{
+		token.key = readKey(start + 1);
+		if (!token.key.empty())
+			token.actionModifier = rest[start];
+	}
+	if (token.key.empty())
+		token.key = readKey(start); // A lone ! or ^ is a key of its own
+	if (token.key.empty() && start > 0)
+		token.key = rest.substr(start - 1, 1); // So is the last space before something that isn't a key
+	if (token.key.empty())
+		return false;
+	size_t pos = token.key.data() + token.key.size() - rest.data();
+	if (pos < rest.size() && string_view("\\/+'_").find(rest[pos]) != string_view::npos)
+		token.eventModifier = rest[pos++];
+	while (pos < rest.size() && isSpace(rest[pos]))
+		++pos;
+	rest.remove_prefix(pos);
+	return true;
+}
+
 istream &operator>>(istream &in, Mapping &mapping)
 {
 	string valueName(128, '\0');
 	in.getline(&valueName[0], valueName.size());
 	valueName.resize(strlen(valueName.c_str()));
-	smatch results;
 	int count = 0;
 
-	mapping._command = valueName;
 	stringstream ss;
-	const char *rgx = R"(\s*([!\^]?)((\".*?\")|\w*[0-9A-Z]|\W)([\\\/+'_]?)\s*(.*))";
-	while (regex_match(valueName, results, regex(rgx)) && !results[0].str().empty())
+	string_view leftovers(valueName);
+	MappingToken token;
+	while (nextMappingToken(leftovers, token))
 	{
 		if (count > 0)
 			ss << " and ";
-		Mapping::ActionModifier actMod = results[1].str().empty() ? Mapping::ActionModifier::None :
-		  results[1].str()[0] == '!'                              ? Mapping::ActionModifier::Instant :
-		  results[1].str()[0] == '^'                              ? Mapping::ActionModifier::Toggle :
-                                                                    Mapping::ActionModifier::INVALID;
-
-		string keyStr(results[2]);
-
-		Mapping::EventModifier evtMod = results[4].str().empty() ? Mapping::EventModifier::None :
-		  results[4].str()[0] == '\\'                            ? Mapping::EventModifier::StartPress :
-		  results[4].str()[0] == '+'                             ? Mapping::EventModifier::TurboPress :
-		  results[4].str()[0] == '/'                             ? Mapping::EventModifier::ReleasePress :
-		  results[4].str()[0] == '\''                            ? Mapping::EventModifier::TapPress :
-		  results[4].str()[0] == '_'                             ? Mapping::EventModifier::HoldPress :
-                                                                   Mapping::EventModifier::INVALID;
-
-		string leftovers(results[5]);
-
-		KeyCode key(keyStr);
+		Mapping::ActionModifier actMod = token.actionModifier == '\0' ? Mapping::ActionModifier::None :
+		  token.actionModifier == '!'                                 ? Mapping::ActionModifier::Instant :
+		  token.actionModifier == '^'                                 ? Mapping::ActionModifier::Toggle :
+                                                                        Mapping::ActionModifier::INVALID;
+
+		Mapping::EventModifier evtMod = token.eventModifier == '\0' ? Mapping::EventModifier::None :
+		  token.eventModifier == '\\'                                ? Mapping::EventModifier::StartPress :
+		  token.eventModifier == '+'                                 ? Mapping::EventModifier::TurboPress :
+		  token.eventModifier == '/'                                 ? Mapping::EventModifier::ReleasePress :
+		  token.eventModifier == '\''                                ? Mapping::EventModifier::TapPress :
+		  token.eventModifier == '_'                                 ? Mapping::EventModifier::HoldPress :
+                                                                       Mapping::EventModifier::INVALID;
+
+		KeyCode key{ string(token.key) };
 		if (evtMod == Mapping::EventModifier::None)
 		{
 			evtMod = count == 0 ? (leftovers.empty() ? Mapping::EventModifier::StartPress : Mapping::EventModifier::TapPress) :
@@ -653,11 +794,10 @@ istream &operator>>(istream &in, Mapping &mapping)
 				ss << " on " << evtMod;
 			}
 		}
-		valueName = leftovers;
 		count++;
 	} // Next item
 
-	mapping._description = ss.str();
+	mapping._text = make_shared<const Mapping::Text>(Mapping::Text{ move(valueName), ss.str() });
 
 	return in;
 }
@@ -665,7 +805,7 @@ istream &operator>>(istream &in, Mapping &mapping)
 bool operator==(const Mapping &lhs, const Mapping &rhs)
 {
 	// Very flawfull :(
-	return lhs._command == rhs._command;
+	return lhs.getCommand() == rhs.getCommand();
 }
 
 Mapping::Mapping(in_string mapping)
@@ -681,54 +821,140 @@ Mapping::Mapping(in_string mapping)
 void Mapping::ProcessEvent(BtnEvent evt, DigitalButton &button, in_string displayName) const
 {
 	// COUT << button._id << " processes event " << evt << endl;
-	auto entry = _eventMapping.find(evt);
-	if (entry != _eventMapping.end() && entry->second) // Skip over empty entries
+	if (_events & (1 << int(evt))) // Skip over events with no action to run
 	{
-		switch (evt)
+		if (isLogged(LogCategory::BUTTONS))
 		{
-		case BtnEvent::OnPress:
-			COUT << displayName << ": true" << endl;
-			break;
-		case BtnEvent::OnRelease:
-		case BtnEvent::OnHoldRelease:
-			COUT << displayName << ": false" << endl;
-			break;
-		case BtnEvent::OnTap:
-			COUT << displayName << ": tapped" << endl;
-			break;
-		case BtnEvent::OnHold:
-			COUT << displayName << ": held" << endl;
-			break;
-		case BtnEvent::OnTurbo:
-			COUT << displayName << ": turbo" << endl;
-			break;
+			const char *state = nullptr;
+			switch (evt)
+			{
+			case BtnEvent::OnPress:
+				state = "true";
+				break;
+			case BtnEvent::OnRelease:
+			case BtnEvent::OnHoldRelease:
+				state = "false";
+				break;
+			case BtnEvent::OnTap:
+				state = "tapped";
+				break;
+			case BtnEvent::OnHold:
+				state = "held";
+				break;
+			case BtnEvent::OnTurbo:
+				state = "turbo";
+				break;
+			}
+			if (state)
+			{
+				logFormat("%s: %s\n", displayName.c_str(), state);
+			}
 		}
 		//COUT << button._id << " processes event " << evt << endl;
-		if (entry->second)
-			entry->second(&button);
+		for (auto action = _actions.cbegin(); action != _actions.cbegin() + _actionCount; ++action)
+		{
+			if (action->event == uint8_t(evt))
+			{
+				// Toggling the key on comes after applying it, but nothing applied looks at toggles
+				RunAction(action->isToggle && !button.ToggleOn(action->key) ? action->toggleOff : action->op, *action, button);
+			}
+		}
+	}
+}
+
+bool Mapping::togglesKey(const KeyCode *key) const
+{
+	return any_of(_actions.cbegin(), _actions.cbegin() + _actionCount, [key](const Action &action) {
+		return action.isToggle && action.key == key;
+	});
+}
+
+void Mapping::RunAction(Opcode op, const Action &action, DigitalButton &button)
+{
+	switch (op)
+	{
+	case Opcode::PressKey:
+		button.ApplyBtnPress(*action.key);
+		break;
+	case Opcode::ReleaseKey:
+		button.ApplyBtnRelease(action.key);
+		break;
+	case Opcode::StartCalibration:
+		button.StartCalibration();
+		break;
+	case Opcode::FinishCalibration:
+		button.FinishCalibration(action.key);
+		break;
+	case Opcode::ApplyGyroAction:
+		button.ApplyGyroAction(action.key);
+		break;
+	case Opcode::RemoveGyroAction:
+		button.RemoveGyroAction();
+		break;
+	case Opcode::RunCommand:
+		WriteToConsole(action.key->name);
+		break;
+	case Opcode::SetRumble:
+		button.SetRumble(action.rumble[1], action.rumble[0]);
+		break;
+	case Opcode::StopRumble:
+		button.SetRumble(0, 0);
+		break;
+	case Opcode::None:
+		break;
+	}
+	if (action.isInstant)
+	{
+		button.RegisterInstant(BtnEvent(action.event));
+	}
+}
+
+void Mapping::InsertEventMapping(BtnEvent evt, const Action &action)
+{
+	// Run after the actions already there for that event, if any
+	_actions[_actionCount] = action;
+	_actions[_actionCount].event = uint8_t(evt);
+	++_actionCount;
+	if (action.op != Opcode::None)
+	{
+		_events |= 1 << int(evt);
 	}
 }
 
-void Mapping::InsertEventMapping(BtnEvent evt, OnEventAction action)
+// Mappings only point to keys, so that copying them copies no string. Keys are kept until JSM exits.
+static const KeyCode *internKey(const KeyCode &key)
 {
-	auto existingActions = _eventMapping.find(evt);
-	_eventMapping[evt] = existingActions == _eventMapping.end() ? action :
-                                                                  bind(&RunBothActions, placeholders::_1, existingActions->second, action); // Chain with already existing mapping, if any
+	static mutex internLock;
+	static deque<KeyCode> keys; // Growing a deque doesn't move what's in it
+	lock_guard guard(internLock);
+	auto found = find(keys.begin(), keys.end(), key);
+	if (found != keys.end())
+	{
+		return &*found;
+	}
+	keys.push_back(key);
+	return &keys.back();
 }
 
 bool Mapping::AddMapping(KeyCode key, EventModifier evtMod, ActionModifier actMod)
 {
-	OnEventAction apply, release;
+	if (_actionCount + 2 > MAX_ACTIONS)
+	{
+		CERR << "Error: a mapping can't hold more than " << MAX_ACTIONS / 2 << " keys" << endl;
+		return false;
+	}
+	Action apply, release;
+	apply.key = release.key = internKey(key);
 	if (key.code == CALIBRATE)
 	{
-		apply = bind(&DigitalButton::StartCalibration, placeholders::_1);
-		release = bind(&DigitalButton::FinishCalibration, placeholders::_1);
+		apply.op = Opcode::StartCalibration;
+		release.op = Opcode::FinishCalibration;
 		_tapDurationMs = MAGIC_EXTENDED_TAP_DURATION; // Unused in regular press
 	}
 	else if (key.code >= GYRO_INV_X && key.code <= GYRO_TRACKBALL)
 	{
-		apply = bind(&DigitalButton::ApplyGyroAction, placeholders::_1, key);
-		release = bind(&DigitalButton::RemoveGyroAction, placeholders::_1);
+		apply.op = Opcode::ApplyGyroAction;
+		release.op = Opcode::RemoveGyroAction;
 		_tapDurationMs = MAGIC_EXTENDED_TAP_DURATION; // Unused in regular press
 	}
 	else if (key.code == COMMAND_ACTION)
@@ -739,8 +965,8 @@ bool Mapping::AddMapping(KeyCode key, EventModifier evtMod, ActionModifier actMo
 			COUT << "Error: \"" << key.name << "\" is not a valid command" << endl;
 			return false;
 		}
-		apply = bind(&WriteToConsole, key.name);
-		release = OnEventAction();
+		apply.op = Opcode::RunCommand;
+		release.op = Opcode::None;
 	}
 	else if (key.code == RUMBLE)
 	{
@@ -750,15 +976,17 @@ bool Mapping::AddMapping(KeyCode key, EventModifier evtMod, ActionModifier actMo
 			array<UCHAR, 2> bytes;
 		} rumble;
 		rumble.raw = stoi(key.name.substr(1, 4), nullptr, 16);
-		apply = bind(&DigitalButton::SetRumble, placeholders::_1, rumble.bytes[1], rumble.bytes[0]);
-		release = bind(&DigitalButton::SetRumble, placeholders::_1, 0, 0);
+		apply.op = Opcode::SetRumble;
+		apply.rumble[0] = rumble.bytes[0];
+		apply.rumble[1] = rumble.bytes[1];
+		release.op = Opcode::StopRumble;
 		_tapDurationMs = MAGIC_EXTENDED_TAP_DURATION; // Unused in regular press
 	}
 	else // if (key.code != NO_HOLD_MAPPED)
 	{
 		_hasViGEmBtn |= (key.code >= X_UP && key.code <= X_START) || key.code == PS_HOME || key.code == PS_PAD_CLICK; // Set flag if vigem button
-		apply = bind(&DigitalButton::ApplyBtnPress, placeholders::_1, key);
-		release = bind(&DigitalButton::ApplyBtnRelease, placeholders::_1, key);
+		apply.op = Opcode::PressKey;
+		release.op = Opcode::ReleaseKey;
 	}
 
 	BtnEvent applyEvt, releaseEvt;
@@ -792,16 +1020,14 @@ bool Mapping::AddMapping(KeyCode key, EventModifier evtMod, ActionModifier actMo
 	switch (actMod)
 	{
 	case ActionModifier::Toggle:
-		apply = bind(&DigitalButton::ApplyButtonToggle, placeholders::_1, key, apply, release);
-		release = OnEventAction();
+		apply.isToggle = true;
+		apply.toggleOff = release.op;
+		release.op = Opcode::None;
 		break;
 	case ActionModifier::Instant:
-	{
-		OnEventAction action2 = bind(&DigitalButton::RegisterInstant, placeholders::_1, applyEvt);
-		apply = bind(&Mapping::RunBothActions, placeholders::_1, apply, action2);
+		apply.isInstant = true;
 		releaseEvt = BtnEvent::OnInstantRelease;
-	}
-	break;
+		break;
 	case ActionModifier::INVALID:
 		return false;
 		// None applies no modification... Hey!
@@ -813,14 +1039,6 @@ bool Mapping::AddMapping(KeyCode key, EventModifier evtMod, ActionModifier actMo
 	return true;
 }
 
-void Mapping::RunBothActions(DigitalButton *btn, OnEventAction action1, OnEventAction action2)
-{
-	if (action1)
-		action1(btn);
-	if (action2)
-		action2(btn);
-}
-
 class ScrollAxis
 {
 protected:
@@ -872,21 +1090,195 @@ public:
 	}
 };
 
+// Flat copy of every modeshiftable setting, resolved against a controller's chord stack. It is indexed by
+// SettingID so that reading a setting in the callback is a plain load rather than a walk of the chord stack.
+struct ResolvedSettings
+{
+	static constexpr int FIRST = int(SettingID::MIN_GYRO_SENS);
+	static constexpr int SIZE = int(SettingID::VIRTUAL_CONTROLLER) + 1 - FIRST;
+
+	static inline int index(SettingID id)
+	{
+		return int(id) - FIRST;
+	}
+
+	// Index of a setting resolved in the given table. Anything else is an error in the code asking for it.
+	template<typename Exception = invalid_argument>
+	static inline int checkedIndex(SettingID id, const bitset<SIZE> &table, const char *type)
+	{
+		int i = index(id);
+		if (i < 0 || i >= SIZE || !table.test(i))
+		{
+			stringstream ss;
+			ss << "Index " << id << " is not a valid " << type;
+			throw Exception(ss.str().c_str());
+		}
+		return i;
+	}
+
+	void setFloat(SettingID id, float value)
+	{
+		floats[index(id)] = value;
+		isFloat.set(index(id));
+	}
+
+	void setFloatXY(SettingID id, FloatXY value)
+	{
+		floatXYs[index(id)] = value;
+		isFloatXY.set(index(id));
+	}
+
+	array<float, SIZE> floats;
+	array<int, SIZE> enums;
+	array<bool, SIZE> modeshifted; // The enum value comes from an active chord rather than the base value
+	array<FloatXY, SIZE> floatXYs;
+	// Which slots of each table hold a setting
+	bitset<SIZE> isFloat;
+	bitset<SIZE> isEnum;
+	bitset<SIZE> isFloatXY;
+	GyroSettings gyroSettings;
+	Color lightBar;
+};
+
 // An instance of this class represents a single controller device that JSM is listening to.
 class JoyShock
 {
 private:
 	float _weightsRemaining[64];
-	float _flickSamples[64];
-	int _frontSample = 0;
+	SmoothingBuffer _flickSamples;
+
+	SmoothingBuffer _gyroSamplesX;
+	SmoothingBuffer _gyroSamplesY;
+
+	ResolvedSettings _resolved;
+	unsigned int _resolvedRevision = 0;
+	unsigned int _resolvedChordStackRevision = 0;
+	bool _isResolved = false;
 
-	FloatXY _gyroSamples[64];
-	int _frontGyroSample = 0;
+	// Value of the setting for the latest activated chord that has one
+	template<typename T>
+	T resolve(const JSMSetting<T> &setting, bool *modeshifted = nullptr) const
+	{
+		if (!setting.HasChords())
+		{
+			// Nothing to look up on the chord stack
+			if (modeshifted)
+				*modeshifted = false;
+			return *setting.get(ButtonID::NONE);
+		}
+		for (auto activeChord = btnCommon->chordStack.begin(); activeChord != btnCommon->chordStack.end(); activeChord++)
+		{
+			auto opt = setting.get(*activeChord);
+			if (opt)
+			{
+				if (modeshifted)
+					*modeshifted = *activeChord != ButtonID::NONE;
+				return *opt;
+			}
+		}
+		// Chord stack should always include NONE which will provide a value in the loop above
+		throw runtime_error("ChordStack should always include ButtonID::NONE, for the chorded variable to return the base value.");
+	}
+
+	template<typename E>
+	void resolveEnum(const JSMSetting<E> &setting, SettingID id)
+	{
+		int i = ResolvedSettings::index(id);
+		_resolved.enums[i] = int(resolve(setting, &_resolved.modeshifted[i]));
+		_resolved.isEnum.set(i);
+	}
+
+	void resolveSettings()
+	{
+		_resolved.setFloat(SettingID::MIN_GYRO_THRESHOLD, resolve(min_gyro_threshold));
+		_resolved.setFloat(SettingID::MAX_GYRO_THRESHOLD, resolve(max_gyro_threshold));
+		_resolved.setFloat(SettingID::STICK_POWER, resolve(stick_power));
+		_resolved.setFloat(SettingID::REAL_WORLD_CALIBRATION, resolve(real_world_calibration));
+		_resolved.setFloat(SettingID::IN_GAME_SENS, resolve(in_game_sens));
+		_resolved.setFloat(SettingID::TRIGGER_THRESHOLD, resolve(trigger_threshold));
+		_resolved.setFloat(SettingID::STICK_AXIS_X, float(resolve(aim_x_sign)));
+		_resolved.setFloat(SettingID::STICK_AXIS_Y, float(resolve(aim_y_sign)));
+		_resolved.setFloat(SettingID::GYRO_AXIS_X, float(resolve(gyro_x_sign)));
+		_resolved.setFloat(SettingID::GYRO_AXIS_Y, float(resolve(gyro_y_sign)));
+		_resolved.setFloat(SettingID::FLICK_TIME, resolve(flick_time));
+		_resolved.setFloat(SettingID::FLICK_TIME_EXPONENT, resolve(flick_time_exponent));
+		_resolved.setFloat(SettingID::GYRO_SMOOTH_THRESHOLD, resolve(gyro_smooth_threshold));
+		_resolved.setFloat(SettingID::GYRO_SMOOTH_TIME, resolve(gyro_smooth_time));
+		_resolved.setFloat(SettingID::GYRO_CUTOFF_SPEED, resolve(gyro_cutoff_speed));
+		_resolved.setFloat(SettingID::GYRO_CUTOFF_RECOVERY, resolve(gyro_cutoff_recovery));
+		_resolved.setFloat(SettingID::STICK_ACCELERATION_RATE, resolve(stick_acceleration_rate));
+		_resolved.setFloat(SettingID::STICK_ACCELERATION_CAP, resolve(stick_acceleration_cap));
+		_resolved.setFloat(SettingID::LEFT_STICK_DEADZONE_INNER, resolve(left_stick_deadzone_inner));
+		_resolved.setFloat(SettingID::LEFT_STICK_DEADZONE_OUTER, resolve(left_stick_deadzone_outer));
+		_resolved.setFloat(SettingID::RIGHT_STICK_DEADZONE_INNER, resolve(right_stick_deadzone_inner));
+		_resolved.setFloat(SettingID::RIGHT_STICK_DEADZONE_OUTER, resolve(right_stick_deadzone_outer));
+		_resolved.setFloat(SettingID::MOTION_DEADZONE_INNER, resolve(motion_deadzone_inner));
+		_resolved.setFloat(SettingID::MOTION_DEADZONE_OUTER, resolve(motion_deadzone_outer));
+		_resolved.setFloat(SettingID::LEAN_THRESHOLD, resolve(lean_threshold));
+		_resolved.setFloat(SettingID::FLICK_DEADZONE_ANGLE, resolve(flick_deadzone_angle));
+		_resolved.setFloat(SettingID::TRACKBALL_DECAY, resolve(trackball_decay));
+		_resolved.setFloat(SettingID::MOUSE_RING_RADIUS, resolve(mouse_ring_radius));
+		_resolved.setFloat(SettingID::SCREEN_RESOLUTION_X, resolve(screen_resolution_x));
+		_resolved.setFloat(SettingID::SCREEN_RESOLUTION_Y, resolve(screen_resolution_y));
+		_resolved.setFloat(SettingID::ROTATE_SMOOTH_OVERRIDE, resolve(rotate_smooth_override));
+		_resolved.setFloat(SettingID::FLICK_SNAP_STRENGTH, resolve(flick_snap_strength));
+		_resolved.setFloat(SettingID::TRIGGER_SKIP_DELAY, resolve(trigger_skip_delay));
+		_resolved.setFloat(SettingID::TURBO_PERIOD, resolve(turbo_period));
+		_resolved.setFloat(SettingID::HOLD_PRESS_TIME, resolve(hold_press_time));
+		// SIM_PRESS_WINDOW and DBL_PRESS_WINDOW are not chorded, they can be accessed as is.
+
+		resolveEnum(mouse_x_from_gyro, SettingID::MOUSE_X_FROM_GYRO_AXIS);
+		resolveEnum(mouse_y_from_gyro, SettingID::MOUSE_Y_FROM_GYRO_AXIS);
+		resolveEnum(left_stick_mode, SettingID::LEFT_STICK_MODE);
+		resolveEnum(right_stick_mode, SettingID::RIGHT_STICK_MODE);
+		resolveEnum(motion_stick_mode, SettingID::MOTION_STICK_MODE);
+		resolveEnum(left_ring_mode, SettingID::LEFT_RING_MODE);
+		resolveEnum(right_ring_mode, SettingID::RIGHT_RING_MODE);
+		resolveEnum(motion_ring_mode, SettingID::MOTION_RING_MODE);
+		resolveEnum(joycon_gyro_mask, SettingID::JOYCON_GYRO_MASK);
+		resolveEnum(joycon_motion_mask, SettingID::JOYCON_MOTION_MASK);
+		resolveEnum(zrMode, SettingID::ZR_MODE);
+		resolveEnum(zlMode, SettingID::ZL_MODE);
+		resolveEnum(flick_snap_mode, SettingID::FLICK_SNAP_MODE);
+		resolveEnum(controller_orientation, SettingID::CONTROLLER_ORIENTATION);
+		int &orientation = _resolved.enums[ResolvedSettings::index(SettingID::CONTROLLER_ORIENTATION)];
+		if (orientation == int(ControllerOrientation::JOYCON_SIDEWAYS))
+		{
+			if (controller_split_type == JS_SPLIT_TYPE_LEFT)
+			{
+				orientation = int(ControllerOrientation::LEFT);
+			}
+			else if (controller_split_type == JS_SPLIT_TYPE_RIGHT)
+			{
+				orientation = int(ControllerOrientation::RIGHT);
+			}
+			else
+			{
+				orientation = int(ControllerOrientation::FORWARD);
+			}
+		}
+
+		_resolved.setFloatXY(SettingID::MIN_GYRO_SENS, resolve(min_gyro_sens));
+		_resolved.setFloatXY(SettingID::MAX_GYRO_SENS, resolve(max_gyro_sens));
+		_resolved.setFloatXY(SettingID::STICK_SENS, resolve(stick_sens));
+		_resolved.setFloatXY(SettingID::SCROLL_SENS, resolve(scroll_sens));
+
+		_resolved.gyroSettings = resolve(gyro_settings);
+		_resolved.lightBar = resolve(light_bar);
+	}
 
-	template<typename E1, typename E2>
-	static inline optional<E1> GetOptionalSetting(const JSMSetting<E2> &setting, ButtonID chord)
+	// Resolve the settings again if the chord stack or any variable changed since the last time
+	inline const ResolvedSettings &getResolvedSettings()
 	{
-		return setting.get(chord) ? optional<E1>(static_cast<E1>(*setting.get(chord))) : nullopt;
+		unsigned int revision = variablesRevision;
+		if (!_isResolved || revision != _resolvedRevision || btnCommon->chordStackRevision != _resolvedChordStackRevision)
+		{
+			_resolvedRevision = revision;
+			_resolvedChordStackRevision = btnCommon->chordStackRevision;
+			_isResolved = true;
+			resolveSettings();
+		}
+		return _resolved;
 	}
 
 	bool isSoftPullPressed(int triggerIndex, float triggerPosition)
@@ -930,8 +1322,7 @@ private:
 	}
 
 public:
-	const int MaxGyroSamples = 64;
-	const int NumSamples = 64;
+	const int MaxSmoothingSamples = 1024;
 	int handle;
 	GamepadMotion motion;
 	int platform_controller_type;
@@ -946,6 +1337,7 @@ public:
 	float delta_flick = 0.0;
 	float flick_percent_done = 0.0;
 	float flick_rotation_counter = 0.0;
+	float report_interval = 0.f; // Time between reports, smoothed so that smoothing windows don't resize with every bit of jitter
 	FloatXY left_last_cal;
 	FloatXY right_last_cal;
 	FloatXY motion_last_cal;
@@ -985,16 +1377,16 @@ public:
 
 	bool set_neutral_quat = false;
 
-	int numLastGyroSamples = 100;
-	float lastGyroX[100] = { 0.f };
-	float lastGyroY[100] = { 0.f };
+	Trackball trackballX;
+	Trackball trackballY;
+	MouseInterpolator mouseOutput;
+	LatencyStats latency;
 	float lastGyroAbsX = 0.f;
 	float lastGyroAbsY = 0.f;
-	int lastGyroIndexX = 0;
-	int lastGyroIndexY = 0;
 
 	Color _light_bar;
 	pair<uint16_t, uint16_t> last_rumble = { 0, 0 };
+	chrono::steady_clock::time_point last_vigem_notification; // Guarded by btnCommon->callback_lock
 
 	JoyShock(int uniqueHandle, int controllerSplitType, shared_ptr<DigitalButton::Common> sharedButtonCommon = nullptr)
 	  : handle(uniqueHandle)
@@ -1034,7 +1426,10 @@ public:
 
 	void Rumble(int smallRumble, int bigRumble)
 	{
-		COUT << "Rumbling at " << smallRumble << " and " << bigRumble << endl;
+		if (isLogged(LogCategory::RUMBLE))
+		{
+			logFormat("Rumbling at %d and %d\n", smallRumble, bigRumble);
+		}
 		JslSetRumble(handle, smallRumble, bigRumble);
 		last_rumble.first = smallRumble;
 		last_rumble.second = bigRumble;
@@ -1061,12 +1456,14 @@ public:
 
 	void handleViGEmNotification(UCHAR largeMotor, UCHAR smallMotor, Indicator indicator)
 	{
-		static chrono::steady_clock::time_point last_call;
-		auto now = chrono::steady_clock::now();
-		auto diff = ((float)chrono::duration_cast<chrono::microseconds>(now - last_call).count()) / 1000000.0f;
-		last_call = now;
-		COUT_INFO << "Time since last vigem rumble is " << diff << " us" << endl;
 		lock_guard guard(this->btnCommon->callback_lock);
+		auto now = chrono::steady_clock::now();
+		auto diff = ((float)chrono::duration_cast<chrono::microseconds>(now - last_vigem_notification).count()) / 1000000.0f;
+		last_vigem_notification = now;
+		if (isLogged(LogCategory::VIGEM, LogLevel::VERBOSE))
+		{
+			COUT_INFO << "Time since last vigem rumble is " << diff << " us" << endl;
+		}
 		switch (platform_controller_type)
 		{
 		case 4: // SDL_GameControllerType::SDL_CONTROLLER_TYPE_PS4
@@ -1084,279 +1481,70 @@ public:
 	E getSetting(SettingID index)
 	{
 		static_assert(is_enum<E>::value, "Parameter of JoyShock::getSetting<E> has to be an enum type");
-		// Look at active chord mappings starting with the latest activates chord
-		for (auto activeChord = btnCommon->chordStack.begin(); activeChord != btnCommon->chordStack.end(); activeChord++)
+		auto &resolved = getResolvedSettings();
+		int i = ResolvedSettings::checkedIndex(index, resolved.isEnum, "enum setting");
+		E value = static_cast<E>(resolved.enums[i]);
+		switch (index)
 		{
-			optional<E> opt;
-			switch (index)
-			{
-			case SettingID::MOUSE_X_FROM_GYRO_AXIS:
-				opt = GetOptionalSetting<E>(mouse_x_from_gyro, *activeChord);
-				break;
-			case SettingID::MOUSE_Y_FROM_GYRO_AXIS:
-				opt = GetOptionalSetting<E>(mouse_y_from_gyro, *activeChord);
-				break;
-			case SettingID::LEFT_STICK_MODE:
-				opt = GetOptionalSetting<E>(left_stick_mode, *activeChord);
-				if (ignore_left_stick_mode && *activeChord == ButtonID::NONE)
-					opt = optional<E>(static_cast<E>(StickMode::INVALID));
-				else
-					ignore_left_stick_mode |= (opt && *activeChord != ButtonID::NONE);
-				break;
-			case SettingID::RIGHT_STICK_MODE:
-				opt = GetOptionalSetting<E>(right_stick_mode, *activeChord);
-				if (ignore_right_stick_mode && *activeChord == ButtonID::NONE)
-					opt = optional<E>(static_cast<E>(StickMode::INVALID));
-				else
-					ignore_right_stick_mode |= (opt && *activeChord != ButtonID::NONE);
-				break;
-			case SettingID::MOTION_STICK_MODE:
-				opt = GetOptionalSetting<E>(motion_stick_mode, *activeChord);
-				if (ignore_motion_stick_mode && *activeChord == ButtonID::NONE)
-					opt = optional<E>(static_cast<E>(StickMode::INVALID));
-				else
-					ignore_motion_stick_mode |= (opt && *activeChord != ButtonID::NONE);
-				break;
-			case SettingID::LEFT_RING_MODE:
-				opt = GetOptionalSetting<E>(left_ring_mode, *activeChord);
-				break;
-			case SettingID::RIGHT_RING_MODE:
-				opt = GetOptionalSetting<E>(right_ring_mode, *activeChord);
-				break;
-			case SettingID::MOTION_RING_MODE:
-				opt = GetOptionalSetting<E>(motion_ring_mode, *activeChord);
-				break;
-			case SettingID::JOYCON_GYRO_MASK:
-				opt = GetOptionalSetting<E>(joycon_gyro_mask, *activeChord);
-				break;
-			case SettingID::JOYCON_MOTION_MASK:
-				opt = GetOptionalSetting<E>(joycon_motion_mask, *activeChord);
-				break;
-			case SettingID::CONTROLLER_ORIENTATION:
-				opt = GetOptionalSetting<E>(controller_orientation, *activeChord);
-				if (opt && int(*opt) == int(ControllerOrientation::JOYCON_SIDEWAYS))
-				{
-					if (controller_split_type == JS_SPLIT_TYPE_LEFT)
-					{
-						opt = optional<E>(static_cast<E>(ControllerOrientation::LEFT));
-					}
-					else if (controller_split_type == JS_SPLIT_TYPE_RIGHT)
-					{
-						opt = optional<E>(static_cast<E>(ControllerOrientation::RIGHT));
-					}
-					else
-					{
-						opt = optional<E>(static_cast<E>(ControllerOrientation::FORWARD));
-					}
-				}
-				break;
-			case SettingID::ZR_MODE:
-				opt = GetOptionalSetting<E>(zrMode, *activeChord);
-				break;
-			case SettingID::ZL_MODE:
-				opt = GetOptionalSetting<E>(zlMode, *activeChord);
-				break;
-			case SettingID::FLICK_SNAP_MODE:
-				opt = GetOptionalSetting<E>(flick_snap_mode, *activeChord);
-				break;
-			}
-			if (opt)
-				return *opt;
+		case SettingID::LEFT_STICK_MODE:
+			return applyStickModeIgnore(value, resolved.modeshifted[i], ignore_left_stick_mode);
+		case SettingID::RIGHT_STICK_MODE:
+			return applyStickModeIgnore(value, resolved.modeshifted[i], ignore_right_stick_mode);
+		case SettingID::MOTION_STICK_MODE:
+			return applyStickModeIgnore(value, resolved.modeshifted[i], ignore_motion_stick_mode);
 		}
-		stringstream ss;
-		ss << "Index " << index << " is not a valid enum setting";
-		throw invalid_argument(ss.str().c_str());
+		return value;
 	}
 
-	float getSetting(SettingID index)
+	// A modeshifted stick mode sets the ignore flag, which turns the base stick mode into INVALID until the
+	// stick returns to neutral.
+	template<typename E>
+	static inline E applyStickModeIgnore(E value, bool modeshifted, bool &ignoreStickMode)
 	{
-		// Look at active chord mappings starting with the latest activates chord
-		for (auto activeChord = btnCommon->chordStack.begin(); activeChord != btnCommon->chordStack.end(); activeChord++)
+		if (modeshifted)
 		{
-			optional<float> opt;
-			switch (index)
-			{
-			case SettingID::MIN_GYRO_THRESHOLD:
-				opt = min_gyro_threshold.get(*activeChord);
-				break;
-			case SettingID::MAX_GYRO_THRESHOLD:
-				opt = max_gyro_threshold.get(*activeChord);
-				break;
-			case SettingID::STICK_POWER:
-				opt = stick_power.get(*activeChord);
-				break;
-			case SettingID::REAL_WORLD_CALIBRATION:
-				opt = real_world_calibration.get(*activeChord);
-				break;
-			case SettingID::IN_GAME_SENS:
-				opt = in_game_sens.get(*activeChord);
-				break;
-			case SettingID::TRIGGER_THRESHOLD:
-				opt = trigger_threshold.get(*activeChord);
-				break;
-			case SettingID::STICK_AXIS_X:
-				opt = GetOptionalSetting<float>(aim_x_sign, *activeChord);
-				break;
-			case SettingID::STICK_AXIS_Y:
-				opt = GetOptionalSetting<float>(aim_y_sign, *activeChord);
-				break;
-			case SettingID::GYRO_AXIS_X:
-				opt = GetOptionalSetting<float>(gyro_x_sign, *activeChord);
-				break;
-			case SettingID::GYRO_AXIS_Y:
-				opt = GetOptionalSetting<float>(gyro_y_sign, *activeChord);
-				break;
-			case SettingID::FLICK_TIME:
-				opt = flick_time.get(*activeChord);
-				break;
-			case SettingID::FLICK_TIME_EXPONENT:
-				opt = flick_time_exponent.get(*activeChord);
-				break;
-			case SettingID::GYRO_SMOOTH_THRESHOLD:
-				opt = gyro_smooth_threshold.get(*activeChord);
-				break;
-			case SettingID::GYRO_SMOOTH_TIME:
-				opt = gyro_smooth_time.get(*activeChord);
-				break;
-			case SettingID::GYRO_CUTOFF_SPEED:
-				opt = gyro_cutoff_speed.get(*activeChord);
-				break;
-			case SettingID::GYRO_CUTOFF_RECOVERY:
-				opt = gyro_cutoff_recovery.get(*activeChord);
-				break;
-			case SettingID::STICK_ACCELERATION_RATE:
-				opt = stick_acceleration_rate.get(*activeChord);
-				break;
-			case SettingID::STICK_ACCELERATION_CAP:
-				opt = stick_acceleration_cap.get(*activeChord);
-				break;
-			case SettingID::LEFT_STICK_DEADZONE_INNER:
-				opt = left_stick_deadzone_inner.get(*activeChord);
-				break;
-			case SettingID::LEFT_STICK_DEADZONE_OUTER:
-				opt = left_stick_deadzone_outer.get(*activeChord);
-				break;
-			case SettingID::RIGHT_STICK_DEADZONE_INNER:
-				opt = right_stick_deadzone_inner.get(*activeChord);
-				break;
-			case SettingID::RIGHT_STICK_DEADZONE_OUTER:
-				opt = right_stick_deadzone_outer.get(*activeChord);
-				break;
-			case SettingID::MOTION_DEADZONE_INNER:
-				opt = motion_deadzone_inner.get(*activeChord);
-				break;
-			case SettingID::MOTION_DEADZONE_OUTER:
-				opt = motion_deadzone_outer.get(*activeChord);
-				break;
-			case SettingID::LEAN_THRESHOLD:
-				opt = lean_threshold.get(*activeChord);
-				break;
-			case SettingID::FLICK_DEADZONE_ANGLE:
-				opt = flick_deadzone_angle.get(*activeChord);
-				break;
-			case SettingID::TRACKBALL_DECAY:
-				opt = trackball_decay.get(*activeChord);
-				break;
-			case SettingID::MOUSE_RING_RADIUS:
-				opt = mouse_ring_radius.get(*activeChord);
-				break;
-			case SettingID::SCREEN_RESOLUTION_X:
-				opt = screen_resolution_x.get(*activeChord);
-				break;
-			case SettingID::SCREEN_RESOLUTION_Y:
-				opt = screen_resolution_y.get(*activeChord);
-				break;
-			case SettingID::ROTATE_SMOOTH_OVERRIDE:
-				opt = rotate_smooth_override.get(*activeChord);
-				break;
-			case SettingID::FLICK_SNAP_STRENGTH:
-				opt = flick_snap_strength.get(*activeChord);
-				break;
-			case SettingID::TRIGGER_SKIP_DELAY:
-				opt = trigger_skip_delay.get(*activeChord);
-				break;
-			case SettingID::TURBO_PERIOD:
-				opt = turbo_period.get(*activeChord);
-				break;
-			case SettingID::HOLD_PRESS_TIME:
-				opt = hold_press_time.get(*activeChord);
-				break;
-				// SIM_PRESS_WINDOW and DBL_PRESS_WINDOW are not chorded, they can be accessed as is.
-			}
-			if (opt)
-				return *opt;
+			ignoreStickMode = true;
+			return value;
 		}
+		return ignoreStickMode ? static_cast<E>(StickMode::INVALID) : value;
+	}
 
-		std::stringstream message;
-		message << "Index " << index << " is not a valid float setting";
-		throw std::out_of_range(message.str().c_str());
+	float getSetting(SettingID index)
+	{
+		auto &resolved = getResolvedSettings();
+		return resolved.floats[ResolvedSettings::checkedIndex<out_of_range>(index, resolved.isFloat, "float setting")];
 	}
 
 	template<>
 	FloatXY getSetting<FloatXY>(SettingID index)
 	{
-		// Look at active chord mappings starting with the latest activates chord
-		for (auto activeChord = btnCommon->chordStack.begin(); activeChord != btnCommon->chordStack.end(); activeChord++)
-		{
-			optional<FloatXY> opt;
-			switch (index)
-			{
-			case SettingID::MIN_GYRO_SENS:
-				opt = min_gyro_sens.get(*activeChord);
-				break;
-			case SettingID::MAX_GYRO_SENS:
-				opt = max_gyro_sens.get(*activeChord);
-				break;
-			case SettingID::STICK_SENS:
-				opt = stick_sens.get(*activeChord);
-				break;
-			case SettingID::SCROLL_SENS:
-				opt = scroll_sens.get(*activeChord);
-				break;
-			}
-			if (opt)
-				return *opt;
-		} // Check next Chord
-
-		stringstream ss;
-		ss << "Index " << index << " is not a valid FloatXY setting";
-		throw invalid_argument(ss.str().c_str());
+		auto &resolved = getResolvedSettings();
+		return resolved.floatXYs[ResolvedSettings::checkedIndex(index, resolved.isFloatXY, "FloatXY setting")];
 	}
 
 	template<>
 	GyroSettings getSetting<GyroSettings>(SettingID index)
 	{
-		if (index == SettingID::GYRO_ON || index == SettingID::GYRO_OFF)
+		// GYRO_ON and GYRO_OFF are the same setting
+		if (index != SettingID::GYRO_ON && index != SettingID::GYRO_OFF)
 		{
-			// Look at active chord mappings starting with the latest activates chord
-			for (auto activeChord = btnCommon->chordStack.begin(); activeChord != btnCommon->chordStack.end(); activeChord++)
-			{
-				auto opt = gyro_settings.get(*activeChord);
-				if (opt)
-					return *opt;
-			}
+			stringstream ss;
+			ss << "Index " << index << " is not a valid GyroSetting";
+			throw invalid_argument(ss.str().c_str());
 		}
-		stringstream ss;
-		ss << "Index " << index << " is not a valid GyroSetting";
-		throw invalid_argument(ss.str().c_str());
+		return getResolvedSettings().gyroSettings;
 	}
 
 	template<>
 	Color getSetting<Color>(SettingID index)
 	{
-		if (index == SettingID::LIGHT_BAR)
+		if (index != SettingID::LIGHT_BAR)
 		{
-			// Look at active chord mappings starting with the latest activates chord
-			for (auto activeChord = btnCommon->chordStack.begin(); activeChord != btnCommon->chordStack.end(); activeChord++)
-			{
-				auto opt = light_bar.get(*activeChord);
-				if (opt)
-					return *opt;
-			}
+			stringstream ss;
+			ss << "Index " << index << " is not a valid Color";
+			throw invalid_argument(ss.str().c_str());
 		}
-		stringstream ss;
-		ss << "Index " << index << " is not a valid Color";
-		throw invalid_argument(ss.str().c_str());
+		return getResolvedSettings().lightBar;
 	}
 
 public:
@@ -1379,19 +1567,11 @@ public:
 
 	void ResetSmoothSample()
 	{
-		_frontSample = 0;
-		for (int i = 0; i < NumSamples; i++)
-		{
-			_flickSamples[i] = 0.0;
-		}
+		_flickSamples.Clear();
 	}
 
 	float GetSmoothedStickRotation(float value, float bottomThreshold, float topThreshold, int maxSamples)
 	{
-		// which sample in the circular smoothing buffer do we want to write over?
-		_frontSample--;
-		if (_frontSample < 0)
-			_frontSample = NumSamples - 1;
 		// if this input is bigger than the top threshold, it'll all be consumed immediately; 0 gets put into the smoothing buffer. If it's below the bottomThreshold, it'll all be put in the smoothing buffer
 		float length = abs(value);
 		float immediateFactor;
@@ -1414,26 +1594,15 @@ public:
 		}
 		float smoothFactor = 1.0f - immediateFactor;
 		// now we can push the smooth sample (or as much of it as we want smoothed)
-		float frontSample = _flickSamples[_frontSample] = value * smoothFactor;
-		// and now calculate smoothed result
-		float result = frontSample / maxSamples;
-		for (int i = 1; i < maxSamples; i++)
-		{
-			int rotatedIndex = (_frontSample + i) % NumSamples;
-			frontSample = _flickSamples[rotatedIndex];
-			result += frontSample / maxSamples;
-		}
-		// finally, add immediate portion
-		return result + value * immediateFactor;
+		_flickSamples.SetWindow(maxSamples);
+		_flickSamples.Push(value * smoothFactor);
+		// finally, add immediate portion to the smoothed result
+		return _flickSamples.Average() + value * immediateFactor;
 	}
 
 	void GetSmoothedGyro(float x, float y, float length, float bottomThreshold, float topThreshold, int maxSamples, float &outX, float &outY)
 	{
-		// this is basically the same as we use for smoothing flick-stick rotations, but because this deals in vectors, it's a slightly different function. Not worth abstracting until it'll be used in more ways
-		// which item in the circular smoothing buffer will we write over?
-		_frontGyroSample--;
-		if (_frontGyroSample < 0)
-			_frontGyroSample = MaxGyroSamples - 1;
+		// this is basically the same as we use for smoothing flick-stick rotations, but applied to each axis of the vector
 		float immediateFactor;
 		if (topThreshold <= bottomThreshold)
 		{
@@ -1454,20 +1623,13 @@ public:
 		}
 		float smoothFactor = 1.0f - immediateFactor;
 		// now we can push the smooth sample (or as much of it as we want smoothed)
-		FloatXY frontSample = _gyroSamples[_frontGyroSample] = { x * smoothFactor, y * smoothFactor };
-		// and now calculate smoothed result
-		float xResult = frontSample.x() / maxSamples;
-		float yResult = frontSample.y() / maxSamples;
-		for (int i = 1; i < maxSamples; i++)
-		{
-			int rotatedIndex = (_frontGyroSample + i) % MaxGyroSamples;
-			frontSample = _gyroSamples[rotatedIndex];
-			xResult += frontSample.x() / maxSamples;
-			yResult += frontSample.y() / maxSamples;
-		}
-		// finally, add immediate portion
-		outX = xResult + x * immediateFactor;
-		outY = yResult + y * immediateFactor;
+		_gyroSamplesX.SetWindow(maxSamples);
+		_gyroSamplesY.SetWindow(maxSamples);
+		_gyroSamplesX.Push(x * smoothFactor);
+		_gyroSamplesY.Push(y * smoothFactor);
+		// finally, add immediate portion to the smoothed result
+		outX = _gyroSamplesX.Average() + x * immediateFactor;
+		outY = _gyroSamplesY.Average() + y * immediateFactor;
 	}
 
 	inline DigitalButton *GetButton(ButtonID index)
@@ -1795,9 +1957,8 @@ static void resetAllMappings()
 	autoloadSwitch.Reset();
 	hide_minimized.Reset();
 	virtual_controller.Reset();
-
-	os_mouse_speed = 1.0f;
-	last_flick_and_rotation = 0.0f;
+	os_mouse_speed.Reset();
+	last_flick_and_rotation.Reset();
 }
 
 // Convert number to bitmap
@@ -1809,9 +1970,15 @@ constexpr int PlayerNumber(size_t n)
 	return i;
 }
 
+void publishJoyShocks()
+{
+	atomic_store(&tick_joyshocks, shared_ptr<const unordered_map<int, shared_ptr<JoyShock>>>(make_shared<unordered_map<int, shared_ptr<JoyShock>>>(handle_to_joyshock)));
+}
+
 void connectDevices(bool mergeJoycons = true)
 {
 	handle_to_joyshock.clear();
+	publishJoyShocks();
 	int numConnected = JslConnectDevices();
 	vector<int> deviceHandles(numConnected, 0);
 	if (numConnected > 0)
@@ -1839,6 +2006,7 @@ void connectDevices(bool mergeJoycons = true)
 			handle_to_joyshock[handle] = js;
 		}
 	}
+	publishJoyShocks();
 
 	if (numConnected == 1)
 	{
@@ -1902,6 +2070,207 @@ bool do_RECONNECT_CONTROLLERS(in_string arguments)
 	return false;
 }
 
+bool do_LOG_LEVEL(in_string arguments)
+{
+	if (arguments.empty())
+	{
+		for (int i = 0; i < int(LogCategory::INVALID); ++i)
+		{
+			COUT << LogCategory(i) << " = " << logLevels[i].load() << endl;
+		}
+		return true;
+	}
+	stringstream ss(arguments);
+	string first, second;
+	ss >> first >> second;
+	auto level = magic_enum::enum_cast<LogLevel>(second.empty() ? first : second);
+	if (!level || *level == LogLevel::INVALID)
+	{
+		return false;
+	}
+	if (second.empty())
+	{
+		for (int i = 0; i < int(LogCategory::INVALID); ++i)
+		{
+			setLogLevel(LogCategory(i), *level);
+		}
+		COUT << "All log categories set to " << *level << endl;
+		return true;
+	}
+	auto category = magic_enum::enum_cast<LogCategory>(first);
+	if (!category || *category == LogCategory::INVALID)
+	{
+		return false;
+	}
+	setLogLevel(*category, *level);
+	COUT << *category << " log level set to " << *level << endl;
+	return true;
+}
+
+bool do_STATS(in_string arguments)
+{
+	if (arguments.compare("RESET") == 0)
+	{
+		for (auto &pair : handle_to_joyshock)
+		{
+			pair.second->latency.Reset();
+		}
+#ifdef JSM_SDL_BACKEND
+		JslResetTickStats();
+#endif
+		COUT << "Latency statistics cleared" << endl;
+		return true;
+	}
+	if (!arguments.empty())
+	{
+		return false;
+	}
+	if (handle_to_joyshock.empty())
+	{
+		COUT << "No controller is connected" << endl;
+		return true;
+	}
+	auto toMicroseconds = [](uint64_t nanoseconds) { return nanoseconds / 1000.f; };
+#ifdef JSM_SDL_BACKEND
+	COUT << "Ticks every " << fixed << setprecision(1) << JslGetTickPeriod() * 1e6f << " microseconds on average for a TICK_TIME of "
+	     << tick_time.get() * 1000.f << ", " << JslGetTickOverruns() << " ticks missed" << endl;
+#endif
+	for (auto &pair : handle_to_joyshock)
+	{
+		COUT << "Controller " << pair.first << " (microseconds: p50 / p99 / max over count)" << endl;
+		for (int i = 0; i < int(LatencyStage::INVALID); ++i)
+		{
+			auto &histogram = pair.second->latency[LatencyStage(i)];
+			if (histogram.Count() > 0)
+			{
+				COUT_INFO << "    " << left << setw(12) << LatencyStage(i) << right << fixed << setprecision(1)
+				          << setw(10) << toMicroseconds(histogram.Percentile(0.5)) << " /"
+				          << setw(10) << toMicroseconds(histogram.Percentile(0.99)) << " /"
+				          << setw(10) << toMicroseconds(histogram.Max()) << " over " << histogram.Count() << endl;
+			}
+		}
+	}
+	return true;
+}
+
+bool do_RECORD(in_string arguments)
+{
+	if (arguments.empty() || arguments.compare("OFF") == 0)
+	{
+		if (!tickRecorder.IsRecording())
+		{
+			COUT << "Not recording" << endl;
+			return true;
+		}
+		tickRecorder.Stop();
+		COUT << "Recorded " << tickRecorder.GetTickCount() << " controller reports" << endl;
+		return true;
+	}
+	string path;
+	stringstream(arguments) >> quoted(path);
+	if (!tickRecorder.Start(path))
+	{
+		CERR << "Can't create the file \"" << path << "\"" << endl;
+		return true;
+	}
+	COUT << "Recording controller input to \"" << path << "\". Enter RECORD OFF to stop." << endl;
+	return true;
+}
+
+bool replayRecording(in_string recordingPath, ostream *capture, float warmupSeconds = numeric_limits<float>::infinity());
+
+bool do_REPLAY(in_string arguments)
+{
+	string recordingPath, capturePath;
+	stringstream ss(arguments);
+	ss >> quoted(recordingPath) >> quoted(capturePath);
+	if (recordingPath.empty())
+	{
+		return false;
+	}
+	if (capturePath.empty())
+	{
+		replayRecording(recordingPath, nullptr);
+		return true;
+	}
+	ofstream capture(capturePath);
+	if (!capture)
+	{
+		CERR << "Can't create the file \"" << capturePath << "\"" << endl;
+		return true;
+	}
+	replayRecording(recordingPath, &capture);
+	return true;
+}
+
+// Holding the callback lock of every controller keeps ticks from seeing a configuration half applied
+vector<unique_lock<mutex>> pauseTicks()
+{
+	vector<mutex *> locks;
+	for (auto &pair : handle_to_joyshock)
+	{
+		locks.push_back(&pair.second->btnCommon->callback_lock);
+	}
+	// Joycons share theirs. Always locking in the same order keeps two callers from waiting on each other.
+	sort(locks.begin(), locks.end());
+	locks.erase(unique(locks.begin(), locks.end()), locks.end());
+	vector<unique_lock<mutex>> paused;
+	for (auto lock : locks)
+	{
+		paused.emplace_back(*lock);
+	}
+	return paused;
+}
+
+// Profiles are applied with ticks paused. Buttons keep their state: they only get new mappings the next time
+// they're pressed or released.
+void applyPaused(const function<void()> &apply)
+{
+	auto paused = pauseTicks();
+	apply();
+}
+
+bool do_WATCH(CmdRegistry *registry, in_string arguments)
+{
+	if (arguments.empty())
+	{
+		if (watchedConfig.empty())
+		{
+			COUT << "Not watching any configuration" << endl;
+		}
+		else
+		{
+			COUT << "Watching ";
+			COUT_INFO << watchedConfig;
+			COUT << " for changes" << endl;
+		}
+		return true;
+	}
+	if (arguments.compare("OFF") == 0)
+	{
+		watchedConfig.clear();
+		watchedProfiles.Clear();
+		COUT << "Stopped watching configuration changes" << endl;
+		return true;
+	}
+	string path;
+	stringstream(arguments) >> quoted(path);
+	watchedProfiles.Clear();
+	watchedProfiles.Load(*registry, path, &applyPaused);
+	if (watchedProfiles.Files(path).empty())
+	{
+		// Loading already said what went wrong
+		watchedConfig.clear();
+		return true;
+	}
+	watchedConfig = path;
+	watchThread->Start();
+	COUT << "Changes to ";
+	COUT_INFO << path;
+	COUT << " will be applied as soon as they are saved. Enter WATCH OFF to stop." << endl;
+	return true;
+}
+
 bool do_COUNTER_OS_MOUSE_SPEED()
 {
 	COUT << "Countering OS mouse speed setting" << endl;
@@ -1955,13 +2324,13 @@ bool do_CALCULATE_REAL_WORLD_CALIBRATION(in_string argument)
 	{
 		COUT << "Can't calculate calibration from zero rotations" << endl;
 	}
-	else if (last_flick_and_rotation == 0)
+	else if (last_flick_and_rotation.get() == 0)
 	{
 		COUT << "Need to use the flick stick at least once before calculating an appropriate calibration value" << endl;
 	}
 	else
 	{
-		COUT << "Recommendation: REAL_WORLD_CALIBRATION = " << setprecision(5) << (*real_world_calibration.get() * last_flick_and_rotation / numRotations) << endl;
+		COUT << "Recommendation: REAL_WORLD_CALIBRATION = " << setprecision(5) << (*real_world_calibration.get() * last_flick_and_rotation.get() / numRotations) << endl;
 	}
 	return true;
 }
@@ -2073,7 +2442,7 @@ bool do_WHITELIST_REMOVE()
 	return true;
 }
 
-static float handleFlickStick(float calX, float calY, float lastCalX, float lastCalY, float stickLength, bool &isFlicking, shared_ptr<JoyShock> jc, float mouseCalibrationFactor, bool FLICK_ONLY, bool ROTATE_ONLY)
+static float handleFlickStick(float calX, float calY, float lastCalX, float lastCalY, float stickLength, bool &isFlicking, shared_ptr<JoyShock> jc, float mouseCalibrationFactor, float deltaTime, bool FLICK_ONLY, bool ROTATE_ONLY)
 {
 	float camSpeedX = 0.0f;
 	// let's centre this
@@ -2119,13 +2488,15 @@ static float handleFlickStick(float calX, float calY, float lastCalX, float last
 					stickAngle = 0.0f;
 				}
 
-				jc->started_flick = chrono::steady_clock::now();
+				jc->started_flick = jc->time_now;
 				jc->delta_flick = stickAngle;
 				jc->flick_percent_done = 0.0f;
 				jc->ResetSmoothSample();
 				jc->flick_rotation_counter = stickAngle; // track all rotation for this flick
-				// TODO: All these printfs should be hidden behind a setting. User might not want them.
-				COUT << "Flick: " << setprecision(3) << stickAngle * (180.0f / (float)PI) << " degrees" << endl;
+				if (isLogged(LogCategory::FLICK))
+				{
+					logFormat("Flick: %.3g degrees\n", stickAngle * (180.0f / (float)PI));
+				}
 			}
 		}
 		else
@@ -2143,7 +2514,7 @@ static float handleFlickStick(float calX, float calY, float lastCalX, float last
 				jc->flick_rotation_counter += angleChange; // track all rotation for this flick
 				float flickSpeedConstant = jc->getSetting(SettingID::REAL_WORLD_CALIBRATION) * mouseCalibrationFactor / jc->getSetting(SettingID::IN_GAME_SENS);
 				float flickSpeed = -(angleChange * flickSpeedConstant);
-				int maxSmoothingSamples = min(jc->NumSamples, (int)(64.0f * tick_time.get())); // target a max smoothing window size of 64ms
+				int maxSmoothingSamples = jc->report_interval > 0.f ? clamp((int)(0.064f / jc->report_interval), 1, jc->MaxSmoothingSamples) : 1; // target a max smoothing window size of 64ms
 				float stepSize = 0.01f;                                                        // and we only want full on smoothing when the stick change each time we poll it is approximately the minimum stick resolution
 				                                                                               // the fact that we're using radians makes this really easy
 				auto rotate_smooth_override = jc->getSetting(SettingID::ROTATE_SMOOTH_OVERRIDE);
@@ -2268,7 +2639,7 @@ void processStick(shared_ptr<JoyShock> jc, float stickX, float stickY, float las
 	}
 	else if (stickMode == StickMode::FLICK || flickOnly || rotateOnly)
 	{
-		camSpeedX += handleFlickStick(stickX, stickY, lastX, lastY, stickLength, isFlicking, jc, mouseCalibrationFactor, flickOnly, rotateOnly);
+		camSpeedX += handleFlickStick(stickX, stickY, lastX, lastY, stickLength, isFlicking, jc, mouseCalibrationFactor, deltaTime, flickOnly, rotateOnly);
 		anyStickInput = pegged;
 	}
 	else if (stickMode == StickMode::AIM)
@@ -2284,8 +2655,8 @@ void processStick(shared_ptr<JoyShock> jc, float stickX, float stickY, float las
 			anyStickInput = true;
 			float warpedStickLengthX = pow(stickLength, jc->getSetting(SettingID::STICK_POWER));
 			float warpedStickLengthY = warpedStickLengthX;
-			warpedStickLengthX *= jc->getSetting<FloatXY>(SettingID::STICK_SENS).first * jc->getSetting(SettingID::REAL_WORLD_CALIBRATION) / os_mouse_speed / jc->getSetting(SettingID::IN_GAME_SENS);
-			warpedStickLengthY *= jc->getSetting<FloatXY>(SettingID::STICK_SENS).second * jc->getSetting(SettingID::REAL_WORLD_CALIBRATION) / os_mouse_speed / jc->getSetting(SettingID::IN_GAME_SENS);
+			warpedStickLengthX *= jc->getSetting<FloatXY>(SettingID::STICK_SENS).first * jc->getSetting(SettingID::REAL_WORLD_CALIBRATION) / os_mouse_speed.get() / jc->getSetting(SettingID::IN_GAME_SENS);
+			warpedStickLengthY *= jc->getSetting<FloatXY>(SettingID::STICK_SENS).second * jc->getSetting(SettingID::REAL_WORLD_CALIBRATION) / os_mouse_speed.get() / jc->getSetting(SettingID::IN_GAME_SENS);
 			camSpeedX += stickX / stickLength * warpedStickLengthX * acceleration * deltaTime;
 			camSpeedY += stickY / stickLength * warpedStickLengthY * acceleration * deltaTime;
 			if (pegged)
@@ -2387,25 +2758,54 @@ void processStick(shared_ptr<JoyShock> jc, float stickX, float stickY, float las
 	}
 }
 
-void joyShockPollCallback(int jcHandle, JOY_SHOCK_STATE state, JOY_SHOCK_STATE lastState, IMU_STATE imuState, IMU_STATE lastImuState, float deltaTime)
+// Run one report of a controller through the whole mapping pipeline. timeNow is when the report is considered received.
+void processTick(shared_ptr<JoyShock> jc, const TickInput &input, chrono::steady_clock::time_point timeNow)
 {
-
-	shared_ptr<JoyShock> jc = handle_to_joyshock[jcHandle];
-	if (jc == nullptr)
-		return;
-
-	auto timeNow = chrono::steady_clock::now();
-	deltaTime = ((float)chrono::duration_cast<chrono::microseconds>(timeNow - jc->time_now).count()) / 1000000.0f;
+	const JOY_SHOCK_STATE &state = input.state;
+	float deltaTime = input.deltaTime;
+	// The first report's deltaTime counts from when time_now was never set, so it says nothing of the report rate
+	bool firstReport = jc->time_now == chrono::steady_clock::time_point();
 	jc->time_now = timeNow;
+	if (deltaTime > 0.f && !firstReport)
+	{
+		jc->report_interval = jc->report_interval > 0.f ? jc->report_interval + (deltaTime - jc->report_interval) * 0.05f : deltaTime;
+	}
 
 	GamepadMotion &motion = jc->motion;
 
-	IMU_STATE imu = JslGetIMUState(jc->handle);
-
-	motion.ProcessMotion(imu.gyroX, imu.gyroY, imu.gyroZ, imu.accelX, imu.accelY, imu.accelZ, deltaTime);
+	const IMU_SAMPLE *imuSamples = input.imuSamples;
+	int numImuSamples = input.numImuSamples;
 
+	// Integrate every sample the controller sent with its own timing, and use their average rotation speed
+	// so that fast flicks between two callbacks aren't lost. When no new sample arrived, keep the last speed.
 	float inGyroX, inGyroY, inGyroZ;
 	motion.GetCalibratedGyro(inGyroX, inGyroY, inGyroZ);
+	if (numImuSamples > 0)
+	{
+		float sampleTime = 0.f;
+		inGyroX = inGyroY = inGyroZ = 0.f;
+		for (int i = 0; i < numImuSamples; ++i)
+		{
+			const IMU_SAMPLE &sample = imuSamples[i];
+			motion.ProcessMotion(sample.imu.gyroX, sample.imu.gyroY, sample.imu.gyroZ, sample.imu.accelX, sample.imu.accelY, sample.imu.accelZ, sample.deltaTime);
+			float sampleGyroX, sampleGyroY, sampleGyroZ;
+			motion.GetCalibratedGyro(sampleGyroX, sampleGyroY, sampleGyroZ);
+			inGyroX += sampleGyroX * sample.deltaTime;
+			inGyroY += sampleGyroY * sample.deltaTime;
+			inGyroZ += sampleGyroZ * sample.deltaTime;
+			sampleTime += sample.deltaTime;
+		}
+		if (sampleTime > 0.f)
+		{
+			inGyroX /= sampleTime;
+			inGyroY /= sampleTime;
+			inGyroZ /= sampleTime;
+		}
+		else
+		{
+			motion.GetCalibratedGyro(inGyroX, inGyroY, inGyroZ);
+		}
+	}
 
 	float inGravX, inGravY, inGravZ;
 	motion.GetGravity(inGravX, inGravY, inGravZ);
@@ -2415,6 +2815,7 @@ void joyShockPollCallback(int jcHandle, JOY_SHOCK_STATE state, JOY_SHOCK_STATE l
 
 	float inQuatW, inQuatX, inQuatY, inQuatZ;
 	motion.GetOrientation(inQuatW, inQuatX, inQuatY, inQuatZ);
+	jc->latency.Mark(LatencyStage::MOTION);
 
 	//COUT << "DS4 accel: %.4f, %.4f, %.4f\n", imuState.accelX, imuState.accelY, imuState.accelZ);
 	//COUT << "\tDS4 gyro: %.4f, %.4f, %.4f\n", imuState.gyroX, imuState.gyroY, imuState.gyroZ);
@@ -2430,6 +2831,9 @@ void joyShockPollCallback(int jcHandle, JOY_SHOCK_STATE state, JOY_SHOCK_STATE l
 	bool motionAny = false;
 
 	jc->btnCommon->callback_lock.lock();
+	jc->latency.Skip(); // Don't count the wait on the other joycon
+	beginOutputFrame();
+	setOrientation(jc->handle, inQuatW, inQuatX, inQuatY, inQuatZ);
 	if (jc->set_neutral_quat)
 	{
 		jc->neutralQuatW = inQuatW;
@@ -2471,9 +2875,11 @@ void joyShockPollCallback(int jcHandle, JOY_SHOCK_STATE state, JOY_SHOCK_STATE l
 	float gyroLength = sqrt(gyroX * gyroX + gyroY * gyroY);
 	// do gyro smoothing
 	// convert gyro smooth time to number of samples
-	auto numGyroSamples = 1.f / tick_time * jc->getSetting(SettingID::GYRO_SMOOTH_TIME); // samples per second * seconds = samples
+	auto numGyroSamples = jc->report_interval > 0.f ? jc->getSetting(SettingID::GYRO_SMOOTH_TIME) / jc->report_interval : 1.f; // seconds / seconds per sample = samples
 	if (numGyroSamples < 1)
 		numGyroSamples = 1; // need at least 1 sample
+	else if (numGyroSamples > jc->MaxSmoothingSamples)
+		numGyroSamples = jc->MaxSmoothingSamples;
 	auto threshold = jc->getSetting(SettingID::GYRO_SMOOTH_THRESHOLD);
 	jc->GetSmoothedGyro(gyroX, gyroY, gyroLength, threshold / 2.0f, threshold, int(numGyroSamples), gyroX, gyroY);
 	//COUT << "%d Samples for threshold: %0.4f\n", numGyroSamples, gyro_smooth_threshold * maxSmoothingSamples);
@@ -2506,21 +2912,19 @@ void joyShockPollCallback(int jcHandle, JOY_SHOCK_STATE state, JOY_SHOCK_STATE l
 		gyroX = gyroY = gyroLength = 0.0f;
 	}
 
-	jc->time_now = std::chrono::steady_clock::now();
-
 	// sticks!
 	ControllerOrientation controllerOrientation = jc->getSetting<ControllerOrientation>(SettingID::CONTROLLER_ORIENTATION);
 	float camSpeedX = 0.0f;
 	float camSpeedY = 0.0f;
 	// account for os mouse speed and convert from radians to degrees because gyro reports in degrees per second
-	float mouseCalibrationFactor = 180.0f / PI / os_mouse_speed;
+	float mouseCalibrationFactor = 180.0f / PI / os_mouse_speed.get();
 	if (jc->controller_split_type != JS_SPLIT_TYPE_RIGHT)
 	{
 		// let's do these sticks... don't want to constantly send input, so we need to compare them to last time
 		float lastCalX = jc->lastLX;
 		float lastCalY = jc->lastLY;
-		float calX = JslGetLeftX(jc->handle);
-		float calY = -JslGetLeftY(jc->handle);
+		float calX = state.stickLX;
+		float calY = -state.stickLY;
 
 		jc->lastLX = calX;
 		jc->lastLY = calY;
@@ -2535,8 +2939,8 @@ void joyShockPollCallback(int jcHandle, JOY_SHOCK_STATE state, JOY_SHOCK_STATE l
 	{
 		float lastCalX = jc->lastRX;
 		float lastCalY = jc->lastRY;
-		float calX = JslGetRightX(jc->handle);
-		float calY = -JslGetRightY(jc->handle);
+		float calX = state.stickRX;
+		float calY = -state.stickRY;
 
 		jc->lastRX = calX;
 		jc->lastRY = calY;
@@ -2600,7 +3004,9 @@ void joyShockPollCallback(int jcHandle, JOY_SHOCK_STATE state, JOY_SHOCK_STATE l
 		}
 	}
 
-	int buttons = JslGetButtons(jc->handle);
+	jc->latency.Mark(LatencyStage::STICKS);
+
+	int buttons = state.buttons;
 
 	// button mappings
 	if (jc->controller_split_type != JS_SPLIT_TYPE_RIGHT)
@@ -2618,8 +3024,7 @@ void joyShockPollCallback(int jcHandle, JOY_SHOCK_STATE state, JOY_SHOCK_STATE l
 		jc->handleButtonChange(ButtonID::LSL, buttons & (1 << JSOFFSET_SL));
 		jc->handleButtonChange(ButtonID::LSR, buttons & (1 << JSOFFSET_SR));
 
-		float lTrigger = JslGetLeftTrigger(jc->handle);
-		jc->handleTriggerChange(ButtonID::ZL, ButtonID::ZLF, jc->getSetting<TriggerMode>(SettingID::ZL_MODE), lTrigger);
+		jc->handleTriggerChange(ButtonID::ZL, ButtonID::ZLF, jc->getSetting<TriggerMode>(SettingID::ZL_MODE), state.lTrigger);
 	}
 	if (jc->controller_split_type != JS_SPLIT_TYPE_LEFT)
 	{
@@ -2635,11 +3040,12 @@ void joyShockPollCallback(int jcHandle, JOY_SHOCK_STATE state, JOY_SHOCK_STATE l
 		jc->handleButtonChange(ButtonID::RSL, buttons & (1 << JSOFFSET_SL));
 		jc->handleButtonChange(ButtonID::RSR, buttons & (1 << JSOFFSET_SR));
 
-		float rTrigger = JslGetRightTrigger(jc->handle);
-		jc->handleTriggerChange(ButtonID::ZR, ButtonID::ZRF, jc->getSetting<TriggerMode>(SettingID::ZR_MODE), rTrigger);
+		jc->handleTriggerChange(ButtonID::ZR, ButtonID::ZRF, jc->getSetting<TriggerMode>(SettingID::ZR_MODE), state.rTrigger);
 	}
-	bool touch = JslGetTouchDown(jc->handle, false) || JslGetTouchDown(jc->handle, true);
+	const TOUCH_STATE &touchState = input.touch;
+	bool touch = touchState.t0Down || touchState.t1Down;
 	jc->handleButtonChange(ButtonID::TOUCH, touch);
+	jc->latency.Mark(LatencyStage::BUTTONS);
 
 	// Handle buttons before GYRO because some of them may affect the value of blockGyro
 	auto gyro = jc->getSetting<GyroSettings>(SettingID::GYRO_ON); // same result as getting GYRO_OFF
@@ -2662,27 +3068,27 @@ void joyShockPollCallback(int jcHandle, JOY_SHOCK_STATE state, JOY_SHOCK_STATE l
 	bool trackball_y_pressed = false;
 
 	// Apply gyro modifiers in the queue from oldest to newest (thus giving priority to most recent)
-	for (auto pair : jc->btnCommon->gyroActionQueue)
+	for (auto &pair : jc->btnCommon->gyroActionQueue)
 	{
-		if (pair.second.code == GYRO_ON_BIND)
+		if (pair.second->code == GYRO_ON_BIND)
 			blockGyro = false;
-		else if (pair.second.code == GYRO_OFF_BIND)
+		else if (pair.second->code == GYRO_OFF_BIND)
 			blockGyro = true;
-		else if (pair.second.code == GYRO_INV_X)
+		else if (pair.second->code == GYRO_INV_X)
 			gyro_x_sign_to_use = jc->getSetting(SettingID::GYRO_AXIS_X) * -1; // Intentionally don't support multiple inversions
-		else if (pair.second.code == GYRO_INV_Y)
+		else if (pair.second->code == GYRO_INV_Y)
 			gyro_y_sign_to_use = jc->getSetting(SettingID::GYRO_AXIS_Y) * -1; // Intentionally don't support multiple inversions
-		else if (pair.second.code == GYRO_INVERT)
+		else if (pair.second->code == GYRO_INVERT)
 		{
 			// Intentionally don't support multiple inversions
 			gyro_x_sign_to_use = jc->getSetting(SettingID::GYRO_AXIS_X) * -1;
 			gyro_y_sign_to_use = jc->getSetting(SettingID::GYRO_AXIS_Y) * -1;
 		}
-		else if (pair.second.code == GYRO_TRACK_X)
+		else if (pair.second->code == GYRO_TRACK_X)
 			trackball_x_pressed = true;
-		else if (pair.second.code == GYRO_TRACK_Y)
+		else if (pair.second->code == GYRO_TRACK_Y)
 			trackball_y_pressed = true;
-		else if (pair.second.code == GYRO_TRACKBALL)
+		else if (pair.second->code == GYRO_TRACKBALL)
 		{
 			trackball_x_pressed = true;
 			trackball_y_pressed = true;
@@ -2690,7 +3096,7 @@ void joyShockPollCallback(int jcHandle, JOY_SHOCK_STATE state, JOY_SHOCK_STATE l
 	}
 
 	float decay = exp2f(-deltaTime * jc->getSetting(SettingID::TRACKBALL_DECAY));
-	int maxTrackballSamples = max(1, min(jc->numLastGyroSamples, (int)(1.f / deltaTime * 0.125f)));
+	int maxTrackballSamples = jc->report_interval > 0.f ? clamp((int)(0.125f / jc->report_interval), 1, jc->MaxSmoothingSamples) : 1; // average the last 125ms of motion
 
 	if (!trackball_x_pressed && !trackball_y_pressed)
 	{
@@ -2700,45 +3106,19 @@ void joyShockPollCallback(int jcHandle, JOY_SHOCK_STATE state, JOY_SHOCK_STATE l
 
 	if (!trackball_x_pressed)
 	{
-		int gyroSampleIndex = jc->lastGyroIndexX = (jc->lastGyroIndexX + 1) % maxTrackballSamples;
-		jc->lastGyroX[gyroSampleIndex] = gyroX;
+		jc->trackballX.Push(gyroX, maxTrackballSamples);
 	}
 	else
 	{
-		float lastGyroX = 0.f;
-		for (int gyroAverageIdx = 0; gyroAverageIdx < maxTrackballSamples; gyroAverageIdx++)
-		{
-			lastGyroX += jc->lastGyroX[gyroAverageIdx];
-			jc->lastGyroX[gyroAverageIdx] *= decay;
-		}
-		lastGyroX /= maxTrackballSamples;
-		float lastGyroAbsX = abs(lastGyroX);
-		if (lastGyroAbsX > jc->lastGyroAbsX)
-		{
-			lastGyroX *= jc->lastGyroAbsX / lastGyroAbsX;
-		}
-		gyroX = lastGyroX;
+		gyroX = jc->trackballX.Roll(decay, maxTrackballSamples, jc->lastGyroAbsX);
 	}
 	if (!trackball_y_pressed)
 	{
-		int gyroSampleIndex = jc->lastGyroIndexY = (jc->lastGyroIndexY + 1) % maxTrackballSamples;
-		jc->lastGyroY[gyroSampleIndex] = gyroY;
+		jc->trackballY.Push(gyroY, maxTrackballSamples);
 	}
 	else
 	{
-		float lastGyroY = 0.f;
-		for (int gyroAverageIdx = 0; gyroAverageIdx < maxTrackballSamples; gyroAverageIdx++)
-		{
-			lastGyroY += jc->lastGyroY[gyroAverageIdx];
-			jc->lastGyroY[gyroAverageIdx] *= decay;
-		}
-		lastGyroY /= maxTrackballSamples;
-		float lastGyroAbsY = abs(lastGyroY);
-		if (lastGyroAbsY > jc->lastGyroAbsY)
-		{
-			lastGyroY *= jc->lastGyroAbsY / lastGyroAbsY;
-		}
-		gyroY = lastGyroY;
+		gyroY = jc->trackballY.Roll(decay, maxTrackballSamples, jc->lastGyroAbsY);
 	}
 
 	if (blockGyro)
@@ -2752,10 +3132,21 @@ void joyShockPollCallback(int jcHandle, JOY_SHOCK_STATE state, JOY_SHOCK_STATE l
 	    (jc->controller_split_type & (int)jc->getSetting<JoyconMask>(SettingID::JOYCON_GYRO_MASK)) == 0))
 	{
 		//COUT << "GX: %0.4f GY: %0.4f GZ: %0.4f\n", imuState.gyroX, imuState.gyroY, imuState.gyroZ);
-		float mouseCalibration = jc->getSetting(SettingID::REAL_WORLD_CALIBRATION) / os_mouse_speed / jc->getSetting(SettingID::IN_GAME_SENS);
-		shapedSensitivityMoveMouse(gyroX * gyro_x_sign_to_use, gyroY * gyro_y_sign_to_use, jc->getSetting<FloatXY>(SettingID::MIN_GYRO_SENS), jc->getSetting<FloatXY>(SettingID::MAX_GYRO_SENS),
+		float mouseCalibration = jc->getSetting(SettingID::REAL_WORLD_CALIBRATION) / os_mouse_speed.get() / jc->getSetting(SettingID::IN_GAME_SENS);
+		auto motion = shapedSensitivityMouseMotion(gyroX * gyro_x_sign_to_use, gyroY * gyro_y_sign_to_use, jc->getSetting<FloatXY>(SettingID::MIN_GYRO_SENS), jc->getSetting<FloatXY>(SettingID::MAX_GYRO_SENS),
 		  jc->getSetting(SettingID::MIN_GYRO_THRESHOLD), jc->getSetting(SettingID::MAX_GYRO_THRESHOLD), deltaTime,
 		  camSpeedX * jc->getSetting(SettingID::STICK_AXIS_X), -camSpeedY * jc->getSetting(SettingID::STICK_AXIS_Y), mouseCalibration);
+		// A replay captures its output on this thread, which the output stage knows nothing about
+		if (isOutputStageRunning && !hasOutputSink())
+		{
+			jc->mouseOutput.Push(motion.first, motion.second, timeNow);
+		}
+		else
+		{
+			// Along with what was pushed while the output stage was stopping
+			auto leftover = jc->mouseOutput.Take();
+			moveMouse(motion.first + leftover.first, motion.second + leftover.second);
+		}
 	}
 	if (jc->btnCommon->_vigemController)
 	{
@@ -2769,9 +3160,211 @@ void joyShockPollCallback(int jcHandle, JOY_SHOCK_STATE state, JOY_SHOCK_STATE l
 		JslSetLightColour(jc->handle, newColor.raw);
 		jc->_light_bar = newColor;
 	}
+	flushOutputFrame();
+	jc->latency.Mark(LatencyStage::OUTPUT);
 	jc->btnCommon->callback_lock.unlock();
 }
 
+void recordTick(shared_ptr<JoyShock> jc, const TickInput &input)
+{
+	if (!tickRecorder.HasDevice(jc->handle))
+	{
+		RecordedDevice device;
+		device.handle = jc->handle;
+		device.controllerType = jc->platform_controller_type;
+		device.splitType = jc->controller_split_type;
+		for (auto &pair : *atomic_load(&tick_joyshocks))
+		{
+			if (pair.second != jc && pair.second->btnCommon == jc->btnCommon)
+			{
+				device.sharedButtonsHandle = pair.first;
+			}
+		}
+		tickRecorder.Write(device);
+	}
+	tickRecorder.Write(jc->handle, input);
+}
+
+void joyShockPollCallback(int jcHandle, JOY_SHOCK_STATE state, JOY_SHOCK_STATE lastState, IMU_STATE imuState, IMU_STATE lastImuState, float deltaTime)
+{
+	auto joyshocks = atomic_load(&tick_joyshocks);
+	auto found = joyshocks->find(jcHandle);
+	if (found == joyshocks->end())
+		return;
+	shared_ptr<JoyShock> jc = found->second;
+
+	auto timeNow = chrono::steady_clock::now();
+	jc->latency.Begin(timeNow);
+
+	TickInput input;
+	input.state = state;
+	input.deltaTime = ((float)chrono::duration_cast<chrono::microseconds>(timeNow - jc->time_now).count()) / 1000000.0f;
+#ifdef JSM_SDL_BACKEND
+	jc->latency.Record(LatencyStage::SDL_UPDATE, JslGetUpdateDuration());
+	jc->latency.Record(LatencyStage::DISPATCH, JslGetDispatchDelay(jc->handle));
+	input.numImuSamples = JslGetIMUSamples(jc->handle, input.imuSamples, JSL_MAX_IMU_SAMPLES);
+#else
+	// JoyShockLibrary calls back for each report with that report's reading
+	input.imuSamples[0] = { imuState, input.deltaTime };
+	input.numImuSamples = 1;
+#endif
+	input.touch = JslGetTouchState(jc->handle);
+	jc->latency.Mark(LatencyStage::IMU_READ);
+
+	if (tickRecorder.IsRecording())
+	{
+		recordTick(jc, input);
+	}
+
+	processTick(jc, input, timeNow);
+
+#ifdef JSM_SDL_BACKEND
+	jc->latency.Record(LatencyStage::TOTAL, JslGetReportAge(jc->handle));
+#else
+	jc->latency.Record(LatencyStage::TOTAL, chrono::steady_clock::now() - timeNow);
+#endif
+}
+
+// Collects the output of a replay instead of sending it to the OS. Every event is hashed, so that
+// two replays can be compared at a glance, and optionally written as text along with its tick number.
+class ReplayCapture : public OutputSink
+{
+public:
+	ReplayCapture(ostream *out)
+	  : _out(out)
+	{
+	}
+
+	void pressKey(KeyCode key, bool pressed) override
+	{
+		++keyEvents;
+		Hash(key.code);
+		Hash(pressed);
+		if (_out)
+		{
+			*_out << tick << " KEY " << key.code << ' ' << (key.name.empty() ? "-" : key.name) << ' ' << pressed << '\n';
+		}
+	}
+
+	void moveMouse(float x, float y) override
+	{
+		++mouseEvents;
+		Hash(x);
+		Hash(y);
+		if (_out)
+		{
+			*_out << tick << " MOVE " << setprecision(9) << x << ' ' << y << '\n';
+		}
+	}
+
+	void setMouseNorm(float x, float y) override
+	{
+		++mouseEvents;
+		Hash(x);
+		Hash(y);
+		if (_out)
+		{
+			*_out << tick << " ABS " << setprecision(9) << x << ' ' << y << '\n';
+		}
+	}
+
+	size_t tick = 0;
+	size_t keyEvents = 0;
+	size_t mouseEvents = 0;
+	uint64_t hash = 0xcbf29ce484222325ull; // FNV-1a
+
+private:
+	template<typename T>
+	void Hash(T value)
+	{
+		auto bytes = reinterpret_cast<const unsigned char *>(&value);
+		for (size_t i = 0; i < sizeof(T); ++i)
+		{
+			hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+		}
+	}
+
+	ostream *_out;
+};
+
+// Feed a recording through the mapping pipeline as fast as possible with the current settings.
+// Time only advances by the recorded time between reports, so the same recording and settings always
+// produce the same output. Returns false if the file isn't a valid recording, or if processing any report
+// recorded more than warmupSeconds into the recording allocated memory. Allocations are only counted by
+// jsm_replay and jsm_bench.
+bool replayRecording(in_string recordingPath, ostream *capture, float warmupSeconds)
+{
+	TickReader reader;
+	if (!reader.Open(recordingPath))
+	{
+		CERR << "\"" << recordingPath << "\" is not a recording" << endl;
+		return false;
+	}
+	// Don't flood the console with what the replayed controllers are doing. Messages are only dropped once
+	// they're handed to the logger, so memory allocated to build them is still counted.
+	muteOutput(true);
+
+	ReplayCapture sink(capture);
+	map<int, shared_ptr<JoyShock>> devices;
+	RecordedDevice device;
+	int handle;
+	TickInput input;
+	TickRecordType type;
+	setOutputSink(&sink);
+	size_t tickAllocations = 0;
+	size_t lateAllocations = 0;
+	auto start = chrono::steady_clock::now();
+	while ((type = reader.Read(device, handle, input)) == TickRecordType::DEVICE || type == TickRecordType::TICK)
+	{
+		if (type == TickRecordType::DEVICE)
+		{
+			// Negative handles don't belong to any connected controller, so rumble and light changes go nowhere
+			auto other = devices.find(device.sharedButtonsHandle);
+			shared_ptr<JoyShock> jc(new JoyShock(-1 - device.handle, device.splitType, other != devices.end() ? other->second->btnCommon : nullptr));
+			jc->platform_controller_type = device.controllerType;
+			devices[device.handle] = jc;
+		}
+		else if (auto found = devices.find(handle); found != devices.end())
+		{
+			auto &jc = found->second;
+			auto timeNow = jc->time_now + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<float>(input.deltaTime));
+			size_t allocations = heapAllocations;
+			processTick(jc, input, timeNow);
+			allocations = heapAllocations - allocations;
+			tickAllocations += allocations;
+			if (allocations > 0 && chrono::duration<float>(timeNow.time_since_epoch()).count() > warmupSeconds)
+			{
+				if (lateAllocations == 0)
+				{
+					CERR << "Report " << sink.tick << " allocated memory " << allocations << " times after warming up" << endl;
+				}
+				lateAllocations += allocations;
+			}
+			++sink.tick;
+		}
+	}
+	float seconds = chrono::duration<float>(chrono::steady_clock::now() - start).count();
+	setOutputSink(nullptr);
+	muteOutput(false);
+
+	if (type == TickRecordType::INVALID)
+	{
+		CERR << "The recording is truncated or corrupted. Stopped after " << sink.tick << " reports." << endl;
+	}
+	COUT << "Replayed " << sink.tick << " reports from " << devices.size() << " controllers in " << seconds << " seconds ("
+	     << size_t(seconds > 0.f ? sink.tick / seconds : 0.f) << " reports per second)" << endl;
+	COUT_INFO << "Output: " << sink.keyEvents << " key events, " << sink.mouseEvents << " mouse events, hash "
+	          << hex << setw(16) << setfill('0') << sink.hash << dec << setfill(' ') << endl;
+#if defined(JSM_REPLAY_TOOL) || defined(JSM_BENCHMARK)
+	COUT_INFO << "Heap allocations while processing reports: " << tickAllocations << endl;
+#endif
+	if (lateAllocations > 0)
+	{
+		CERR << "Reports after the first " << warmupSeconds << " seconds allocated memory " << lateAllocations << " times" << endl;
+	}
+	return type != TickRecordType::INVALID && lateAllocations == 0;
+}
+
 // https://stackoverflow.com/a/25311622/1130520 says this is why filenames obtained by fgets don't work
 static void removeNewLine(char *string)
 {
@@ -2782,45 +3375,84 @@ static void removeNewLine(char *string)
 	}
 }
 
-// https://stackoverflow.com/a/4119881/1130520 gives us case insensitive equality
-static bool iequals(const string &a, const string &b)
+// Finds the AutoLoad file for an application. The folder is only listed again when files in it are added, removed or renamed.
+class AutoLoadIndex
 {
-	return equal(a.begin(), a.end(),
-	  b.begin(), b.end(),
-	  [](char a, char b) {
-		  return tolower(a) == tolower(b);
-	  });
-}
+public:
+	// Returns an empty string if there is no file for that module
+	string Find(in_string noextmodule)
+	{
+		string folder(AUTOLOAD_FOLDER());
+		if (folder != _folder)
+		{
+			// JSM_DIRECTORY changed
+			_folder = folder;
+			_watcher.reset(new DirectoryWatcher(_folder));
+			_files.clear();
+			_isListed = false;
+		}
+		if (!_isListed || _watcher->HasChanged())
+		{
+			_files.clear();
+			for (auto file : ListDirectory(_folder))
+			{
+				// The first file listed for a name wins
+				_files.emplace(lowercase(file.substr(0, file.find_first_of('.'))), file);
+			}
+			_isListed = true;
+		}
+		auto found = _files.find(lowercase(noextmodule));
+		return found != _files.end() ? found->second : string();
+	}
+
+	inline const string &Folder() const
+	{
+		return _folder;
+	}
+
+private:
+	static string lowercase(string name)
+	{
+		transform(name.begin(), name.end(), name.begin(), [](char c) { return char(tolower(c)); });
+		return name;
+	}
+
+	string _folder;
+	unique_ptr<DirectoryWatcher> _watcher;
+	unordered_map<string, string> _files; // lowercase name without extension -> file name
+	bool _isListed = false;
+};
 
 bool AutoLoadPoll(void *param)
 {
 	auto registry = reinterpret_cast<CmdRegistry *>(param);
 	static string lastModuleName;
+	static AutoLoadIndex autoLoadFiles;
+	// Switching back and forth between games shouldn't stall input while their configurations are parsed again
+	static ProfileCache profiles;
+	// Woken up by focus changes. Returning now and then lets the thread stop when AUTOLOAD is turned off.
+	if (!WaitForFocusChange(1000))
+	{
+		return true;
+	}
 	string windowTitle, windowModule;
 	tie(windowModule, windowTitle) = GetActiveWindowName();
 	if (!windowModule.empty() && windowModule != lastModuleName && windowModule.compare("JoyShockMapper.exe") != 0)
 	{
 		lastModuleName = windowModule;
-		string path(AUTOLOAD_FOLDER());
-		auto files = ListDirectory(path);
 		auto noextmodule = windowModule.substr(0, windowModule.find_first_of('.'));
 		COUT_INFO << "[AUTOLOAD] \"" << windowTitle << "\" in focus: "; // looking for config : " , );
-		bool success = false;
-		for (auto file : files)
+		auto file = autoLoadFiles.Find(noextmodule);
+		if (!file.empty())
 		{
 			auto noextconfig = file.substr(0, file.find_first_of('.'));
-			if (iequals(noextconfig, noextmodule))
-			{
-				COUT_INFO << "loading \"AutoLoad\\" << noextconfig << ".txt\"." << endl;
-				loading_lock.lock();
-				registry->processLine(path + file);
-				loading_lock.unlock();
-				COUT_INFO << "[AUTOLOAD] Loading completed" << endl;
-				success = true;
-				break;
-			}
+			COUT_INFO << "loading \"AutoLoad\\" << noextconfig << ".txt\"." << endl;
+			loading_lock.lock();
+			profiles.Load(*registry, autoLoadFiles.Folder() + file, &applyPaused);
+			loading_lock.unlock();
+			COUT_INFO << "[AUTOLOAD] Loading completed" << endl;
 		}
-		if (!success)
+		else
 		{
 			COUT_INFO << "create \"AutoLoad\\" << noextmodule << ".txt\" to autoload for this application." << endl;
 		}
@@ -2828,6 +3460,54 @@ bool AutoLoadPoll(void *param)
 	return true;
 }
 
+bool WatchPoll(void *param)
+{
+	auto registry = reinterpret_cast<CmdRegistry *>(param);
+	static unique_ptr<DirectoryWatcher> watcher;
+	static vector<string> watchedFolders;
+	// Woken up by changes in the folders of the watched files. Returning now and then lets WATCH pick another file.
+	bool changed = !watcher || watcher->WaitForChange(1000);
+	vector<string> folders;
+	{
+		lock_guard guard(loading_lock);
+		if (changed && !watchedConfig.empty() && watchedProfiles.HasChanged(watchedConfig))
+		{
+			COUT_INFO << "[WATCH] " << watchedConfig << " was modified" << endl;
+			// Ticks keep going while the configuration is parsed: they're only paused to apply what it changed
+			if (!watchedProfiles.Reload(*registry, watchedConfig, &applyPaused))
+			{
+				// Runs commands that don't only change variables, so it can't be compared with the current state
+				watchedProfiles.Load(*registry, watchedConfig, &applyPaused);
+			}
+			COUT_INFO << "[WATCH] Loading completed" << endl;
+		}
+		// Files loaded by the configuration may be elsewhere, and change when it does
+		for (auto &file : watchedProfiles.Files(watchedConfig))
+		{
+			auto folder = filesystem::path(file).parent_path().string();
+			if (folder.empty())
+			{
+				folder = ".";
+			}
+			if (find(folders.begin(), folders.end(), folder) == folders.end())
+			{
+				folders.push_back(folder);
+			}
+		}
+	}
+	if (folders != watchedFolders)
+	{
+		watchedFolders = folders;
+		watcher.reset(folders.empty() ? nullptr : new DirectoryWatcher(folders, true));
+	}
+	if (!watcher)
+	{
+		// Nothing to watch until WATCH is entered again
+		this_thread::sleep_for(chrono::milliseconds(500));
+	}
+	return true;
+}
+
 bool MinimizePoll(void *param)
 {
 	if (isConsoleMinimized())
@@ -2906,12 +3586,74 @@ void beforeShowTrayMenu()
 	}
 }
 
+// Send the mouse motion of every controller in even steps, at OUTPUT_RATE
+void runOutputStage()
+{
+	TickScheduler scheduler;
+	while (isOutputStageRunning)
+	{
+		// OUTPUT_RATE can be set to 0 while the stage is stopping
+		float rate = output_rate.get();
+		if (rate <= 0.f)
+		{
+			break;
+		}
+		scheduler.SetPeriod(chrono::duration_cast<TickScheduler::clock::duration>(chrono::duration<float>(1.f / rate)));
+		scheduler.SleepUntilDeadline();
+		auto now = TickScheduler::clock::now();
+		scheduler.Advance(now);
+		auto extrapolation = chrono::duration_cast<TickScheduler::clock::duration>(chrono::duration<float, milli>(output_extrapolation.get()));
+		float x = 0.f, y = 0.f;
+		for (auto &pair : *atomic_load(&tick_joyshocks))
+		{
+			auto motion = pair.second->mouseOutput.Pull(now, extrapolation);
+			x += motion.first;
+			y += motion.second;
+		}
+		if (x != 0.f || y != 0.f)
+		{
+			moveMouse(x, y);
+		}
+	}
+	// Send what is left at once rather than lose it
+	float x = 0.f, y = 0.f;
+	for (auto &pair : *atomic_load(&tick_joyshocks))
+	{
+		auto motion = pair.second->mouseOutput.Take();
+		x += motion.first;
+		y += motion.second;
+	}
+	if (x != 0.f || y != 0.f)
+	{
+		moveMouse(x, y);
+	}
+}
+
+void UpdateOutputStage(float rate)
+{
+	if ((rate > 0.f) == isOutputStageRunning)
+	{
+		return;
+	}
+	isOutputStageRunning = rate > 0.f;
+	if (isOutputStageRunning)
+	{
+		outputThread = thread(&runOutputStage);
+	}
+	else
+	{
+		outputThread.join();
+	}
+}
+
 // Perform all cleanup tasks when JSM is exiting
 void CleanUp()
 {
 	tray->Hide();
 	HideConsole();
+	UpdateOutputStage(0.f);
 	handle_to_joyshock.clear();
+	publishJoyShocks();
 	JslDisconnectAndDisposeAll();
 	handle_to_joyshock.clear(); // Destroy Vigem Gamepads
 	ReleaseConsole();
@@ -2967,7 +3709,28 @@ float filterHoldPressDelay(float c, float next)
 
 float filterTickTime(float c, float next)
 {
-	return max(1.f, min(100.f, round(next)));
+	return max(0.1f, min(100.f, next));
+}
+
+int filterCpu(int current, int next)
+{
+	return next >= -1 && next < max(1, int(thread::hardware_concurrency())) ? next : current;
+}
+
+// Whether every device has the virtual controller VIRTUAL_CONTROLLER asks for. They only get it once it is changed for
+// real, so in a variableShadow, values are only checked when the profile is applied.
+bool checkVigemState()
+{
+	if (variableShadow)
+	{
+		return true;
+	}
+	for (auto &js : handle_to_joyshock)
+	{
+		if (js.second->CheckVigemState() == false)
+			return false;
+	}
+	return true;
 }
 
 Mapping filterMapping(Mapping current, Mapping next)
@@ -2979,10 +3742,9 @@ Mapping filterMapping(Mapping current, Mapping next)
 			COUT_WARN << "Before using this mapping, you need to set VIRTUAL_CONTROLLER." << endl;
 			return current;
 		}
-		for (auto &js : handle_to_joyshock)
+		if (!checkVigemState())
 		{
-			if (js.second->CheckVigemState() == false)
-				return current;
+			return current;
 		}
 	}
 	return next.isValid() ? next : current;
@@ -3007,10 +3769,9 @@ TriggerMode filterTriggerMode(TriggerMode current, TriggerMode next)
 			COUT_WARN << "Before using this trigger mode, you need to set VIRTUAL_CONTROLLER." << endl;
 			return current;
 		}
-		for (auto &js : handle_to_joyshock)
+		if (!checkVigemState())
 		{
-			if (js.second->CheckVigemState() == false)
-				return current;
+			return current;
 		}
 	}
 	return filterInvalidValue<TriggerMode, TriggerMode::INVALID>(current, next);
@@ -3025,10 +3786,9 @@ StickMode filterStickMode(StickMode current, StickMode next)
 			COUT_WARN << "Before using this stick mode, you need to set VIRTUAL_CONTROLLER." << endl;
 			return current;
 		}
-		for (auto &js : handle_to_joyshock)
+		if (!checkVigemState())
 		{
-			if (js.second->CheckVigemState() == false)
-				return current;
+			return current;
 		}
 	}
 	return filterInvalidValue<StickMode, StickMode::INVALID>(current, next);
@@ -3046,23 +3806,35 @@ void UpdateRingModeFromStickMode(JSMVariable<RingMode> *stickRingMode, StickMode
 	}
 }
 
-ControllerScheme UpdateVirtualController(ControllerScheme prevScheme, ControllerScheme nextScheme)
+
+OutputDevice UpdateOutputDevice(OutputDevice current, OutputDevice next)
+{
+	if (next == OutputDevice::INVALID)
+	{
+		return current;
+	}
+	if (!setOutputDevice(next))
+	{
+		CERR << "Output can't be sent to " << next << " on this system." << endl;
+		return current;
+	}
+	return next;
+}
+
+// Plugs virtual controllers in and out. This is done by a listener rather than the filter, so that loading
+// a configuration quietly to compile it, or putting back a profile that doesn't change it, does nothing.
+void OnVirtualControllerChange(ControllerScheme newScheme)
 {
 	for (auto &js : handle_to_joyshock)
 	{
 		if (!js.second->btnCommon->_vigemController ||
-		  js.second->btnCommon->_vigemController->getType() != nextScheme)
+		  js.second->btnCommon->_vigemController->getType() != newScheme)
 		{
 			js.second->btnCommon->_vigemController.reset(
-			  nextScheme == ControllerScheme::NONE ? nullptr :
-                                                     new Gamepad(nextScheme, bind(&JoyShock::handleViGEmNotification, js.second.get(), placeholders::_1, placeholders::_2, placeholders::_3)));
+			  newScheme == ControllerScheme::NONE ? nullptr :
+                                                    new Gamepad(newScheme, bind(&JoyShock::handleViGEmNotification, js.second.get(), placeholders::_1, placeholders::_2, placeholders::_3)));
 		}
 	}
-	return nextScheme;
-}
-
-void OnVirtualControllerChange(ControllerScheme newScheme)
-{
 	for (auto &js : handle_to_joyshock)
 	{
 		// Display an error message if any vigem is no good.
@@ -3165,14 +3937,14 @@ public:
 		return this;
 	}
 
-	virtual unique_ptr<JSMCommand> GetModifiedCmd(char op, in_string chord) override
+	virtual unique_ptr<JSMCommand> GetModifiedCmd(char op, string_view chord) override
 	{
 		auto optBtn = magic_enum::enum_cast<ButtonID>(chord);
 		auto settingVar = dynamic_cast<JSMSetting<GyroSettings> *>(&_var);
-		if (optBtn > ButtonID::NONE && op == ',' && settingVar)
+		if (optBtn > ButtonID::NONE && optBtn < ButtonID::SIZE && op == ',' && settingVar)
 		{
 			//Create Modeshift
-			string name = chord + op + _displayName;
+			string name = string(chord) + op + _displayName;
 			unique_ptr<JSMCommand> chordAssignment(new GyroButtonAssignment(name, *settingVar->AtChord(*optBtn), _always_off));
 			chordAssignment->SetHelp(_help)->SetParser(bind(&GyroButtonAssignment::ModeshiftParser, *optBtn, settingVar, _parse, placeholders::_1, placeholders::_2))->SetTaskOnDestruction(bind(&JSMSetting<GyroSettings>::ProcessModeshiftRemoval, settingVar, *optBtn));
 			return chordAssignment;
@@ -3261,7 +4033,147 @@ public:
 	}
 };
 
-#ifdef _WIN32
+#ifdef JSM_REPLAY_TOOL
+// Write a recording of scripted synthetic controllers reporting at 1kHz going through their whole script a number of
+// times, without waiting for them in real time
+bool generateRecording(in_string recordingPath, int numControllers, int passes)
+{
+	constexpr float period = 0.001f;
+	TickRecorder recorder;
+	if (!recorder.Start(recordingPath))
+	{
+		CERR << "Can't create the file \"" << recordingPath << "\"" << endl;
+		return false;
+	}
+	vector<SyntheticInput> controllers;
+	for (int i = 0; i < numControllers; ++i)
+	{
+		controllers.emplace_back(i, 0);
+		RecordedDevice device;
+		device.handle = i;
+		device.controllerType = JS_TYPE_DS4;
+		recorder.Write(device);
+	}
+	TickInput input;
+	input.deltaTime = period;
+	input.numImuSamples = 1;
+	int reports = int(passes * SyntheticInput::GetScriptDuration() / period);
+	for (int report = 0; report < reports; ++report)
+	{
+		for (int i = 0; i < numControllers; ++i)
+		{
+			controllers[i].Generate(period, false);
+			input.state = controllers[i].state;
+			input.touch = controllers[i].touch;
+			input.imuSamples[0] = { controllers[i].imu, period };
+			recorder.Write(i, input);
+		}
+	}
+	COUT << "Recorded " << recorder.GetTickCount() << " reports to \"" << recordingPath << "\"" << endl;
+	recorder.Stop();
+	return true;
+}
+
+// Benchmark and regression tool: jsm_replay <recording> [-o <output file>] [-n <repetitions>] [-w <seconds>] [<config file> ...]
+// Configuration files are loaded in order before replaying, as if their path was entered in the console.
+// With -w, it fails if processing any report recorded after that many seconds allocates memory. "-w script"
+// waits for one pass of the synthetic controllers' script, after which they have used every button.
+// jsm_replay -g <recording> <controllers> <passes> writes a recording of synthetic controllers going through
+// their script that many times, to replay instead.
+int runReplayTool(CmdRegistry &commandRegistry, int argc, char *argv[])
+{
+	if (argc == 5 && string(argv[1]) == "-g")
+	{
+		return generateRecording(argv[2], max(1, atoi(argv[3])), max(1, atoi(argv[4]))) ? 0 : 1;
+	}
+	string recordingPath, capturePath;
+	int repetitions = 1;
+	float warmupSeconds = numeric_limits<float>::infinity();
+	vector<string> configs;
+	for (int i = 1; i < argc; ++i)
+	{
+		string arg(argv[i]);
+		if (arg == "-o" && i + 1 < argc)
+			capturePath = argv[++i];
+		else if (arg == "-n" && i + 1 < argc)
+			repetitions = max(1, atoi(argv[++i]));
+		else if (arg == "-w" && i + 1 < argc)
+		{
+			string warmup(argv[++i]);
+			warmupSeconds = warmup == "script" ? SyntheticInput::GetScriptDuration() : max(0.f, float(atof(warmup.c_str())));
+		}
+		else if (recordingPath.empty())
+			recordingPath = arg;
+		else
+			configs.push_back(arg);
+	}
+	if (recordingPath.empty())
+	{
+		CERR << "Usage: " << argv[0] << " <recording> [-o <output file>] [-n <repetitions>] [-w <seconds>|script] [<config file> ...]" << endl;
+		CERR << "       " << argv[0] << " -g <recording> <controllers> <passes>" << endl;
+		return 1;
+	}
+	for (auto &config : configs)
+	{
+		if (!commandRegistry.loadConfigFile(config))
+		{
+			CERR << "Can't load \"" << config << "\"" << endl;
+			return 1;
+		}
+	}
+	ofstream capture;
+	if (!capturePath.empty())
+	{
+		capture.open(capturePath);
+		if (!capture)
+		{
+			CERR << "Can't create the file \"" << capturePath << "\"" << endl;
+			return 1;
+		}
+	}
+	for (int i = 0; i < repetitions; ++i)
+	{
+		if (!replayRecording(recordingPath, capture.is_open() ? &capture : nullptr, warmupSeconds))
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+#endif // JSM_REPLAY_TOOL
+
+#ifdef JSM_BENCHMARK
+#include "Benchmarks.cpp"
+#endif
+
+// jsm_replay and jsm_bench run the mapper without controllers, console window or tray icon
+#if defined(JSM_REPLAY_TOOL) || defined(JSM_BENCHMARK)
+#define JSM_HEADLESS
+
+// They also count heap allocations, to tell when processing input makes any
+void *operator new(size_t size)
+{
+	heapAllocations.fetch_add(1, memory_order_relaxed);
+	if (void *memory = malloc(size > 0 ? size : 1))
+	{
+		return memory;
+	}
+	throw bad_alloc();
+}
+
+void operator delete(void *memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+	free(memory);
+}
+#endif
+
+#if defined(_WIN32) && !defined(JSM_HEADLESS)
 int __stdcall wWinMain(HINSTANCE hInstance, HINSTANCE prevInstance, LPWSTR cmdLine, int cmdShow)
 {
 	auto trayIconData = hInstance;
@@ -3275,19 +4187,25 @@ int main(int argc, char *argv[])
 	mappings.reserve(MAPPING_SIZE);
 	for (int id = 0; id < MAPPING_SIZE; ++id)
 	{
-		JSMButton newButton(ButtonID(id), Mapping::NO_MAPPING);
-		newButton.SetFilter(&filterMapping);
-		mappings.push_back(newButton);
+		mappings.emplace_back(ButtonID(id), Mapping::NO_MAPPING);
+		mappings.back().SetFilter(&filterMapping);
 	}
+#ifdef JSM_HEADLESS
+	// Replays and benchmarks must not depend on which window is in focus
+	autoloadSwitch = Switch::OFF;
+#else
 	// console
 	initConsole();
 	ColorStream<&cout, FOREGROUND_GREEN | FOREGROUND_INTENSITY>() << "Welcome to JoyShockMapper version " << version << '!' << endl;
+#endif
 	//if (whitelister) COUT << "JoyShockMapper was successfully whitelisted!" << endl;
 	// Threads need to be created before listeners
 	CmdRegistry commandRegistry;
 	minimizeThread.reset(new PollingThread("Minimize thread", &MinimizePoll, nullptr, 1000, hide_minimized.get() == Switch::ON));          // Start by default
-	autoLoadThread.reset(new PollingThread("Autoload thread", &AutoLoadPoll, &commandRegistry, 1000, autoloadSwitch.get() == Switch::ON)); // Start by default
+	autoLoadThread.reset(new PollingThread("Autoload thread", &AutoLoadPoll, &commandRegistry, 0, autoloadSwitch.get() == Switch::ON)); // Start by default, waits for focus changes by itself
+	watchThread.reset(new PollingThread("Watch thread", &WatchPoll, &commandRegistry, 0, false));                                          // Started by WATCH, waits for file changes by itself
 
+#ifndef JSM_HEADLESS
 	if (autoLoadThread && autoLoadThread->isRunning())
 	{
 		COUT << "AUTOLOAD is enabled. Files in ";
@@ -3298,10 +4216,11 @@ int main(int argc, char *argv[])
 	{
 		CERR << "AutoLoad is unavailable" << endl;
 	}
+#endif
 
-	left_stick_mode.SetFilter(&filterStickMode)->AddOnChangeListener(bind(&UpdateRingModeFromStickMode, &left_ring_mode, ::placeholders::_1));
-	right_stick_mode.SetFilter(&filterStickMode)->AddOnChangeListener(bind(&UpdateRingModeFromStickMode, &right_ring_mode, ::placeholders::_1));
-	motion_stick_mode.SetFilter(&filterStickMode)->AddOnChangeListener(bind(&UpdateRingModeFromStickMode, &motion_ring_mode, ::placeholders::_1));
+	left_stick_mode.SetFilter(&filterStickMode)->AddOnChangeListener(bind(&UpdateRingModeFromStickMode, &left_ring_mode, ::placeholders::_1), false, true);
+	right_stick_mode.SetFilter(&filterStickMode)->AddOnChangeListener(bind(&UpdateRingModeFromStickMode, &right_ring_mode, ::placeholders::_1), false, true);
+	motion_stick_mode.SetFilter(&filterStickMode)->AddOnChangeListener(bind(&UpdateRingModeFromStickMode, &motion_ring_mode, ::placeholders::_1), false, true);
 	left_ring_mode.SetFilter(&filterInvalidValue<RingMode, RingMode::INVALID>);
 	right_ring_mode.SetFilter(&filterInvalidValue<RingMode, RingMode::INVALID>);
 	motion_ring_mode.SetFilter(&filterInvalidValue<RingMode, RingMode::INVALID>);
@@ -3356,16 +4275,32 @@ int main(int argc, char *argv[])
 	dbl_press_window.SetFilter(&filterPositive);
 	hold_press_time.SetFilter(&filterHoldPressDelay);
 	tick_time.SetFilter(&filterTickTime);
+	tick_spin_time.SetFilter([](float current, float next) {
+		return next >= 0.f && next <= 2.f ? next : current;
+	});
+	output_rate.SetFilter([](float current, float next) {
+		return next == 0.f || (next >= 60.f && next <= 8000.f) ? next : current;
+	})->AddOnChangeListener(&UpdateOutputStage);
+	output_extrapolation.SetFilter([](float current, float next) {
+		return next >= 0.f && next <= 20.f ? next : current;
+	});
+	processing_cpu.SetFilter(&filterCpu);
+	input_thread_cpu.SetFilter(&filterCpu);
+	input_thread_priority.SetFilter([](int current, int next) {
+		return next >= 0 && next <= 99 ? next : current;
+	});
+	lock_memory.SetFilter(&filterInvalidValue<Switch, Switch::INVALID>);
+	output_device.SetFilter(&UpdateOutputDevice);
 	currentWorkingDir.SetFilter([](PathString current, PathString next) 
 		{
 			return SetCWD(string(next)) ? next : current; 
 		});
 	autoloadSwitch.SetFilter(&filterInvalidValue<Switch, Switch::INVALID>)->AddOnChangeListener(bind(&UpdateThread, autoLoadThread.get(), placeholders::_1));
 	hide_minimized.SetFilter(&filterInvalidValue<Switch, Switch::INVALID>)->AddOnChangeListener(bind(&UpdateThread, minimizeThread.get(), placeholders::_1));
-	virtual_controller.SetFilter(&UpdateVirtualController)->AddOnChangeListener(&OnVirtualControllerChange);
+	virtual_controller.SetFilter(&filterInvalidValue<ControllerScheme, ControllerScheme::INVALID>)->AddOnChangeListener(&OnVirtualControllerChange);
 	scroll_sens.SetFilter(&filterFloatPair);
 	// light_bar needs no filter or listener. The callback polls and updates the color.
-#if _WIN32
+#if defined(_WIN32) && !defined(JSM_HEADLESS)
 	currentWorkingDir = string(&cmdLine[0], &cmdLine[wcslen(cmdLine)]);
 #else
 	currentWorkingDir = string(argv[0]);
@@ -3398,8 +4333,8 @@ int main(int argc, char *argv[])
 	                      ->SetHelp("Set this value to the sensitivity you use in game. It is used by stick FLICK and AIM modes as well as GYRO aiming."));
 	commandRegistry.Add((new JSMAssignment<float>(trigger_threshold))
 	                      ->SetHelp("Set this to a value between 0 and 1. This is the threshold at which a soft press binding is triggered. Or set the value to -1 to use hair trigger mode"));
-	commandRegistry.Add((new JSMMacro("RESET_MAPPINGS"))->SetMacro(bind(&do_RESET_MAPPINGS, &commandRegistry))->SetHelp("Delete all custom bindings and reset to default.\nHOME and CAPTURE are set to CALIBRATE on both tap and hold by default."));
-	commandRegistry.Add((new JSMMacro("NO_GYRO_BUTTON"))->SetMacro(bind(&do_NO_GYRO_BUTTON))->SetHelp("Enable gyro at all times, without any GYRO_OFF binding."));
+	commandRegistry.Add((new JSMMacro("RESET_MAPPINGS"))->SetMacro(bind(&do_RESET_MAPPINGS, &commandRegistry))->SetHelp("Delete all custom bindings and reset to default.\nHOME and CAPTURE are set to CALIBRATE on both tap and hold by default.")->SetOnlyChangesVariables());
+	commandRegistry.Add((new JSMMacro("NO_GYRO_BUTTON"))->SetMacro(bind(&do_NO_GYRO_BUTTON))->SetHelp("Enable gyro at all times, without any GYRO_OFF binding.")->SetOnlyChangesVariables());
 	commandRegistry.Add((new JSMAssignment<StickMode>(left_stick_mode))
 	                      ->SetHelp("Set a mouse mode for the left stick. Valid values are the following:\nNO_MOUSE, AIM, FLICK, FLICK_ONLY, ROTATE_ONLY, MOUSE_RING, MOUSE_AREA, OUTER_RING, INNER_RING, SCROLL_WHEEL, LEFT_STICK, RIGHT_STICK"));
 	commandRegistry.Add((new JSMAssignment<StickMode>(right_stick_mode))
@@ -3419,8 +4354,13 @@ int main(int argc, char *argv[])
 	commandRegistry.Add((new JSMAssignment<AxisMode>(gyro_y_sign))
 	                      ->SetHelp("Set gyro Y axis inversion. Valid values are the following:\nSTANDARD or 1, and INVERTED or -1"));
 	commandRegistry.Add((new JSMMacro("RECONNECT_CONTROLLERS"))->SetMacro(bind(&do_RECONNECT_CONTROLLERS, placeholders::_2))->SetHelp("Look for newly connected controllers. Specify MERGE (default) or SPLIT whether you want to consider joycons as a single or separate controllers."));
+	commandRegistry.Add((new JSMMacro("LOG_LEVEL"))->SetMacro(bind(&do_LOG_LEVEL, placeholders::_2))->SetHelp("Set how much is printed while processing controllers: LOG_LEVEL [BUTTONS|FLICK|RUMBLE|VIGEM] OFF|ON|VERBOSE. Without a category, all of them are set. Without arguments, the current levels are displayed."));
+	commandRegistry.Add((new JSMMacro("STATS"))->SetMacro(bind(&do_STATS, placeholders::_2))->SetHelp("Display how long each step of processing controller input takes, per controller. Enter STATS RESET to start measuring again."));
+	commandRegistry.Add((new JSMMacro("RECORD"))->SetMacro(bind(&do_RECORD, placeholders::_2))->SetHelp("Record the input of all controllers to a file: RECORD <file>. Enter RECORD OFF to stop recording."));
+	commandRegistry.Add((new JSMMacro("REPLAY"))->SetMacro(bind(&do_REPLAY, placeholders::_2))->SetHelp("Process a recording with the current settings as fast as possible and report how long it took: REPLAY <file> [<output file>]. Output is written to the output file instead of moving the mouse and pressing keys."));
+	commandRegistry.Add((new JSMMacro("WATCH"))->SetMacro(bind(&do_WATCH, &commandRegistry, placeholders::_2))->SetHelp("Load a configuration file and apply changes to it as soon as they are saved: WATCH <file>. Only settings and mappings that changed are assigned again, without releasing held buttons. Enter WATCH OFF to stop, or WATCH alone to see which file is watched."));
 	commandRegistry.Add((new JSMMacro("COUNTER_OS_MOUSE_SPEED"))->SetMacro(bind(do_COUNTER_OS_MOUSE_SPEED))->SetHelp("JoyShockMapper will load the user's OS mouse sensitivity value to consider it in its calculations."));
-	commandRegistry.Add((new JSMMacro("IGNORE_OS_MOUSE_SPEED"))->SetMacro(bind(do_IGNORE_OS_MOUSE_SPEED))->SetHelp("Disable JoyShockMapper's consideration of the the user's OS mouse sensitivity value."));
+	commandRegistry.Add((new JSMMacro("IGNORE_OS_MOUSE_SPEED"))->SetMacro(bind(do_IGNORE_OS_MOUSE_SPEED))->SetHelp("Disable JoyShockMapper's consideration of the the user's OS mouse sensitivity value.")->SetOnlyChangesVariables());
 	commandRegistry.Add((new JSMAssignment<JoyconMask>(joycon_gyro_mask))
 	                      ->SetHelp("When using two Joycons, select which one will be used for gyro. Valid values are the following:\nUSE_BOTH, IGNORE_LEFT, IGNORE_RIGHT, IGNORE_BOTH"));
 	commandRegistry.Add((new JSMAssignment<JoyconMask>(joycon_motion_mask))
@@ -3519,9 +4459,28 @@ int main(int argc, char *argv[])
 	commandRegistry.Add((new JSMAssignment<float>("DBL_PRESS_WINDOW", dbl_press_window))
 	                      ->SetHelp("Sets the amount of time in milliseconds within which the user needs to press a button twice before enabling the double press mappings. This setting does not support modeshift."));
 	commandRegistry.Add((new JSMAssignment<float>("TICK_TIME", tick_time))
-	                      ->SetHelp("Sets the time in milliseconds that JoyShockMaper waits before reading from each controller again."));
+	                      ->SetHelp("Sets the maximum time in milliseconds that JoyShockMaper waits for a new report before reading from each controller again. It can be a fraction of a millisecond."));
+	commandRegistry.Add((new JSMAssignment<float>("OUTPUT_RATE", output_rate))
+	                      ->SetHelp("Sets how many times per second gyro and stick mouse motion is sent, between 60 and 8000. The motion of each controller report is spread evenly until the next report is expected, which makes low rate controllers look smoother. 0, the default, sends motion as soon as each report is processed."));
+	commandRegistry.Add((new JSMAssignment<float>("OUTPUT_EXTRAPOLATION", output_extrapolation))
+	                      ->SetHelp("With OUTPUT_RATE, sets for how many milliseconds, up to 20, mouse motion keeps going when a controller report is late. Overshooting motion is taken back from the next report. Defaults to 0."));
+#ifdef JSM_SDL_BACKEND
+	commandRegistry.Add((new JSMAssignment<float>("TICK_SPIN_TIME", tick_spin_time))
+	                      ->SetHelp("Sets how many milliseconds before each tick to stop sleeping and keep the CPU busy instead, up to 2, so that ticks happen on time. Useful with a TICK_TIME below 1. Defaults to 0."));
+#endif
+#ifdef JSM_SDL_BACKEND
+	commandRegistry.Add((new JSMAssignment<int>("PROCESSING_CPU", processing_cpu))
+	                      ->SetHelp("Each controller is processed on a thread of its own. Set this to pin the first controller's thread to that CPU, the next one to the following CPU and so on. -1 leaves it to the OS. It applies the next time controllers are connected."));
+	commandRegistry.Add((new JSMAssignment<int>("INPUT_THREAD_PRIORITY", input_thread_priority))
+	                      ->SetHelp("Set between 1 and 99 to have the threads reading and processing controllers run with real-time scheduling at that priority, so that a busy game doesn't delay them. Without the permission to do so, they get the best priority allowed instead. 0 is the default scheduling."));
+	commandRegistry.Add((new JSMAssignment<int>("INPUT_THREAD_CPU", input_thread_cpu))
+	                      ->SetHelp("Pin the thread reading the controllers to that CPU. -1 leaves it to the OS."));
+	commandRegistry.Add((new JSMAssignment<Switch>("LOCK_MEMORY", lock_memory))
+	                      ->SetHelp("Set to ON to keep JoyShockMapper in RAM, so that processing input never waits for memory to be paged in. Linux only."));
+#endif
 	commandRegistry.Add((new JSMAssignment<PathString>("JSM_DIRECTORY", currentWorkingDir))
-	                      ->SetHelp("If AUTOLOAD doesn't work properly, set this value to the path to the directory holding the JoyShockMapper.exe file. Make sure a folder named \"AutoLoad\" exists there."));
+	                      ->SetHelp("If AUTOLOAD doesn't work properly, set this value to the path to the directory holding the JoyShockMapper.exe file. Make sure a folder named \"AutoLoad\" exists there.")
+	                      ->SetOnlyChangesVariables(false)); // Its filter changes the working directory
 	commandRegistry.Add((new JSMAssignment<Color>(light_bar))
 	                      ->SetHelp("Changes the color bar of the DS4. Either enter as a hex code (xRRGGBB), as three decimal values between 0 and 255 (RRR GGG BBB), or as a common color name in all caps and underscores."));
 	commandRegistry.Add(new HelpCmd(commandRegistry));
@@ -3529,6 +4488,9 @@ int main(int argc, char *argv[])
 	                      ->SetHelp("Sets the vigem virtual controller type. Can be NONE (default), XBOX (360) or DS4 (PS4)."));
 	commandRegistry.Add((new JSMAssignment<FloatXY>(scroll_sens))
 	                      ->SetHelp("Scrolling sensitivity for sticks."));
+	commandRegistry.Add((new JSMAssignment<OutputDevice>("OUTPUT_DEVICE", output_device))
+	                      ->SetHelp("Sets where keyboard and mouse output goes. OS (default) sends it to the OS like a real keyboard and mouse. SHARED_MEMORY publishes it to the shared memory segment " + string(SHARED_OUTPUT_NAME) + " for games made to read it, with mouse motion in fractions of pixels and the orientation of each controller. See SharedMemoryOutput.h. Linux only.")
+	                      ->SetOnlyChangesVariables(false)); // Its filter opens the shared memory
 
 	bool quit = false;
 	commandRegistry.Add((new JSMMacro("QUIT"))
@@ -3540,6 +4502,15 @@ int main(int argc, char *argv[])
 
 	Mapping::_isCommandValid = bind(&CmdRegistry::isCommandValid, &commandRegistry, placeholders::_1);
 
+#ifdef JSM_HEADLESS
+#ifdef JSM_BENCHMARK
+	int result = runBenchmarks(commandRegistry, argc, argv);
+#else
+	int result = runReplayTool(commandRegistry, argc, argv);
+#endif
+	flushLog();
+	return result;
+#else
 	JslSetCallback(&joyShockPollCallback);
 	connectDevices();
 	tray.reset(new TrayIcon(trayIconData, &beforeShowTrayMenu));
@@ -3567,5 +4538,7 @@ int main(int argc, char *argv[])
 		loading_lock.unlock();
 	}
 	CleanUp();
+	flushLog();
 	return 0;
+#endif // JSM_HEADLESS
 }
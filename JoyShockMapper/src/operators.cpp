@@ -20,19 +20,21 @@ static optional<float> getFloat(const string &str, size_t *newpos = nullptr)
 	}
 }
 
+ButtonID toButtonID(string_view name)
+{
+	if (name == "-")
+		return ButtonID::MINUS;
+	if (name == "+")
+		return ButtonID::PLUS;
+	auto opt = magic_enum::enum_cast<ButtonID>(name);
+	return opt && *opt != ButtonID::SIZE ? *opt : ButtonID::INVALID; // SIZE is not a button
+}
+
 istream &operator>>(istream &in, ButtonID &rhv)
 {
 	string s;
 	in >> s;
-	if (s.compare("-") == 0)
-		rhv = ButtonID::MINUS;
-	else if (s.compare("+") == 0)
-		rhv = ButtonID::PLUS;
-	else
-	{
-		auto opt = magic_enum::enum_cast<ButtonID>(s);
-		rhv = opt ? *opt : ButtonID::INVALID;
-	}
+	rhv = toButtonID(s);
 	return in;
 }
 
@@ -1,9 +1,11 @@
 #include "InputHelpers.h"
 
+#include <mutex>
 #include <unordered_map>
 
 static float accumulatedX = 0;
 static float accumulatedY = 0;
+static std::mutex accumulatedLock; // Each controller moves the mouse from its own thread
 
 // Windows' mouse speed settings translate non-linearly to speed.
 // Thankfully, the mappings are available here: https://liquipedia.net/counterstrike/Mouse_settings#Windows_Sensitivity
@@ -53,8 +55,33 @@ std::unordered_map<WORD, std::tuple<DWORD, DWORD, DWORD>> mouseMaps = {
 	{ V_WHEEL_DOWN, {MOUSEEVENTF_WHEEL, 0, -WHEEL_DELTA} },
 };
 
+static thread_local OutputSink *outputSink = nullptr;
+
+void setOutputSink(OutputSink *sink) {
+	outputSink = sink;
+}
+
+bool hasOutputSink() {
+	return outputSink != nullptr;
+}
+
+// Shared memory output relies on POSIX shared memory, so it is Linux only for now
+bool setOutputDevice(OutputDevice device) {
+	return device == OutputDevice::OS;
+}
+
+void setOrientation(int handle, float w, float x, float y, float z) {
+	if (outputSink) {
+		outputSink->setOrientation(handle, w, x, y, z);
+	}
+}
+
 // send mouse button
 int pressMouse(KeyCode vkKey, bool isPressed) {
+	if (outputSink) {
+		outputSink->pressKey(vkKey, isPressed);
+		return 0;
+	}
 	// https://docs.microsoft.com/en-us/windows/win32/api/winuser/ns-winuser-mouseinput
 	auto val = mouseMaps[vkKey.code];
 	
@@ -96,6 +123,10 @@ int pressMouse(KeyCode vkKey, bool isPressed) {
 // send key press
 int pressKey(KeyCode vkKey, bool pressed) {
 	if (vkKey.code == 0) return 0;
+	if (outputSink) {
+		outputSink->pressKey(vkKey, pressed);
+		return 0;
+	}
 	if (vkKey.code <= V_WHEEL_DOWN) { // Highest mouse ID
 		return pressMouse(vkKey, pressed);
 	}
@@ -117,14 +148,22 @@ int pressKey(KeyCode vkKey, bool pressed) {
 }
 
 void moveMouse(float x, float y) {
-	accumulatedX += x;
-	accumulatedY += y;
+	if (outputSink) {
+		outputSink->moveMouse(x, y);
+		return;
+	}
+	int applicableX, applicableY;
+	{
+		std::lock_guard<std::mutex> guard(accumulatedLock);
+		accumulatedX += x;
+		accumulatedY += y;
 
-	int applicableX = (int)accumulatedX;
-	int applicableY = (int)accumulatedY;
+		applicableX = (int)accumulatedX;
+		applicableY = (int)accumulatedY;
 
-	accumulatedX -= applicableX;
-	accumulatedY -= applicableY;
+		accumulatedX -= applicableX;
+		accumulatedY -= applicableY;
+	}
 	//COUT << setprecision(4) << accumulatedX << ' ' << accumulatedY << endl;
 
 	INPUT input;
@@ -137,7 +176,18 @@ void moveMouse(float x, float y) {
 	SendInput(1, &input, sizeof(input));
 }
 
+// SendInput is called as output happens
+void beginOutputFrame() {
+}
+
+void flushOutputFrame() {
+}
+
 void setMouseNorm(float x, float y) {
+	if (outputSink) {
+		outputSink->setMouseNorm(x, y);
+		return;
+	}
 	INPUT input;
 	input.type = INPUT_MOUSE;
 	input.mi.mouseData = 0;
@@ -245,6 +295,136 @@ std::tuple<std::string, std::string> GetActiveWindowName() {
 	return { "", "" };
 }
 
+static thread_local bool foregroundChanged = false;
+
+static void CALLBACK OnForegroundChanged(HWINEVENTHOOK, DWORD, HWND, LONG, LONG, DWORD, DWORD)
+{
+	foregroundChanged = true;
+}
+
+bool WaitForFocusChange(int timeoutMs)
+{
+	// The hook calls back on the thread that set it, while it waits for messages
+	struct ForegroundHook
+	{
+		HWINEVENTHOOK handle = SetWinEventHook(EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND, nullptr, &OnForegroundChanged, 0, 0, WINEVENT_OUTOFCONTEXT);
+		bool isNew = true;
+
+		~ForegroundHook()
+		{
+			if (handle)
+				UnhookWinEvent(handle);
+		}
+	};
+	static thread_local ForegroundHook hook;
+	if (!hook.handle)
+	{
+		Sleep(timeoutMs);
+		return true;
+	}
+	if (hook.isNew)
+	{
+		hook.isNew = false;
+		return true; // Whatever is in focus right now hasn't been looked at yet
+	}
+
+	const ULONGLONG deadline = GetTickCount64() + timeoutMs;
+	while (!foregroundChanged)
+	{
+		ULONGLONG now = GetTickCount64();
+		if (now >= deadline)
+		{
+			return false;
+		}
+		MsgWaitForMultipleObjects(0, nullptr, FALSE, DWORD(deadline - now), QS_ALLINPUT);
+		MSG msg;
+		while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+		{
+			TranslateMessage(&msg);
+			DispatchMessage(&msg);
+		}
+	}
+	foregroundChanged = false;
+	return true;
+}
+
+DirectoryWatcher::DirectoryWatcher(in_string directory)
+  : DirectoryWatcher(std::vector<std::string>{ directory }, false)
+{
+}
+
+DirectoryWatcher::DirectoryWatcher(const std::vector<std::string> &directories, bool watchContents)
+{
+	DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME;
+	if (watchContents)
+	{
+		filter |= FILE_NOTIFY_CHANGE_LAST_WRITE;
+	}
+	for (auto &directory : directories)
+	{
+		HANDLE notification = FindFirstChangeNotificationA(directory.c_str(), FALSE, filter);
+		if (notification != INVALID_HANDLE_VALUE && _handles.size() == MAXIMUM_WAIT_OBJECTS)
+		{
+			FindCloseChangeNotification(notification);
+			notification = INVALID_HANDLE_VALUE;
+		}
+		if (notification == INVALID_HANDLE_VALUE)
+		{
+			// Not watching some of them is the same as not watching any
+			for (auto handle : _handles)
+			{
+				FindCloseChangeNotification(reinterpret_cast<HANDLE>(handle));
+			}
+			_handles.clear();
+			return;
+		}
+		_handles.push_back(reinterpret_cast<intptr_t>(notification));
+	}
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+	for (auto handle : _handles)
+	{
+		FindCloseChangeNotification(reinterpret_cast<HANDLE>(handle));
+	}
+}
+
+bool DirectoryWatcher::HasChanged()
+{
+	if (_handles.empty())
+	{
+		return true;
+	}
+	bool changed = false;
+	for (auto handle : _handles)
+	{
+		HANDLE notification = reinterpret_cast<HANDLE>(handle);
+		if (WaitForSingleObject(notification, 0) == WAIT_OBJECT_0)
+		{
+			FindNextChangeNotification(notification);
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+bool DirectoryWatcher::WaitForChange(int timeoutMs)
+{
+	if (_handles.empty())
+	{
+		Sleep(timeoutMs);
+		return true;
+	}
+	std::vector<HANDLE> handles;
+	for (auto handle : _handles)
+	{
+		handles.push_back(reinterpret_cast<HANDLE>(handle));
+	}
+	DWORD result = WaitForMultipleObjects(DWORD(handles.size()), handles.data(), FALSE, timeoutMs);
+	return result < WAIT_OBJECT_0 + _handles.size() && HasChanged();
+}
+
 std::vector<std::string> ListDirectory(std::string directory)
 {
 	std::vector<std::string> fileListing;
@@ -313,9 +493,11 @@ PollingThread::~PollingThread()
 }
 
 bool PollingThread::Start() {
-	if (_thread && !_continue) // thread is running but hasn't stopped yet
+	// thread is running but hasn't stopped yet. Loop content may block for a while, so wait for the thread to end.
+	// Not forever though: it could be waiting on a lock held by the caller.
+	for (int waited = 0; _thread && !_continue && waited < 2000; waited += 10)
 	{
-		Sleep(_sleepTimeMs);
+		Sleep(10);
 	}
 	if (!_thread) //thread is clear
 	{
@@ -0,0 +1,119 @@
+// Behaviour checks of Trackball and the SmoothingBuffer it keeps its history in. Both are self-contained,
+// so this builds on its own and runs with ctest. It prints every failed check and returns non-zero if any.
+
+#include "Trackball.hpp"
+
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+int failures = 0;
+
+void check(bool passed, const char *what, float value, float expected)
+{
+	if (!passed)
+	{
+		std::printf("FAILED: %s: got %g, expected %g\n", what, value, expected);
+		++failures;
+	}
+}
+
+void checkNear(float value, float expected, const char *what)
+{
+	// Relative, since decayed values get very small
+	check(std::abs(value - expected) <= 1e-4f * std::abs(expected) + 1e-12f, what, value, expected);
+}
+
+void testSmoothingWindow()
+{
+	SmoothingBuffer buffer(4);
+	buffer.SetWindow(3);
+	for (float value : { 1.f, 2.f, 3.f, 4.f })
+	{
+		buffer.Push(value);
+	}
+	checkNear(buffer.Average(), 3.f, "average of the last 3 samples");
+	// Growing the window brings back samples older than it, even past the initial capacity
+	buffer.SetWindow(8);
+	checkNear(buffer.Sum(), 10.f, "sum once the window grew");
+	buffer.SetWindow(2);
+	checkNear(buffer.Average(), 3.5f, "average once the window shrank");
+	buffer.Scale(0.5f);
+	checkNear(buffer.Average(), 1.75f, "average once scaled");
+	buffer.SetWindow(4);
+	checkNear(buffer.Sum(), 5.f, "samples outside the window are scaled too");
+}
+
+void testDecay()
+{
+	Trackball trackball;
+	for (int i = 0; i < 10; ++i)
+	{
+		trackball.Push(8.f, 10);
+	}
+	float expected = 8.f;
+	for (int i = 0; i < 4; ++i)
+	{
+		checkNear(trackball.Roll(0.5f, 10, 100.f), expected, "rolling decays by the given factor");
+		expected *= 0.5f;
+	}
+	// Rolling averages the window only
+	trackball.Reset();
+	for (int i = 0; i < 10; ++i)
+	{
+		trackball.Push(i < 5 ? 0.f : 4.f, 10);
+	}
+	checkNear(trackball.Roll(1.f, 5, 100.f), 4.f, "rolling averages the most recent samples");
+	checkNear(trackball.Roll(1.f, 10, 100.f), 2.f, "rolling averages the whole window");
+}
+
+void testMaxSpeed()
+{
+	Trackball trackball;
+	trackball.Push(-50.f, 1);
+	checkNear(trackball.Roll(1.f, 1, 20.f), -20.f, "rolling never goes faster than maxSpeed");
+}
+
+void testFoldBack()
+{
+	// A decay of 0.1 takes the scale below its minimum of 1e-4 on the 5th roll, when it is folded into the samples
+	Trackball trackball;
+	for (int i = 0; i < 4; ++i)
+	{
+		trackball.Push(3.f, 4);
+	}
+	float expected = 3.f;
+	for (int i = 0; i < 8; ++i)
+	{
+		checkNear(trackball.Roll(0.1f, 4, 100.f), expected, "decay carries on across the fold-back");
+		expected *= 0.1f;
+	}
+	// New samples are stored against the folded scale, so they mix with the decayed history at full value
+	trackball.Push(2.f, 4);
+	checkNear(trackball.Roll(1.f, 4, 100.f), (2.f + 3.f * expected) / 4.f, "samples pushed after the fold-back");
+
+	// The scale folds back the same way when it grows
+	trackball.Reset();
+	trackball.Push(1e-6f, 1);
+	expected = 1e-6f;
+	for (int i = 0; i < 8; ++i)
+	{
+		checkNear(trackball.Roll(10.f, 1, 100.f), expected, "growth carries on across the fold-back");
+		expected *= 10.f;
+	}
+}
+} // namespace
+
+int main()
+{
+	testSmoothingWindow();
+	testDecay();
+	testMaxSpeed();
+	testFoldBack();
+	if (failures == 0)
+	{
+		std::printf("All trackball checks passed\n");
+	}
+	return failures == 0 ? 0 : 1;
+}
@@ -18,6 +18,7 @@ if (UNIX AND NOT APPLE)
         PkgConfig::evdev
         pthread
         dl
+        rt
     )
 
     add_library (Platform::Dependencies ALIAS platform_dependencies)